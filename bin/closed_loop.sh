@@ -0,0 +1,15 @@
+#!/bin/bash
+# Drive ../build/pid (or the program given, e.g. twiddle) with the offline simulator stand-in,
+# as fast as it answers, and fail if the car's MAE is above MAX_MAE.
+PROGRAM=${1:-pid}
+FRAMES=${FRAMES:-4000}
+MAX_MAE=${MAX_MAE:-1.5}
+
+cd ../build
+./$PROGRAM > closed_loop_$PROGRAM.out &
+server_pid=$!
+sleep 1
+./sim_client --lockstep --frames $FRAMES --max-mae $MAX_MAE
+status=$?
+kill $server_pid
+exit $status
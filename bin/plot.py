@@ -1,6 +1,9 @@
 import matplotlib.pyplot as plt
 import numpy as np
+import os
+import subprocess
 from sys import argv
+import pyramid
 
 plot_fname_segments = []
 def add_fname_segment(name, value, format='%s'):
@@ -17,112 +20,144 @@ if len(argv) == 1:
 else:
     fname = argv[1]
 
-# Read twiddle log.
-with open(fname, 'r') as f:
-    lines = f.readlines()
-
-# Read CTE log.
-cte_history = []
-cte_history_times = []
-steer_history = []
-throttle_history = []
-ierr_history = []
-t0_cte = None
 # Discard the first fraction of a minute of telemetry.
 cte_discard = 0.1 * 1000 * 60
-with open('../build/cte.csv', 'r') as ctefile:
-    for line in ctefile.readlines():
-        t, cte, speed, angle, steer, throttle, ierr = line.split(',')
-        t = int(t)
-        if t0_cte is None:
-            t0_cte = t
-        if t - t0_cte > cte_discard:
-            cte_history.append(float(cte))
-            cte_history_times.append(t)
-            steer_history.append(float(steer))
-            throttle_history.append(float(throttle))
-            ierr_history.append(ierr)
-
-parameter_history = []
-parameter_history_times = []
-
-accepted_parameter_history = []
-accepted_parameter_history_times = []
-
-diff_parameter_history = []
-diff_parameter_history_times = []
-
-std_history = []
-std_history_times = []
-
-mae_history = []
-mae_history_times = []
-
-obj_history = []
-obj_history_times = []
-
-cycle_start_times = []
-param_modification_times = []
-success_times = []
-
-
-def parse_time_from_line(l):
-    if '|' in l:
-        l = l.split('|')
-        assert len(l) == 2
-        return long(l[0]), l[1].strip()
-    else:
-        return None, l
-
-
-for l in lines:
-    t_clock, l = parse_time_from_line(l)
-
-    if t_clock is None:
-        continue
-
-    if 'succeed' in l:
-        accepted_parameter_history.append(parameter_history[-1])
-        accepted_parameter_history_times.append(parameter_history_times[-1])
-        success_times.append(t_clock)
-
-    elif 'dp =' in l:
-        exec(l)
-        if len(dp) == nparam:
-            diff_parameter_history.append(dp)
-            diff_parameter_history_times.append(t_clock)
-
-    elif 'p =' in l:
-        param_modification_times.append(t_clock)
-        exec(l)
-        if len(p) == nparam:
-            parameter_history.append(p)
-            parameter_history_times.append(t_clock)
-
-    elif '>Mean absolute error' in l:
-        mae_history.append(
-            float(l.split('=')[-1])
-        )
-        mae_history_times.append(t_clock)
-
-    elif '>Stdd error' in l:
-        std_history.append(
-            float(l.split('=')[-1])
-        )
-        std_history_times.append(t_clock)
-
-    elif 'objective = ' in l:
-        obj_history.append(
-            float(l.split('=')[-1])
-        )
-        obj_history_times.append(t_clock)
-
-    elif 'Twiddle iteration' in l:
-        cycle_start_times.append(t_clock)
-
-    elif 'i=' in l:
-        i_attempt = 0
-        i_param = int(l.replace('-', '').replace('i=', ''))
+
+# With the pidlog tool built (see README), let it do the parsing; it is much faster on long logs.
+PIDLOG = '../build/pidlog'
+PIDLOG_DIR = '../build/pidlog_series'
+
+def load_series(name):
+    a = np.loadtxt(os.path.join(PIDLOG_DIR, name), delimiter=',', skiprows=1, ndmin=2)
+    return a[:, 0], a[:, 1:]
+
+if os.path.exists(PIDLOG):
+    subprocess.check_call([PIDLOG, fname, '../build/cte.csv', '--out', PIDLOG_DIR,
+        '--nparam', str(nparam), '--discard-ms', str(int(cte_discard))])
+
+    telemetry = np.fromfile(os.path.join(PIDLOG_DIR, 'telemetry.bin')).reshape((-1, 7))
+    cte_history_times = telemetry[:, 0]
+    cte_history = telemetry[:, 1]
+    steer_history = telemetry[:, 4]
+    throttle_history = telemetry[:, 5]
+    ierr_history = telemetry[:, 6]
+
+    parameter_history_times, parameter_history = load_series('params.csv')
+    accepted_parameter_history_times, accepted_parameter_history = load_series('accepted.csv')
+    diff_parameter_history_times, diff_parameter_history = load_series('dp.csv')
+    mae_history_times, mae_history = load_series('mae.csv')
+    std_history_times, std_history = load_series('stdd.csv')
+    obj_history_times, obj_history = load_series('objective.csv')
+    mae_history, std_history, obj_history = mae_history[:, 0], std_history[:, 0], obj_history[:, 0]
+    cycle_start_times = load_series('iterations.csv')[0]
+    param_modification_times = load_series('modifications.csv')[0]
+    success_times = load_series('successes.csv')[0]
+
+else:
+    # Read twiddle log.
+    with open(fname, 'r') as f:
+        lines = f.readlines()
+
+    # Read CTE log.
+    cte_history = []
+    cte_history_times = []
+    steer_history = []
+    throttle_history = []
+    ierr_history = []
+    t0_cte = None
+    with open('../build/cte.csv', 'r') as ctefile:
+        for line in ctefile.readlines():
+            t, cte, speed, angle, steer, throttle, ierr = line.split(',')
+            t = int(t)
+            if t0_cte is None:
+                t0_cte = t
+            if t - t0_cte > cte_discard:
+                cte_history.append(float(cte))
+                cte_history_times.append(t)
+                steer_history.append(float(steer))
+                throttle_history.append(float(throttle))
+                ierr_history.append(ierr)
+
+    parameter_history = []
+    parameter_history_times = []
+
+    accepted_parameter_history = []
+    accepted_parameter_history_times = []
+
+    diff_parameter_history = []
+    diff_parameter_history_times = []
+
+    std_history = []
+    std_history_times = []
+
+    mae_history = []
+    mae_history_times = []
+
+    obj_history = []
+    obj_history_times = []
+
+    cycle_start_times = []
+    param_modification_times = []
+    success_times = []
+
+
+    def parse_time_from_line(l):
+        if '|' in l:
+            l = l.split('|', 1)
+            assert len(l) == 2
+            return long(l[0]), l[1].strip()
+        else:
+            return None, l
+
+
+    for l in lines:
+        t_clock, l = parse_time_from_line(l)
+
+        if t_clock is None:
+            continue
+
+        if 'succeed' in l:
+            accepted_parameter_history.append(parameter_history[-1])
+            accepted_parameter_history_times.append(parameter_history_times[-1])
+            success_times.append(t_clock)
+
+        elif 'dp =' in l:
+            exec(l)
+            if len(dp) == nparam:
+                diff_parameter_history.append(dp)
+                diff_parameter_history_times.append(t_clock)
+
+        elif 'p =' in l:
+            param_modification_times.append(t_clock)
+            exec(l)
+            if len(p) == nparam:
+                parameter_history.append(p)
+                parameter_history_times.append(t_clock)
+
+        elif '>Mean absolute error' in l:
+            mae_history.append(
+                float(l.split('=')[-1])
+            )
+            mae_history_times.append(t_clock)
+
+        elif '>Stdd error' in l:
+            std_history.append(
+                float(l.split('=')[-1])
+            )
+            std_history_times.append(t_clock)
+
+        elif 'objective = ' in l:
+            obj_history.append(
+                float(l.split('=')[-1])
+            )
+            obj_history_times.append(t_clock)
+
+        elif 'Twiddle iteration' in l:
+            cycle_start_times.append(t_clock)
+
+        elif 'i=' in l:
+            i_attempt = 0
+            i_param = int(l.replace('-', '').replace('i=', ''))
 
 ar = lambda v: np.array(v).astype(float)
 
@@ -197,16 +232,33 @@ if len(mae_history_times) > 0:
     ax2.plot(obj_history_times, obj_history, 
         color='blue', linewidth=1, linestyle='-', label='objective$(t)$')
 
-ax.plot(cte_history_times, cte_history,
-        color='black', alpha=.25, linestyle='-', label='raw cte$(t)$')
-ax.plot(cte_history_times, steer_history,
-        color='red', alpha=.25, linestyle='-', label='steer$(t)$')
-ax.plot(cte_history_times, throttle_history,
-        color='green', alpha=.25, linestyle='-', label='throttle$(t)$')
-
 div = 50
-ax.plot(cte_history_times, ar(ierr_history) / div,
-        color='indigo', alpha=.25, linestyle='--', label='$\int$ error $(t)$ $/%d$' % div)
+series = [
+    (cte_history, 'cte', 1, dict(color='black', alpha=.25, linestyle='-', label='raw cte$(t)$')),
+    (steer_history, 'steer', 1, dict(color='red', alpha=.25, linestyle='-', label='steer$(t)$')),
+    (throttle_history, 'throttle', 1, dict(color='green', alpha=.25, linestyle='-', label='throttle$(t)$')),
+    (ierr_history, 'i_error', div, dict(color='indigo', alpha=.25, linestyle='--',
+        label='$\int$ error $(t)$ $/%d$' % div)),
+]
+
+# With the pyramid tool built (see README), draw a few thousand LTTB points and
+# the min/max envelope of each series instead of every sample.
+PYRAMID = '../build/pyramid'
+MAX_PLOT_POINTS = 4000
+selection = None
+if os.path.exists(PYRAMID) and len(cte_history_times) > MAX_PLOT_POINTS:
+    subprocess.check_call([PYRAMID, '../build/cte.csv'])
+    selection = pyramid.select('../build/cte.csv.pyramid', MAX_PLOT_POINTS,
+        t0=t0 + cte_history_times[0] * 1000 * 60)
+
+for values, name, scale, style in series:
+    if selection is None:
+        ax.plot(cte_history_times, ar(values) / scale, **style)
+    else:
+        level = selection[1]
+        ax.plot((level[name]['t'] - t0) / (1000 * 60), level[name]['v'] / scale, **style)
+        ax.fill_between((level['t_first'] - t0) / (1000 * 60), level[name]['min'] / scale,
+            level[name]['max'] / scale, color=style['color'], alpha=.1, linewidth=0)
 
 
 ax.grid(False)
@@ -0,0 +1,81 @@
+"""Read the multi-resolution plotting pyramid that `pyramid` builds next to a cte.csv log (see src/pyramid.h)."""
+import os
+import numpy as np
+
+COLUMNS = ['cte', 'speed', 'angle', 'steer', 'throttle', 'i_error']
+NCOLS = len(COLUMNS)
+
+
+def level_fname(path, level):
+    return os.path.join(path, 'level_%d.bin' % level)
+
+
+def num_levels(path):
+    level = 0
+    while os.path.exists(level_fname(path, level)) and os.path.getsize(level_fname(path, level)) > 0:
+        level += 1
+    return level
+
+
+def load_level(path, level):
+    """Bucket times, and for each column the representative points and the min/max envelope.
+    The file is memory-mapped, so only the parts used are read."""
+    a = np.memmap(level_fname(path, level), dtype=np.float64, mode='r')
+    if level == 0:
+        a = a.reshape((-1, 1 + NCOLS))
+        out = {'t_first': a[:, 0], 't_last': a[:, 0]}
+        for c, name in enumerate(COLUMNS):
+            v = a[:, 1 + c]
+            out[name] = {'t': a[:, 0], 'v': v, 'min': v, 'max': v}
+    else:
+        a = a.reshape((-1, 3 + 4 * NCOLS))
+        out = {'t_first': a[:, 0], 't_last': a[:, 1]}
+        for c, name in enumerate(COLUMNS):
+            b = 3 + 4 * c
+            out[name] = {'t': a[:, b], 'v': a[:, b + 1], 'min': a[:, b + 2], 'max': a[:, b + 3]}
+    return out
+
+
+def _crop(data, lo, hi):
+    out = {'t_first': data['t_first'][lo:hi], 't_last': data['t_last'][lo:hi]}
+    for name in COLUMNS:
+        out[name] = dict((k, v[lo:hi]) for k, v in data[name].items())
+    return out
+
+
+def _concatenate(a, b):
+    out = {'t_first': np.concatenate([a['t_first'], b['t_first']]),
+           't_last': np.concatenate([a['t_last'], b['t_last']])}
+    for name in COLUMNS:
+        out[name] = dict((k, np.concatenate([a[name][k], b[name][k]])) for k in a[name])
+    return out
+
+
+def select(path, max_points=4000, t0=None, t1=None):
+    """The finest level with at most max_points buckets between t0 and t1 [ms],
+    completed with the newest samples from the levels below it.
+    Returns (level, data) with data as from load_level, or None if there is no pyramid."""
+    chosen = None
+    for level in range(num_levels(path) - 1, -1, -1):
+        candidate = load_level(path, level)
+        n = len(candidate['t_first'])
+        lo = 0 if t0 is None else np.searchsorted(candidate['t_last'], t0, 'left')
+        hi = n if t1 is None else np.searchsorted(candidate['t_first'], t1, 'right')
+        if chosen is not None and hi - lo > max_points:
+            break
+        chosen = (level, _crop(candidate, lo, hi))
+    if chosen is None:
+        return None
+    level, data = chosen
+
+    # A level lags the one below by up to two of its buckets; take the rest from there.
+    for below in range(level - 1, -1, -1):
+        tail = load_level(path, below)
+        n = len(tail['t_first'])
+        last = data['t_last'][-1] if len(data['t_last']) > 0 else -np.inf
+        lo = np.searchsorted(tail['t_first'], last, 'right')
+        if t0 is not None:
+            lo = max(lo, np.searchsorted(tail['t_last'], t0, 'left'))
+        hi = n if t1 is None else np.searchsorted(tail['t_first'], t1, 'right')
+        data = _concatenate(data, _crop(tail, lo, max(lo, hi)))
+    return level, data
@@ -1,12 +1,33 @@
 #!/bin/bash
 DELAY=32
+last_windows=""
 while true
 do
+    # With twiddle running with --follow, ask it which log it follows and how many windows it has
+    # scored, and only replot when that changed; plot.py leaves the parsing to pidlog and pyramid.
+    tune="`curl -s localhost:4567/tune`"
+    if [ -n "$tune" ]
+    then
+        read windows last <<< "`echo "$tune" | python -c 'import json, sys; d = json.load(sys.stdin); sys.stdout.write("%s %s\n" % (d["windows"], d["file"]))'`"
+        # twiddle runs from ../build, so a relative --follow path is relative to there.
+        case "$last" in
+            /*) ;;
+            *) last="../build/$last" ;;
+        esac
+        if [ "$windows" == "$last_windows" ]
+        then
+            sleep $DELAY
+            continue
+        fi
+        last_windows="$windows"
+    else
+        last="`ls -t ../build/twiddle_* | head -n 1`"
+    fi
+
     # Get the former active window id.
     active_wid=`xprop -root 32x '\t$0' _NET_ACTIVE_WINDOW | cut -f 2`
 
     # Make the plot.
-    last="`ls -t ../build/twiddle_* | head -n 1`" 
     python plot.py "$last" &
     child_pid=$!
     sleep 5
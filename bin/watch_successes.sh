@@ -1,2 +1,8 @@
 #!/bin/bash
-watch "grep succeeded \"\`ls -t ../build/twiddle_* | head -n 1\`\""
+# With twiddle running with --follow, ask it for the run's summary instead of re-reading the whole log.
+if [ -n "`curl -s localhost:4567/tune`" ]
+then
+    watch "curl -s localhost:4567/tune"
+else
+    watch "grep succeeded \"\`ls -t ../build/twiddle_* | head -n 1\`\""
+fi
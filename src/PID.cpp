@@ -1,15 +1,7 @@
 #include <iostream>
+#include <cstring>  // memcpy
 #include "PID.h"
 
-/*
- * How long should the deque of error values be when computing the i term?
- *
- * 200 samples (About 49 [ms] each) is roughly enough time
- * to judge manually whether we're turning,
- * and so probably enough time to keep track of integrated history.
- */
-#define MAX_CTE_HISTORY_LENGTH 200
-
 using namespace std;
 
 /*
@@ -20,6 +12,8 @@ PID::PID() {
     p_error = 0;
     i_error = 0;
     d_error = 0;
+    history_start = 0;
+    history_size = 0;
     last_t = epoch_time();
 }
 
@@ -47,18 +41,70 @@ void PID::UpdateError(double cte) {
     double dt = ((double (t)) - last_t) / 49.0;
     last_t = t;
 
-    cte_history.push_back(cte);
+    UpdateError(cte, dt);
+}
+
+/*
+ * @brief       Do the PID computations for a known time step.
+ * @param[in]   cte             the error signal to be driven to zero
+ * @param[in]   dt              time since the last update, in nominal (49 [ms]) sampling periods
+ */
+void PID::UpdateError(double cte, double dt) {
+
+    cte_history[(history_start + history_size) % MAX_CTE_HISTORY_LENGTH] = cte;
+    history_size++;
     d_error = (cte - p_error) / dt;
     p_error = cte;
     i_error += cte * dt;
 
-    if(cte_history.size() >= MAX_CTE_HISTORY_LENGTH) {
-        i_error -= cte_history[0];
-        cte_history.pop_front();
+    if(history_size >= MAX_CTE_HISTORY_LENGTH) {
+        i_error -= cte_history[history_start];
+        history_start = (history_start + 1) % MAX_CTE_HISTORY_LENGTH;
+        history_size--;
     }
 
 }
 
+/*
+ * @brief       Clear the error terms and the integral history.
+ */
+void PID::Reset() {
+    p_error = 0;
+    i_error = 0;
+    d_error = 0;
+    history_start = 0;
+    history_size = 0;
+    last_t = epoch_time();
+}
+
+/*
+ * @brief       The error terms and integral history, not the coefficients.
+ */
+PIDState PID::save() const {
+    PIDState state;
+    memcpy(state.cte_history, cte_history, sizeof(cte_history));
+    state.history_start = history_start;
+    state.history_size = history_size;
+    state.last_t = last_t;
+    state.p_error = p_error;
+    state.i_error = i_error;
+    state.d_error = d_error;
+    return state;
+}
+
+/*
+ * @brief       Continue from a saved state, keeping the current coefficients.
+ */
+void PID::restore(const PIDState& state) {
+    memcpy(cte_history, state.cte_history, sizeof(cte_history));
+    history_start = state.history_start;
+    history_size = state.history_size;
+    last_t = state.last_t;
+    p_error = state.p_error;
+    i_error = state.i_error;
+    d_error = state.d_error;
+}
+
 /*
  * @brief       Get the summed error terms, weighted by their coefficients.
  * This can be used as the feedback value.
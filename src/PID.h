@@ -1,12 +1,37 @@
 #ifndef PID_H
 #define PID_H
 
-#include <deque>
 #include "say_time.h"
 
+/*
+ * How long should the history of error values be when computing the i term?
+ *
+ * 200 samples (About 49 [ms] each) is roughly enough time
+ * to judge manually whether we're turning,
+ * and so probably enough time to keep track of integrated history.
+ */
+#define MAX_CTE_HISTORY_LENGTH 200
+
+/*
+ * Everything a PID's output depends on besides its coefficients, as plain data
+ * that can be copied with memcpy, e.g. to resume a run with other coefficients.
+ */
+struct PIDState {
+  double cte_history[MAX_CTE_HISTORY_LENGTH];
+  unsigned int history_start;
+  unsigned int history_size;
+  long last_t;
+  double p_error;
+  double i_error;
+  double d_error;
+};
+
 class PID {
 private:
-  std::deque<double> cte_history;
+  // Ring buffer, so updates never allocate.
+  double cte_history[MAX_CTE_HISTORY_LENGTH];
+  unsigned int history_start;
+  unsigned int history_size;
   long last_t;
 
 public:
@@ -44,6 +69,23 @@ public:
   */
   void UpdateError(double cte);
 
+  /*
+  * Update the PID error variables with an explicitly given time step
+  * (in units of the nominal sampling period), e.g. from an offline simulator.
+  */
+  void UpdateError(double cte, double dt);
+
+  /*
+  * Forget the error history, e.g. before evaluating a new set of coefficients.
+  */
+  void Reset();
+
+  /*
+  * Copy out, or take back, the error state.
+  */
+  PIDState save() const;
+  void restore(const PIDState& state);
+
   /*
   * Calculate the total PID error.
   */
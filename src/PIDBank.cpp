@@ -0,0 +1,130 @@
+#include "PIDBank.h"
+
+using namespace std;
+
+/*
+ * @brief       Construct a bank of PID controllers.
+ * All coefficients and errors are set to 0.
+ * @param[in]   n               number of lanes
+ */
+PIDBank::PIDBank(unsigned int n) {
+    this->n = n;
+    Kp.assign(n, 0);
+    Ki.assign(n, 0);
+    Kd.assign(n, 0);
+    Reset();
+}
+
+unsigned int PIDBank::size() const {
+    return n;
+}
+
+/*
+ * @brief       Set one lane's PID coefficients.
+ */
+void PIDBank::Init(unsigned int lane, double Kp, double Ki, double Kd) {
+    this->Kp[lane] = Kp;
+    this->Ki[lane] = Ki;
+    this->Kd[lane] = Kd;
+}
+
+/*
+ * @brief       Same computations as PID::UpdateError, for every lane at once.
+ * @param[in]   cte             n error signals
+ * @param[in]   dt              time since the last update, in nominal sampling periods
+ */
+void PIDBank::UpdateError(const double* cte, double dt) {
+    double* slot = &cte_history[((head + count) % MAX_CTE_HISTORY_LENGTH) * n];
+    double* p = p_error.data();
+    double* i = i_error.data();
+    double* d = d_error.data();
+
+    for(unsigned int k=0; k<n; k++) {
+        slot[k] = cte[k];
+        d[k] = (cte[k] - p[k]) / dt;
+        p[k] = cte[k];
+        i[k] += cte[k] * dt;
+    }
+    ForgetOldest();
+}
+
+/*
+ * @brief       Update every lane with a shared error signal, e.g. for shadow controllers.
+ */
+void PIDBank::UpdateError(double cte, double dt) {
+    double* slot = &cte_history[((head + count) % MAX_CTE_HISTORY_LENGTH) * n];
+    double* p = p_error.data();
+    double* i = i_error.data();
+    double* d = d_error.data();
+
+    for(unsigned int k=0; k<n; k++) {
+        slot[k] = cte;
+        d[k] = (cte - p[k]) / dt;
+        p[k] = cte;
+        i[k] += cte * dt;
+    }
+    ForgetOldest();
+}
+
+/*
+ * @brief       Account for the slot just written, and drop the oldest once the history is full.
+ */
+void PIDBank::ForgetOldest() {
+    count++;
+    if(count >= MAX_CTE_HISTORY_LENGTH) {
+        const double* oldest = &cte_history[head * n];
+        double* i = i_error.data();
+        for(unsigned int k=0; k<n; k++) {
+            i[k] -= oldest[k];
+        }
+        head = (head + 1) % MAX_CTE_HISTORY_LENGTH;
+        count--;
+    }
+}
+
+/*
+ * @brief       The summed, weighted error terms of each lane, as in PID::TotalError.
+ * @param[out]  out             n feedback values
+ */
+void PIDBank::TotalError(double* out) const {
+    for(unsigned int k=0; k<n; k++) {
+        out[k] = - Kp[k] * p_error[k] - Ki[k] * i_error[k] - Kd[k] * d_error[k];
+    }
+}
+
+/*
+ * @brief       Drop all but the given lanes, keeping their coefficients, errors and history.
+ */
+void PIDBank::Select(const vector<unsigned int>& lanes) {
+    unsigned int m = lanes.size();
+    vector<double> history(MAX_CTE_HISTORY_LENGTH * m, 0);
+    for(unsigned int slot=0; slot<MAX_CTE_HISTORY_LENGTH; slot++) {
+        for(unsigned int k=0; k<m; k++) {
+            history[slot * m + k] = cte_history[slot * n + lanes[k]];
+        }
+    }
+
+    vector<double>* fields[] = {&p_error, &i_error, &d_error, &Kp, &Ki, &Kd};
+    for(auto field : fields) {
+        vector<double> kept(m);
+        for(unsigned int k=0; k<m; k++) {
+            kept[k] = (*field)[lanes[k]];
+        }
+        *field = kept;
+    }
+
+    cte_history = history;
+    n = m;
+}
+
+/*
+ * @brief       Clear all lanes' errors and history; coefficients are kept.
+ */
+void PIDBank::Reset() {
+    p_error.assign(n, 0);
+    i_error.assign(n, 0);
+    d_error.assign(n, 0);
+    cte_history.assign(MAX_CTE_HISTORY_LENGTH * n, 0);
+    head = 0;
+    count = 0;
+}
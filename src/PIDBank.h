@@ -0,0 +1,81 @@
+#ifndef PIDBANK_H
+#define PIDBANK_H
+
+#include <vector>
+#include "PID.h"
+
+/*
+ * A batch of PID controllers updated in lockstep.
+ *
+ * Each lane behaves exactly like a PID, but state is kept as one array per
+ * quantity (structure of arrays), so an update over all lanes is a handful of
+ * tight, vectorizable loops instead of one object and history buffer per controller.
+ */
+class PIDBank {
+private:
+  unsigned int n;
+
+  // Ring buffer of the last MAX_CTE_HISTORY_LENGTH errors, one row of n lanes per slot.
+  std::vector<double> cte_history;
+  unsigned int head;
+  unsigned int count;
+
+  void ForgetOldest();
+
+public:
+  /*
+  * Errors
+  */
+  std::vector<double> p_error;
+  std::vector<double> i_error;
+  std::vector<double> d_error;
+
+  /*
+  * Coefficients
+  */
+  std::vector<double> Kp;
+  std::vector<double> Ki;
+  std::vector<double> Kd;
+
+  /*
+  * Constructor
+  */
+  PIDBank(unsigned int n=0);
+
+  /*
+  * Number of lanes.
+  */
+  unsigned int size() const;
+
+  /*
+  * Set one lane's coefficients.
+  */
+  void Init(unsigned int lane, double Kp, double Ki, double Kd);
+
+  /*
+  * Update all lanes, each with its own error.
+  */
+  void UpdateError(const double* cte, double dt);
+
+  /*
+  * Update all lanes with the same error.
+  */
+  void UpdateError(double cte, double dt);
+
+  /*
+  * Write each lane's total error to out[0..n).
+  */
+  void TotalError(double* out) const;
+
+  /*
+  * Keep only the given lanes (in the given order), with their state.
+  */
+  void Select(const std::vector<unsigned int>& lanes);
+
+  /*
+  * Clear all errors and history.
+  */
+  void Reset();
+};
+
+#endif /* PIDBANK_H */
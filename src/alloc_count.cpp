@@ -0,0 +1,64 @@
+#include "alloc_count.h"
+#include <new>
+#include <cstdlib>    // malloc, free
+
+thread_local AllocCounters alloc_counters = {0, 0};
+
+
+#ifdef PID_ALLOC_COUNT
+
+/*
+ * @brief       Whether operator new is counting allocations in this build.
+ */
+bool alloc_counting_enabled() {
+    return true;
+}
+
+
+/*
+ * @brief       Count and perform an allocation.
+ */
+static inline void* counted_malloc(size_t size) {
+    alloc_counters.allocations++;
+    alloc_counters.bytes += size;
+    return malloc(size ? size : 1);
+}
+
+
+void* operator new(size_t size) {
+    void* p = counted_malloc(size);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size) {
+    void* p = counted_malloc(size);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+#else
+
+bool alloc_counting_enabled() {
+    return false;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+#include <cstdint>
+
+/*
+ * Heap allocation accounting.
+ *
+ * When built with PID_ALLOC_COUNT (cmake -DALLOC_COUNT=ON), alloc_count.cpp replaces the
+ * global operator new and delete with versions that also count, per thread, the
+ * allocations made and bytes requested. StageClock samples these counters at every
+ * lap, so allocations are attributed to handler stages just like time is.
+ * Without the option, the counters stay at zero and the hook costs nothing.
+ */
+
+struct AllocCounters {
+  uint64_t allocations;
+  uint64_t bytes;
+};
+
+extern thread_local AllocCounters alloc_counters;
+
+bool alloc_counting_enabled();
+
+#endif /* ALLOC_COUNT_H */
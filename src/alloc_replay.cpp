@@ -0,0 +1,225 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>    // strcmp
+#include <cstdlib>    // atoi, atof
+#include <algorithm>  // std::min, std::max
+#include <cmath>
+#include "json.hpp"
+
+#include "PID.h"
+#include "twiddle.h"
+#include "offtrack.h"
+#include "handler.h"
+#include "sprt.h"
+#include "sysid.h"
+#include "metrics.h"
+#include "alloc_count.h"
+#include "say_time.h"
+
+// Set parameters.
+#define TARGETSPEED 40.0
+#define NSAMPLES 6400
+#define NDISCARD 32
+#define TWIDDLETOL 0.001
+#define WARMUP 100
+#define FRAMEMS 49
+
+using json = nlohmann::json;
+
+static const char* STAGES[] = {"parse", "control", "log", "serialize", "tune"};
+static const unsigned int NUM_REPLAY_STAGES = 5;
+
+
+/*
+ * @brief       The websocket message the simulator would have sent for one logged frame.
+ */
+std::string telemetry_message(const TelemetryLog& log, size_t i) {
+    std::ostringstream out;
+    out << "42[\"telemetry\",{\"cte\":\"" << log.cte[i] << "\",\"speed\":\"" << log.speed[i];
+    out << "\",\"steering_angle\":\"" << log.angle[i] << "\",\"throttle\":\"" << log.throttle[i];
+    out << "\",\"image\":\"\"}]";
+    return out.str();
+}
+
+
+/*
+ * @brief       A log of n frames weaving about the centerline at about the target speed, for
+ *              replaying without a recorded run.
+ */
+TelemetryLog synthetic_log(size_t n) {
+    TelemetryLog log;
+    for(size_t i=0; i<n; i++) {
+        log.t.push_back(i * FRAMEMS);
+        log.cte.push_back(0.6 * sin(i / 20.0) + 0.2 * sin(i / 3.0));
+        log.speed.push_back(TARGETSPEED + 2 * sin(i / 50.0));
+        log.angle.push_back(5 * sin(i / 20.0 + 1));
+        log.steer.push_back(-0.1 * sin(i / 20.0));
+        log.throttle.push_back(0.3);
+        log.i_error.push_back(0);
+    }
+    return log;
+}
+
+
+/*
+ * Replay a cte.csv telemetry log through the handler steps twiddle_main calls
+ * (see handler.h; minus the socket), counting heap allocations per frame and stage.
+ *
+ * ./alloc_replay cte.csv [--max-allocs-per-frame X] [--steady-state] [--warmup N] [twiddle options]
+ * ./alloc_replay --synthetic N [...]
+ *
+ * Twiddle's --sprt, --offtrack, --offtrack-reset, --window-* and --lap-length options configure the tune stage
+ * as they do the server. Exits with status 1 if the mean allocations per frame after the first
+ * --warmup frames exceed --max-allocs-per-frame, or with --steady-state, if the control, log
+ * or tune stage (everything but JSON) allocates in any frame that did not end an evaluation
+ * window, so hot-path regressions can be caught by a script or by ctest, which replays a synthetic log.
+ */
+int main(int argc, char* argv[]) {
+
+    if(!alloc_counting_enabled()) {
+        std::cerr << "This build does not count allocations (PID_ALLOC_COUNT is not defined)." << std::endl;
+        return 2;
+    }
+
+    double max_allocs = -1;
+    bool steady_state = false;
+    unsigned int warmup = WARMUP;
+    size_t synthetic_frames = 0;
+    const char* log_fname = nullptr;
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--max-allocs-per-frame") == 0 && has_value) {
+            max_allocs = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--steady-state") == 0) {
+            steady_state = true;
+        } else if(strcmp(argv[i], "--warmup") == 0 && has_value) {
+            warmup = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--synthetic") == 0 && has_value) {
+            synthetic_frames = atol(argv[++i]);
+        } else if(i == 1 && argv[i][0] != '-') {
+            log_fname = argv[i];
+        }
+    }
+
+    TelemetryLog log;
+    if(synthetic_frames > 0) {
+        log = synthetic_log(synthetic_frames);
+    } else if(!log_fname) {
+        std::cerr << "Usage: " << argv[0] << " cte.csv|--synthetic N [--max-allocs-per-frame X]"
+                  << " [--steady-state] [--warmup N]" << std::endl;
+        return 2;
+    } else if(!read_telemetry_csv(log_fname, log)) {
+        return 2;
+    }
+    std::vector<std::string> messages;
+    for(size_t i=0; i<log.cte.size(); i++) {
+        messages.push_back(telemetry_message(log, i));
+    }
+    if(messages.size() <= warmup) {
+        std::cerr << "The log has only " << messages.size() << " frames." << std::endl;
+        return 2;
+    }
+
+    // Set up the tune stage as twiddle_main does.
+    PID pid_steering;
+    PID pid_throttle;
+    pid_steering.Init(0.110293, 0.000680556, 0.797399);
+    pid_throttle.Init(0.3, 0, 0.02);
+    std::vector<PID*> pids = {&pid_steering};
+    TwiddlerManager twiddler_manager(pids, NSAMPLES, TWIDDLETOL, NDISCARD);
+    double lap_length;
+    parse_tail_options(argc, argv, twiddler_manager.lambda_tail, lap_length);
+    unsigned int sprt_segment;
+    PairedSPRT* sprt = parse_sprt(argc, argv, sprt_segment);
+    if(sprt)
+        twiddler_manager.set_sprt(sprt, sprt_segment);
+    double window_distance;
+    bool window_reset;
+    parse_window_options(argc, argv, lap_length, window_distance, window_reset);
+    if(window_distance > 0 && !sprt)
+        twiddler_manager.set_window_distance(window_distance, window_reset);
+    OffTrackDetector* offtrack = parse_offtrack_detector(argc, argv);
+    bool offtrack_reset = window_reset;
+    for(int i=1; i<argc; i++) {
+        if(strcmp(argv[i], "--offtrack-reset") == 0)
+            offtrack_reset = true;
+    }
+    TuneStage tune_stage(twiddler_manager, pid_steering, pid_throttle, offtrack, offtrack_reset, lap_length, 0);
+    std::ofstream cte_log_file("/dev/null");
+
+    std::vector<uint64_t> stage_allocs(NUM_REPLAY_STAGES, 0);
+    uint64_t total_allocs = 0, total_bytes = 0, max_frame_allocs = 0;
+    size_t unsteady_frames = 0;
+
+    for(size_t f=0; f<messages.size(); f++) {
+        const char* data = messages[f].data();
+        size_t length = messages[f].length();
+
+        AllocCounters before = alloc_counters;
+        AllocCounters last = before;
+        uint64_t allocs[NUM_REPLAY_STAGES];
+        auto stage_done = [&](unsigned int stage) {
+            allocs[stage] = alloc_counters.allocations - last.allocations;
+            last = alloc_counters;
+        };
+
+        StageClock clock;
+        auto s = hasData(std::string(data, length));
+        auto j = json::parse(s);
+        Telemetry telemetry = parse_telemetry(j[1]);
+        clock.lap(STAGE_PARSE);
+        stage_done(0);
+
+        Controls controls = control_step(pid_steering, pid_throttle, telemetry, TARGETSPEED);
+        clock.lap(STAGE_CONTROL);
+        stage_done(1);
+
+        log_frame(cte_log_file, telemetry, controls, pid_steering.i_error);
+        clock.lap(STAGE_LOG);
+        stage_done(2);
+
+        std::string msg = steer_message(controls);
+        clock.lap(STAGE_SERIALIZE);
+        stage_done(3);
+
+        unsigned long windows = twiddler_manager.get_num_windows();
+        tune_stage.process(telemetry, (long) f * FRAMEMS);
+        bool window_ended = twiddler_manager.get_num_windows() != windows;
+        clock.lap(STAGE_TUNE);
+        stage_done(4);
+
+        if(f >= warmup) {
+            uint64_t frame_allocs = alloc_counters.allocations - before.allocations;
+            total_allocs += frame_allocs;
+            total_bytes += alloc_counters.bytes - before.bytes;
+            max_frame_allocs = std::max(max_frame_allocs, frame_allocs);
+            for(unsigned int i=0; i<NUM_REPLAY_STAGES; i++) {
+                stage_allocs[i] += allocs[i];
+            }
+            // New gains and log lines may allocate when a window ends; nothing else should.
+            if(allocs[1] + allocs[2] + (window_ended ? 0 : allocs[4]) > 0)
+                unsteady_frames++;
+        }
+    }
+
+    size_t nframes = messages.size() - warmup;
+    double mean_allocs = (double) total_allocs / nframes;
+    say_time(); std::cout << "Replayed " << messages.size() << " frames; after " << warmup << " warm-up frames:" << std::endl;
+    for(unsigned int i=0; i<NUM_REPLAY_STAGES; i++) {
+        say_time(); std::cout << "    " << STAGES[i] << ": " << (double) stage_allocs[i] / nframes << " allocations/frame" << std::endl;
+    }
+    say_time(); std::cout << "    total: " << mean_allocs << " allocations/frame (max " << max_frame_allocs << "), ";
+    std::cout << (double) total_bytes / nframes << " bytes/frame" << std::endl;
+
+    if(max_allocs >= 0 && mean_allocs > max_allocs) {
+        say_time(); std::cout << "FAIL: more than the ceiling of " << max_allocs << " allocations/frame." << std::endl;
+        return 1;
+    }
+    if(steady_state && unsteady_frames > 0) {
+        say_time(); std::cout << "FAIL: " << unsteady_frames << " frames allocated outside JSON parsing and serialization"
+                              << " without ending a window." << std::endl;
+        return 1;
+    }
+    return 0;
+}
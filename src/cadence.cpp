@@ -0,0 +1,215 @@
+#include "cadence.h"
+#include "say_time.h"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <algorithm>  // find
+#include <cmath>
+#include <cstring>    // strcmp
+#include <cstdlib>    // atoi, atof
+
+using namespace std;
+
+// Log at most one alert of each kind per connection (or probe) per second; count the rest.
+static const uint64_t ALERT_LOG_INTERVAL_NS = 1000000000ull;
+
+static const double SUMMARY_QUANTILES[] = {0.5, 0.9, 0.99};
+
+static vector<CadenceMonitor*> live_monitors;
+
+
+
+/*****************************************************************
+ ***************** Event loop lag. *******************************
+ *****************************************************************/
+
+
+/*
+ * @brief       Start probing the loop's lag.
+ * @param[in]   loop            The event loop, e.g. h.getLoop()
+ * @param[in]   interval_ms     Timer period [ms]
+ * @param[in]   alert_ms        Warn when the timer runs this late [ms]
+ * libuv timers have millisecond resolution, so lags under a millisecond are noise.
+ */
+LoopLagProbe::LoopLagProbe(uv_loop_t* loop, unsigned int interval_ms, double alert_ms) {
+    this->interval_ns = interval_ms * 1000000ull;
+    this->alert_ms = alert_ms;
+    last_alert_ns = 0;
+    suppressed_alerts = 0;
+
+    timer.data = this;
+    uv_timer_init(loop, &timer);
+    due_ns = metrics_now_ns() + interval_ns;
+    uv_timer_start(&timer, on_timer, interval_ms, interval_ms);
+}
+
+
+void LoopLagProbe::on_timer(uv_timer_t* handle) {
+    ((LoopLagProbe*) handle->data)->fire();
+}
+
+
+/*
+ * @brief       Record how late this tick is, and when the next one is due.
+ */
+void LoopLagProbe::fire() {
+    uint64_t now = metrics_now_ns();
+    uint64_t lag = now > due_ns ? now - due_ns : 0;
+    due_ns = now + interval_ns;
+    metrics_record(HISTOGRAM_LOOP_LAG, lag);
+
+    if(lag > alert_ms * 1e6) {
+        metrics_count(COUNTER_LOOP_LAG_ALERTS);
+        if(now - last_alert_ns >= ALERT_LOG_INTERVAL_NS) {
+            say_time(); cout << "Event loop lag of " << lag * 1e-6 << " ms (alert threshold " << alert_ms << " ms)";
+            if(suppressed_alerts)
+                cout << "; " << suppressed_alerts << " more since the last warning";
+            cout << "." << endl;
+            last_alert_ns = now;
+            suppressed_alerts = 0;
+        } else {
+            suppressed_alerts++;
+        }
+    }
+}
+
+
+
+/*****************************************************************
+ ***************** Telemetry cadence. ****************************
+ *****************************************************************/
+
+
+/*
+ * @brief       Start monitoring a connection.
+ * @param[in]   id          Connection number, for logs and metric labels
+ * @param[in]   alert_ms    Warn when an interval is this far from the nominal period [ms]
+ */
+CadenceMonitor::CadenceMonitor(unsigned int id, double alert_ms) {
+    this->id = id;
+    this->alert_ms = alert_ms;
+    last_ns = 0;
+    last_alert_ns = 0;
+    suppressed_alerts = 0;
+    sum_dt_deviation = 0;
+    alerts = 0;
+    live_monitors.push_back(this);
+}
+
+
+CadenceMonitor::~CadenceMonitor() {
+    live_monitors.erase(find(live_monitors.begin(), live_monitors.end(), this));
+}
+
+
+/*
+ * @brief       Record the arrival of a telemetry frame.
+ */
+void CadenceMonitor::frame() {
+    uint64_t now = metrics_now_ns();
+    if(last_ns == 0) {
+        last_ns = now;
+        return;
+    }
+    uint64_t interval = now - last_ns;
+    last_ns = now;
+    intervals.record(interval);
+    metrics_record(HISTOGRAM_FRAME_INTERVAL, interval);
+
+    double interval_ms = interval * 1e-6;
+    sum_dt_deviation += fabs(interval_ms / NOMINAL_PERIOD_MS - 1);
+
+    if(fabs(interval_ms - NOMINAL_PERIOD_MS) > alert_ms) {
+        alerts++;
+        metrics_count(COUNTER_CADENCE_ALERTS);
+        if(now - last_alert_ns >= ALERT_LOG_INTERVAL_NS) {
+            say_time(); cout << "Connection " << id << ": frame interval " << interval_ms << " ms, nominal ";
+            cout << NOMINAL_PERIOD_MS << " +/- " << alert_ms << " ms";
+            if(suppressed_alerts)
+                cout << "; " << suppressed_alerts << " more since the last warning";
+            cout << "." << endl;
+            last_alert_ns = now;
+            suppressed_alerts = 0;
+        } else {
+            suppressed_alerts++;
+        }
+    }
+}
+
+
+/*
+ * @brief       Print the interval distribution, e.g. when the connection closes.
+ */
+void CadenceMonitor::summarize() {
+    uint64_t n = intervals.count.load(memory_order_relaxed);
+    if(n == 0)
+        return;
+    say_time(); cout << "Connection " << id << " cadence over " << n << " intervals: mean ";
+    cout << intervals.sum.load(memory_order_relaxed) * 1e-6 / n << " ms";
+    for(auto q : SUMMARY_QUANTILES) {
+        cout << ", p" << q * 100 << " " << intervals.quantile(q) * 1e-6 << " ms";
+    }
+    cout << ", max " << intervals.quantile(1) * 1e-6 << " ms; mean |dt - 1| = " << sum_dt_deviation / n;
+    cout << "; " << alerts << " jitter alerts." << endl;
+}
+
+
+/*
+ * @brief       Write this connection's summary as labelled Prometheus samples, one stream per metric family.
+ */
+void CadenceMonitor::expose(ostream& intervals_out, ostream& deviation_out, ostream& alerts_out) {
+    uint64_t n = intervals.count.load(memory_order_relaxed);
+    string label = "connection=\"" + to_string(id) + "\"";
+    for(auto q : SUMMARY_QUANTILES) {
+        intervals_out << "pid_connection_frame_interval_seconds{" << label << ",quantile=\"" << q << "\"} ";
+        intervals_out << intervals.quantile(q) * 1e-9 << "\n";
+    }
+    intervals_out << "pid_connection_frame_interval_seconds_sum{" << label << "} ";
+    intervals_out << intervals.sum.load(memory_order_relaxed) * 1e-9 << "\n";
+    intervals_out << "pid_connection_frame_interval_seconds_count{" << label << "} " << n << "\n";
+    deviation_out << "pid_connection_dt_deviation{" << label << "} " << (n ? sum_dt_deviation / n : 0) << "\n";
+    alerts_out << "pid_connection_cadence_alerts{" << label << "} " << alerts << "\n";
+}
+
+
+/*
+ * @brief       Per-connection cadence summaries of all live connections.
+ */
+string cadence_exposition() {
+    ostringstream intervals_out, deviation_out, alerts_out;
+    for(auto monitor : live_monitors) {
+        monitor->expose(intervals_out, deviation_out, alerts_out);
+    }
+    ostringstream out;
+    out << "# HELP pid_connection_frame_interval_seconds Time between telemetry frames, per live connection.\n";
+    out << "# TYPE pid_connection_frame_interval_seconds summary\n";
+    out << intervals_out.str();
+    out << "# HELP pid_connection_dt_deviation Mean |dt - 1| of the nominal-period-normalized frame interval.\n";
+    out << "# TYPE pid_connection_dt_deviation gauge\n";
+    out << deviation_out.str();
+    out << "# HELP pid_connection_cadence_alerts Frame intervals off nominal by more than the alert threshold.\n";
+    out << "# TYPE pid_connection_cadence_alerts gauge\n";
+    out << alerts_out.str();
+    return out.str();
+}
+
+
+/*
+ * @brief       Read the loop lag probe and cadence monitor settings from the command line.
+ */
+void parse_cadence_options(int argc, char* argv[], unsigned int& lag_interval_ms, double& lag_alert_ms,
+                           double& jitter_alert_ms) {
+    lag_interval_ms = 10;
+    lag_alert_ms = 10;
+    jitter_alert_ms = 25;
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--lag-interval") == 0 && has_value) {
+            lag_interval_ms = max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--lag-alert") == 0 && has_value) {
+            lag_alert_ms = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--jitter-alert") == 0 && has_value) {
+            jitter_alert_ms = atof(argv[++i]);
+        }
+    }
+}
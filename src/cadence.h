@@ -0,0 +1,79 @@
+#ifndef CADENCE_H
+#define CADENCE_H
+
+#include <string>
+#include <ostream>
+#include <cstdint>
+#include <uv.h>
+#include "metrics.h"
+
+/*
+ * Nominal telemetry period PID::UpdateError normalizes dt by [ms].
+ */
+#define NOMINAL_PERIOD_MS 49.0
+
+
+/*
+ * Measures how late the event loop runs: a repeating uv timer compares
+ * when it fired with when it was due. Lag means our own process (a slow
+ * handler, logging, a scrape) is delaying frames, not the simulator.
+ */
+class LoopLagProbe {
+
+private:
+  uv_timer_t timer;
+  uint64_t interval_ns;
+  uint64_t due_ns;
+  double alert_ms;
+  uint64_t last_alert_ns;
+  unsigned long suppressed_alerts;
+
+  static void on_timer(uv_timer_t* handle);
+  void fire();
+
+public:
+  LoopLagProbe(uv_loop_t* loop, unsigned int interval_ms=10, double alert_ms=10);
+};
+
+
+/*
+ * Tracks the intervals between one connection's telemetry frames, against the
+ * nominal period. Intervals further than the alert threshold from nominal
+ * are jitter alerts; the distribution of dt (interval / nominal) shows how much
+ * the dt normalization in PID::UpdateError actually changes.
+ */
+class CadenceMonitor {
+
+private:
+  unsigned int id;
+  double alert_ms;
+  uint64_t last_ns;
+  uint64_t last_alert_ns;
+  unsigned long suppressed_alerts;
+
+  LogHistogram intervals;
+  double sum_dt_deviation;
+  unsigned long alerts;
+
+public:
+  CadenceMonitor(unsigned int id, double alert_ms=25);
+  ~CadenceMonitor();
+  void frame();
+  void summarize();
+  void expose(std::ostream& intervals_out, std::ostream& deviation_out, std::ostream& alerts_out);
+};
+
+
+/*
+ * Per-connection cadence summaries of all live connections, in the Prometheus format.
+ */
+std::string cadence_exposition();
+
+
+/*
+ * Parse --lag-interval MS, --lag-alert MS and --jitter-alert MS.
+ */
+void parse_cadence_options(int argc, char* argv[], unsigned int& lag_interval_ms, double& lag_alert_ms,
+                           double& jitter_alert_ms);
+
+#endif /* CADENCE_H */
@@ -0,0 +1,350 @@
+#include "follow.h"
+#include <iostream>
+#include <limits>
+#include <cmath>     // isnan
+#include <cstring>    // memchr, strcmp
+#include <cstdlib>    // atoi
+#include <algorithm>  // min, max
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "json.hpp"
+#include "say_time.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+// Bytes read per pread call.
+static const size_t READ_CHUNK = 1 << 16;
+
+// An unfinished line longer than this is dropped rather than buffered.
+static const size_t MAX_LINE = 1 << 20;
+
+
+/*****************************************************************
+ ***************** Follow a growing file. ************************
+ *****************************************************************/
+
+
+/*
+ * @brief       Start following a file (which need not exist yet).
+ * @param[in]   loop        The event loop to watch and poll on.
+ * @param[in]   fname       The file to follow.
+ * @param[in]   on_line     Called with each complete line, without its newline.
+ * @param[in]   on_reset    Called when the file was truncated or replaced, before it is read again.
+ * @param[in]   poll_ms     Interval of the fallback poll [ms].
+ */
+LogFollower::LogFollower(uv_loop_t* loop, const string& fname, LineHandler on_line,
+                         function<void()> on_reset, unsigned int poll_ms) {
+    this->fname = fname;
+    this->on_line = on_line;
+    this->on_reset = on_reset;
+    fd = -1;
+    device = 0;
+    inode = 0;
+    offset = 0;
+    lines = 0;
+    skipping = false;
+    watching = false;
+
+    uv_fs_event_init(loop, &event);
+    event.data = this;
+    uv_timer_init(loop, &timer);
+    timer.data = this;
+    uv_timer_start(&timer, on_timer, poll_ms, poll_ms);
+
+    refresh();
+}
+
+
+void LogFollower::on_event(uv_fs_event_t* handle, const char* filename, int events, int status) {
+    ((LogFollower*) handle->data)->refresh();
+}
+
+
+void LogFollower::on_timer(uv_timer_t* handle) {
+    ((LogFollower*) handle->data)->refresh();
+}
+
+
+/*
+ * @brief       (Re)start the fs event watch on the currently open file.
+ */
+void LogFollower::watch() {
+    if(watching)
+        uv_fs_event_stop(&event);
+    watching = uv_fs_event_start(&event, on_event, fname.c_str(), 0) == 0;
+    say_time(); cout << "Following " << fname << (watching ? " (fs events)" : " (polling only)") << "." << endl;
+}
+
+
+/*
+ * @brief       Open the file afresh and read it from the start.
+ * @return      Whether it could be opened.
+ */
+bool LogFollower::reopen() {
+    bool had_file = fd >= 0;
+    if(had_file)
+        close(fd);
+    fd = open(fname.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    fstat(fd, &st);
+    device = st.st_dev;
+    inode = st.st_ino;
+    offset = 0;
+    lines = 0;
+    partial.clear();
+    skipping = false;
+    if(had_file && on_reset)
+        on_reset();
+    watch();
+    return true;
+}
+
+
+/*
+ * @brief       Read whatever was appended since the last refresh.
+ */
+void LogFollower::refresh() {
+    struct stat st;
+    if(stat(fname.c_str(), &st) != 0)
+        return;
+    bool replaced = st.st_dev != device || st.st_ino != inode;
+    bool truncated = (uint64_t) st.st_size < offset;
+    if(fd < 0 || replaced || truncated) {
+        if(!reopen())
+            return;
+    }
+
+    char buffer[READ_CHUNK];
+    ssize_t n;
+    while((n = pread(fd, buffer, sizeof(buffer), offset)) > 0) {
+        offset += n;
+        const char* p = buffer;
+        const char* end = buffer + n;
+        while(p < end) {
+            const char* nl = (const char*) memchr(p, '\n', end - p);
+            if(!nl) {
+                if(skipping)
+                    break;
+                if(partial.size() + (end - p) <= MAX_LINE) {
+                    partial.append(p, end);
+                } else {
+                    // Too long: drop the whole line, up to its newline, rather than pass on a fragment.
+                    partial.clear();
+                    skipping = true;
+                }
+                break;
+            }
+            bool skipped = skipping;
+            if(skipping) {
+                skipping = false;
+            } else if(partial.empty()) {
+                on_line(p, nl);
+            } else {
+                partial.append(p, nl);
+                on_line(partial.data(), partial.data() + partial.size());
+                partial.clear();
+            }
+            if(!skipped)
+                lines++;
+            p = nl + 1;
+        }
+    }
+}
+
+
+const string& LogFollower::get_fname() {
+    return fname;
+}
+
+
+/*
+ * @brief       Bytes of the file read so far.
+ */
+uint64_t LogFollower::get_offset() {
+    return offset;
+}
+
+
+/*
+ * @brief       Complete lines handed to on_line so far.
+ */
+unsigned long LogFollower::get_lines() {
+    return lines;
+}
+
+
+/*
+ * @brief       Whether fs events (rather than only the poll) are watching the file.
+ */
+bool LogFollower::is_watching() {
+    return watching;
+}
+
+
+
+/*****************************************************************
+ ***************** Summarize a twiddle log as it grows. **********
+ *****************************************************************/
+
+
+// The follower reads what is already in the file as it is constructed,
+// so everything line() uses is initialized before it, in the class definition.
+TuneFollower::TuneFollower(uv_loop_t* loop, const string& fname, unsigned int nparam, unsigned int poll_ms)
+        : nparam(nparam),
+          follower(loop, fname,
+                   [this](const char* begin, const char* end) { line(begin, end); },
+                   [this]() { reset(); },
+                   poll_ms) {
+}
+
+
+/*
+ * @brief       Forget everything parsed so far, for when the log starts over.
+ */
+void TuneFollower::reset() {
+    const double nan = numeric_limits<double>::quiet_NaN();
+    params.clear();
+    accepted.clear();
+    diff_params.clear();
+    params_t = 0;
+    accepted_t = 0;
+    success_t = 0;
+    objective = nan;
+    mae = nan;
+    stdd = nan;
+    num_iterations = 0;
+    num_windows = 0;
+    num_modifications = 0;
+    num_successes = 0;
+    best_objective = numeric_limits<double>::infinity();
+    last_t = 0;
+    num_events = 0;
+}
+
+
+/*
+ * @brief       Fold one new line of the log into the summary, as TuneLog::apply would but keeping only the latest rows.
+ */
+void TuneFollower::line(const char* begin, const char* end) {
+    TuneEvent event;
+    if(!parse_tune_line(begin, end, event))
+        return;
+    num_events++;
+    last_t = event.t;
+
+    switch(event.kind) {
+    case EVENT_SUCCESS:
+        // The parameters that just succeeded are the last ones tried.
+        if(!params.empty()) {
+            accepted = params;
+            accepted_t = params_t;
+        }
+        success_t = event.t;
+        num_successes++;
+        break;
+    case EVENT_DIFF_PARAMS:
+        if(event.n == nparam)
+            diff_params.assign(event.values, event.values + nparam);
+        break;
+    case EVENT_PARAMS:
+        num_modifications++;
+        if(event.n == nparam) {
+            params.assign(event.values, event.values + nparam);
+            params_t = event.t;
+        }
+        break;
+    case EVENT_MAE:
+        mae = event.values[0];
+        break;
+    case EVENT_STDD:
+        stdd = event.values[0];
+        break;
+    case EVENT_OBJECTIVE:
+        objective = event.values[0];
+        best_objective = min(best_objective, objective);
+        num_windows++;
+        break;
+    case EVENT_ITERATION:
+        num_iterations++;
+        break;
+    }
+}
+
+
+/*
+ * @brief       A row, or null before the first.
+ */
+static json row_or_null(const vector<double>& row) {
+    if(row.empty())
+        return nullptr;
+    return row;
+}
+
+
+/*
+ * @brief       A value, or null if NaN (before the first).
+ */
+static json value_or_null(double x) {
+    if(isnan(x))
+        return nullptr;
+    return x;
+}
+
+
+/*
+ * @brief       The current state of the run as JSON; constant time however long the log is.
+ */
+string TuneFollower::summary_json() {
+    follower.refresh();
+    json j;
+    j["file"] = follower.get_fname();
+    j["bytes"] = follower.get_offset();
+    j["lines"] = follower.get_lines();
+    j["fs_events"] = follower.is_watching();
+    j["events"] = num_events;
+    j["last_t"] = last_t;
+
+    j["iterations"] = num_iterations;
+    j["windows"] = num_windows;
+    j["modifications"] = num_modifications;
+    j["successes"] = num_successes;
+
+    j["params"] = row_or_null(params);
+    j["params_t"] = params.empty() ? json(nullptr) : json(params_t);
+    j["accepted"] = row_or_null(accepted);
+    j["accepted_t"] = accepted.empty() ? json(nullptr) : json(accepted_t);
+    j["dp"] = row_or_null(diff_params);
+    double dp_sum = 0;
+    for(auto dp : diff_params) {
+        dp_sum += dp;
+    }
+    j["dp_sum"] = dp_sum;
+
+    j["objective"] = value_or_null(objective);
+    j["best_objective"] = num_windows == 0 ? json(nullptr) : json(best_objective);
+    j["mae"] = value_or_null(mae);
+    j["stdd"] = value_or_null(stdd);
+    j["last_success_t"] = num_successes == 0 ? json(nullptr) : json(success_t);
+    return j.dump();
+}
+
+
+TuneFollower* parse_tune_follower(int argc, char* argv[], uv_loop_t* loop) {
+    string fname;
+    unsigned int poll_ms = 1000;
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--follow") == 0 && has_value) {
+            fname = argv[++i];
+        } else if(strcmp(argv[i], "--follow-poll") == 0 && has_value) {
+            poll_ms = max(1, atoi(argv[++i]));
+        }
+    }
+    if(fname.empty())
+        return nullptr;
+    return new TuneFollower(loop, fname, 3, poll_ms);
+}
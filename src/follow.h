@@ -0,0 +1,103 @@
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <limits>
+#include <sys/types.h>
+#include <uv.h>
+#include "pidlog.h"
+
+typedef std::function<void(const char*, const char*)> LineHandler;
+
+
+/*
+ * Follows a growing text file, handing each new complete line to a callback.
+ *
+ * Only bytes past the remembered offset are read on each refresh, and an
+ * unfinished last line is kept until its newline arrives, so the cost of a
+ * refresh depends on what was appended, not on the size of the file.
+ * Refreshes are triggered by a uv fs event (inotify on Linux) as soon as the file
+ * changes, and by a timer every poll_ms in case events are unavailable (the file
+ * does not exist yet, or the filesystem does not support them). If the file is
+ * truncated or replaced, on_reset is called and it is read again from the start.
+ * Like the other uv handle owners, it must live as long as the loop.
+ */
+class LogFollower {
+
+private:
+  std::string fname;
+  LineHandler on_line;
+  std::function<void()> on_reset;
+
+  int fd;
+  dev_t device;
+  ino_t inode;
+  uint64_t offset;
+  std::string partial;
+  bool skipping;          // dropping the rest of a line longer than the limit
+  unsigned long lines;
+
+  uv_fs_event_t event;
+  uv_timer_t timer;
+  bool watching;
+
+  static void on_event(uv_fs_event_t* handle, const char* filename, int events, int status);
+  static void on_timer(uv_timer_t* handle);
+  void watch();
+  bool reopen();
+
+public:
+  LogFollower(uv_loop_t* loop, const std::string& fname, LineHandler on_line,
+              std::function<void()> on_reset=nullptr, unsigned int poll_ms=1000);
+  void refresh();
+
+  const std::string& get_fname();
+  uint64_t get_offset();
+  unsigned long get_lines();
+  bool is_watching();
+};
+
+
+/*
+ * An always-current summary of a twiddle log, kept by following the file.
+ * Only the latest value of each series is kept, plus counts, so memory
+ * stays flat however long the log grows.
+ */
+class TuneFollower {
+
+private:
+  unsigned int nparam;
+
+  // Latest rows, empty before the first; scalars NaN before the first. Initialized here,
+  // as reset() would, because the follower below reads the existing log as it is constructed.
+  std::vector<double> params, accepted, diff_params;
+  long params_t = 0, accepted_t = 0, success_t = 0;
+  double objective = std::numeric_limits<double>::quiet_NaN();
+  double mae = std::numeric_limits<double>::quiet_NaN();
+  double stdd = std::numeric_limits<double>::quiet_NaN();
+  unsigned long num_iterations = 0, num_windows = 0, num_modifications = 0, num_successes = 0;
+
+  double best_objective = std::numeric_limits<double>::infinity();
+  long last_t = 0;
+  unsigned long num_events = 0;
+  LogFollower follower;
+
+  void line(const char* begin, const char* end);
+  void reset();
+
+public:
+  TuneFollower(uv_loop_t* loop, const std::string& fname, unsigned int nparam=3, unsigned int poll_ms=1000);
+  std::string summary_json();
+};
+
+
+/*
+ * Follow the twiddle log given with --follow FILE (polling every --follow-poll MS as a fallback);
+ * nullptr if not given.
+ */
+TuneFollower* parse_tune_follower(int argc, char* argv[], uv_loop_t* loop);
+
+#endif /* FOLLOW_H */
@@ -0,0 +1,475 @@
+#include "halving.h"
+#include "twiddle.h"
+#include "vector_utils.h"
+#include "say_time.h"
+#include <iostream>
+#include <cmath>
+#include <cstring>    // strcmp
+#include <cstdlib>    // atoi, atof, exit
+#include <algorithm>  // sort, min, max
+
+using namespace std;
+
+
+/*****************************************************************
+ ***************** Successive halving over a fixed candidate set. *
+ *****************************************************************/
+
+
+/*
+ * @brief       Construct the schedule.
+ * @param[in]   candidates  Parameter vectors to screen.
+ * @param[in]   budgets     Increasing per-rung sample budgets; the last should be the full evaluation window.
+ * @param[in]   keep        Fraction of candidates promoted from one rung to the next.
+ * @param[in]   bracket     Identifier copied into every job, for Hyperband.
+ */
+SuccessiveHalving::SuccessiveHalving(const vector<vector<double> >& candidates,
+                                     const vector<unsigned int>& budgets, double keep, unsigned int bracket)
+        : candidates(candidates), budgets(budgets) {
+    this->keep = keep;
+    this->bracket = bracket;
+    objectives.assign(candidates.size(), numeric_limits<double>::infinity());
+    rung = 0;
+    outstanding = 0;
+    for(unsigned int i=0; i<candidates.size(); i++) {
+        alive.push_back(i);
+        pending.push_back(i);
+    }
+}
+
+
+/*
+ * @brief       Hand out the next evaluation of the current rung.
+ * @param[out]  job         Filled in if a job is available.
+ * @return      Whether a job was available. False either when done,
+ *              or while waiting for the rest of the rung to be reported.
+ */
+bool SuccessiveHalving::next_job(HalvingJob& job) {
+    if(pending.empty())
+        return false;
+    job.bracket = bracket;
+    job.candidate = pending.front();
+    job.rung = rung;
+    job.budget = budgets[rung];
+    job.params = candidates[job.candidate];
+    pending.pop_front();
+    outstanding++;
+    return true;
+}
+
+
+/*
+ * @brief       Record the objective of a finished job, and promote if the rung is complete.
+ */
+void SuccessiveHalving::report(const HalvingJob& job, double objective) {
+    if(job.rung != rung)
+        return;
+    // NaN (e.g. from a diverged run) ranks last.
+    objectives[job.candidate] = std::isnan(objective) ? numeric_limits<double>::infinity() : objective;
+    outstanding--;
+    say_time(); cout << "Rung " << rung << " (budget " << job.budget << "): candidate " << job.candidate;
+    cout << " scored " << objective << "; " << pending.size() + outstanding << " left in rung." << endl;
+    if(pending.empty() && outstanding == 0)
+        promote();
+}
+
+
+/*
+ * @brief       Put back a job whose evaluation was abandoned (e.g. on disconnection).
+ */
+void SuccessiveHalving::requeue(const HalvingJob& job) {
+    if(job.rung != rung)
+        return;
+    outstanding--;
+    pending.push_front(job.candidate);
+}
+
+
+/*
+ * @brief       Keep the best fraction of the finished rung and queue them on the next budget.
+ */
+void SuccessiveHalving::promote() {
+    sort(alive.begin(), alive.end(), [this](unsigned int a, unsigned int b) {
+        return objectives[a] < objectives[b];
+    });
+
+    if(rung + 1 >= budgets.size()) {
+        // Final rung: only the ranking is left.
+        alive.resize(min((size_t) 1, alive.size()));
+        rung++;
+        say_time(); cout << "Successive halving done; best objective " << best_objective() << " with" << endl;
+        say_time(); vec_print(best_params(), "p");
+        return;
+    }
+
+    unsigned int nkeep = max(1u, (unsigned int) floor(alive.size() * keep));
+    alive.resize(min((size_t) nkeep, alive.size()));
+    rung++;
+    for(auto i : alive) {
+        pending.push_back(i);
+    }
+    say_time(); cout << "Promoted " << alive.size() << " candidates to rung " << rung;
+    cout << " (budget " << budgets[rung] << "); best so far " << objectives[alive[0]] << " with" << endl;
+    say_time(); vec_print(candidates[alive[0]], "p");
+}
+
+
+/*
+ * @brief       Whether all rungs have been evaluated.
+ */
+bool SuccessiveHalving::is_done() {
+    return rung >= budgets.size();
+}
+
+
+/*
+ * @brief       The best candidate so far (of the most recently completed rung).
+ */
+vector<double> SuccessiveHalving::best_params() {
+    if(alive.empty())
+        return vector<double>();
+    return candidates[alive[0]];
+}
+
+
+/*
+ * @brief       The objective of the best candidate so far.
+ */
+double SuccessiveHalving::best_objective() {
+    if(alive.empty())
+        return numeric_limits<double>::infinity();
+    return objectives[alive[0]];
+}
+
+
+
+/*****************************************************************
+ ***************** Hyperband over several halving brackets. ******
+ *****************************************************************/
+
+
+/*
+ * @brief       Construct the Hyperband brackets.
+ * @param[in]   sampler     Produces the requested number of fresh candidates.
+ * @param[in]   min_budget  Shortest evaluation window.
+ * @param[in]   max_budget  Full evaluation window.
+ * @param[in]   eta         Budget growth (and inverse keep) ratio between rungs.
+ */
+Hyperband::Hyperband(function<vector<vector<double> >(unsigned int)> sampler,
+                     unsigned int min_budget, unsigned int max_budget, double eta) {
+    unsigned int smax = (unsigned int) floor(log((double) max_budget / min_budget) / log(eta) + 1e-9);
+
+    // Most exploratory bracket first, so the cheap screening happens early.
+    for(int s=smax; s>=0; s--) {
+        unsigned int n = (unsigned int) ceil((smax + 1.0) / (s + 1.0) * pow(eta, s));
+        vector<unsigned int> budgets;
+        for(int i=0; i<=s; i++) {
+            budgets.push_back((unsigned int) round(max_budget * pow(eta, i - s)));
+        }
+        say_time(); cout << "Hyperband bracket " << brackets.size() << ": " << n << " candidates, ";
+        vec_print(budgets, "budgets");
+        brackets.push_back(SuccessiveHalving(sampler(n), budgets, 1.0 / eta, brackets.size()));
+    }
+}
+
+
+/*
+ * @brief       Hand out a job from the first bracket that has one.
+ */
+bool Hyperband::next_job(HalvingJob& job) {
+    for(auto& b : brackets) {
+        if(b.next_job(job))
+            return true;
+    }
+    return false;
+}
+
+
+/*
+ * @brief       Route a result to the bracket it came from.
+ */
+void Hyperband::report(const HalvingJob& job, double objective) {
+    brackets[job.bracket].report(job, objective);
+}
+
+
+/*
+ * @brief       Route an abandoned job back to the bracket it came from.
+ */
+void Hyperband::requeue(const HalvingJob& job) {
+    brackets[job.bracket].requeue(job);
+}
+
+
+/*
+ * @brief       Whether every bracket has finished.
+ */
+bool Hyperband::is_done() {
+    for(auto& b : brackets) {
+        if(!b.is_done())
+            return false;
+    }
+    return true;
+}
+
+
+/*
+ * @brief       Best candidate across brackets. Brackets' final rungs all use the full budget,
+ *              so their objectives are comparable once done.
+ */
+vector<double> Hyperband::best_params() {
+    vector<double> best;
+    double best_obj = numeric_limits<double>::infinity();
+    for(auto& b : brackets) {
+        if(b.is_done() && b.best_objective() < best_obj) {
+            best_obj = b.best_objective();
+            best = b.best_params();
+        }
+    }
+    return best;
+}
+
+
+/*
+ * @brief       Objective of the best full-budget candidate across brackets.
+ */
+double Hyperband::best_objective() {
+    double best_obj = numeric_limits<double>::infinity();
+    for(auto& b : brackets) {
+        if(b.is_done())
+            best_obj = min(best_obj, b.best_objective());
+    }
+    return best_obj;
+}
+
+
+
+/*****************************************************************
+ ***************** Configuration and candidate generation. *******
+ *****************************************************************/
+
+
+/*
+ * @brief       Read the scheduler settings from the command line.
+ * Recognized flags: --halving, --hyperband, --candidates N, --min-budget N,
+ * --max-budget N, --eta X, --spread X, --seed N. Exits with status 1 if --candidates is below 1.
+ * @param[in]   max_budget  Default full evaluation window.
+ */
+HalvingOptions parse_halving_options(int argc, char* argv[], unsigned int max_budget) {
+    HalvingOptions options;
+    options.enabled = false;
+    options.hyperband = false;
+    options.num_candidates = 243;
+    options.max_budget = max_budget;
+    options.min_budget = max(1u, max_budget / 81);
+    options.eta = 3;
+    options.spread = 0.5;
+    options.seed = 0;
+
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--halving") == 0) {
+            options.enabled = true;
+        } else if(strcmp(argv[i], "--hyperband") == 0) {
+            options.enabled = true;
+            options.hyperband = true;
+        } else if(strcmp(argv[i], "--candidates") == 0 && has_value) {
+            int num_candidates = atoi(argv[++i]);
+            if(num_candidates < 1) {
+                cerr << "Usage: --candidates N needs N >= 1, not " << argv[i] << "." << endl;
+                exit(1);
+            }
+            options.num_candidates = num_candidates;
+        } else if(strcmp(argv[i], "--min-budget") == 0 && has_value) {
+            options.min_budget = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--max-budget") == 0 && has_value) {
+            options.max_budget = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--eta") == 0 && has_value) {
+            options.eta = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--spread") == 0 && has_value) {
+            options.spread = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--seed") == 0 && has_value) {
+            options.seed = atoi(argv[++i]);
+        }
+    }
+
+    // Hyperband takes log(max/min) / log(eta) rungs: budgets must be positive and ordered, and eta at least 2.
+    if((int) options.max_budget <= 0) {
+        cerr << "--max-budget must be positive; using " << max_budget << "." << endl;
+        options.max_budget = max(1u, max_budget);
+    }
+    if((int) options.min_budget <= 0 || options.min_budget > options.max_budget) {
+        unsigned int min_budget = max(1u, options.max_budget / 81);
+        cerr << "--min-budget must be between 1 and --max-budget; using " << min_budget << "." << endl;
+        options.min_budget = min_budget;
+    }
+    if(!(options.eta >= 2)) {
+        cerr << "--eta must be at least 2; using 3." << endl;
+        options.eta = 3;
+    }
+    return options;
+}
+
+
+/*
+ * @brief       Budgets growing by a factor eta from min_budget, ending exactly at max_budget.
+ */
+vector<unsigned int> geometric_budgets(unsigned int min_budget, unsigned int max_budget, double eta) {
+    vector<unsigned int> budgets;
+    double b = max_budget;
+    while(b >= min_budget && budgets.size() < 32) {
+        budgets.insert(budgets.begin(), (unsigned int) round(b));
+        b /= eta;
+    }
+    if(budgets.empty())
+        budgets.push_back(max_budget);
+    return budgets;
+}
+
+
+/*
+ * @brief       Draw candidates log-uniformly around a center point.
+ * The center itself is always the first candidate, so screening can only confirm or beat it.
+ * @param[in]   spread      Half-width of the perturbation in natural-log units.
+ * @param[in]   filter      If given, only candidates it accepts are kept (the center always is).
+ */
+vector<vector<double> > sample_candidates(const vector<double>& center, double spread,
+                                          unsigned int n, mt19937& rng, CandidateFilter filter) {
+    uniform_real_distribution<double> u(-spread, spread);
+    vector<vector<double> > candidates;
+    if(n == 0)
+        return candidates;
+    candidates.push_back(center);
+    unsigned long nrejected = 0;
+    while(candidates.size() < n && nrejected < 100ul * n) {
+        vector<double> p(center);
+        for(auto& x : p) {
+            x *= exp(u(rng));
+        }
+        if(filter && !filter(p)) {
+            nrejected++;
+            continue;
+        }
+        candidates.push_back(p);
+    }
+    if(filter) {
+        say_time(); cout << "Pre-screen rejected " << nrejected << " of " << nrejected + candidates.size() - 1;
+        cout << " sampled candidates." << endl;
+    }
+    return candidates;
+}
+
+
+
+/*****************************************************************
+ ***************** Driving a schedule from live telemetry. *******
+ *****************************************************************/
+
+
+/*
+ * @brief       Build either a single halving schedule or Hyperband, per the options.
+ * @param[in]   center      Parameters to sample candidates around.
+ * @param[in]   filter      Optional pre-screen for sampled candidates.
+ */
+HalvingScheduler::HalvingScheduler(const HalvingOptions& options, const vector<double>& center,
+                                   CandidateFilter filter) {
+    halving = nullptr;
+    hyperband = nullptr;
+    mt19937 rng(options.seed);
+    if(options.hyperband) {
+        double spread = options.spread;
+        hyperband = new Hyperband([center, spread, &rng, filter](unsigned int n) {
+            return sample_candidates(center, spread, n, rng, filter);
+        }, options.min_budget, options.max_budget, options.eta);
+    } else {
+        vector<unsigned int> budgets = geometric_budgets(options.min_budget, options.max_budget, options.eta);
+        say_time(); cout << "Successive halving over " << options.num_candidates << " candidates, ";
+        vec_print(budgets, "budgets");
+        halving = new SuccessiveHalving(sample_candidates(center, options.spread, options.num_candidates, rng, filter),
+                                        budgets, 1.0 / options.eta);
+    }
+}
+
+HalvingScheduler::~HalvingScheduler() {
+    delete halving;
+    delete hyperband;
+}
+
+bool HalvingScheduler::next_job(HalvingJob& job) {
+    return hyperband ? hyperband->next_job(job) : halving->next_job(job);
+}
+
+void HalvingScheduler::report(const HalvingJob& job, double objective) {
+    hyperband ? hyperband->report(job, objective) : halving->report(job, objective);
+}
+
+void HalvingScheduler::requeue(const HalvingJob& job) {
+    hyperband ? hyperband->requeue(job) : halving->requeue(job);
+}
+
+bool HalvingScheduler::is_done() {
+    return hyperband ? hyperband->is_done() : halving->is_done();
+}
+
+vector<double> HalvingScheduler::best_params() {
+    return hyperband ? hyperband->best_params() : halving->best_params();
+}
+
+double HalvingScheduler::best_objective() {
+    return hyperband ? hyperband->best_objective() : halving->best_objective();
+}
+
+
+/*
+ * @brief       Construct a worker for one simulator connection.
+ * @param[in]   ndiscard    Samples to skip after each gain change before scoring.
+ */
+HalvingWorker::HalvingWorker(HalvingScheduler* scheduler, unsigned int ndiscard) {
+    this->scheduler = scheduler;
+    this->ndiscard = ndiscard;
+    busy = false;
+    nseen = 0;
+    pid_throttle.Init(0.3, 0, 0.02);
+    vector<double> p = scheduler->best_params();
+    if(p.size() >= 3)
+        pid_steering.Init(p[0], p[1], p[2]);
+}
+
+/*
+ * @brief       Give an unfinished job back, so another connection can run it.
+ */
+HalvingWorker::~HalvingWorker() {
+    if(busy)
+        scheduler->requeue(job);
+}
+
+
+/*
+ * @brief       Record the cte of the frame just controlled, finishing and starting jobs as needed.
+ */
+void HalvingWorker::process_error(double cte) {
+    if(busy) {
+        nseen++;
+        if(nseen > ndiscard)
+            errors.push_back(cte);
+        if(errors.size() >= job.budget) {
+            busy = false;
+            scheduler->report(job, twiddle_objective(errors));
+            errors.clear();
+        }
+    }
+
+    if(!busy) {
+        if(scheduler->next_job(job)) {
+            busy = true;
+            nseen = 0;
+            pid_steering.Init(fabs(job.params[0]), fabs(job.params[1]), fabs(job.params[2]));
+            pid_steering.Reset();
+        } else if(scheduler->is_done()) {
+            // No best gains if every candidate failed (NaN or infinite objectives); keep the last ones.
+            vector<double> p = scheduler->best_params();
+            if(p.size() >= 3)
+                pid_steering.Init(fabs(p[0]), fabs(p[1]), fabs(p[2]));
+        }
+    }
+}
@@ -0,0 +1,147 @@
+#ifndef HALVING_H
+#define HALVING_H
+
+#include <vector>
+#include <deque>
+#include <random>
+#include <functional>
+#include "PID.h"
+#include "twiddle.h"
+
+
+/*
+ * One unit of work handed out by a scheduler:
+ * run `params` for `budget` scored samples and report the objective.
+ */
+struct HalvingJob {
+  unsigned int bracket;
+  unsigned int candidate;
+  unsigned int rung;
+  unsigned int budget;
+  std::vector<double> params;
+};
+
+
+/*
+ * Successive halving: evaluate every candidate on the shortest budget,
+ * keep the best fraction, evaluate those on the next budget, and so on
+ * until the survivors have been run on the full budget.
+ *
+ * Work is pulled with next_job() and pushed back with report(), so the same
+ * schedule can be driven synchronously (offline model) or by several live
+ * simulator connections finishing in any order.
+ */
+class SuccessiveHalving {
+
+private:
+  std::vector<std::vector<double> > candidates;
+  std::vector<double> objectives;
+  std::vector<unsigned int> budgets;
+  double keep;
+
+  unsigned int rung;
+  std::vector<unsigned int> alive;
+  std::deque<unsigned int> pending;
+  unsigned int outstanding;
+  unsigned int bracket;
+
+  void promote();
+
+public:
+  SuccessiveHalving(const std::vector<std::vector<double> >& candidates,
+                    const std::vector<unsigned int>& budgets, double keep, unsigned int bracket=0);
+  bool next_job(HalvingJob& job);
+  void report(const HalvingJob& job, double objective);
+  void requeue(const HalvingJob& job);
+  bool is_done();
+  std::vector<double> best_params();
+  double best_objective();
+};
+
+
+/*
+ * Hyperband: several successive-halving brackets trading off
+ * the number of candidates against the shortest budget.
+ */
+class Hyperband {
+
+private:
+  std::vector<SuccessiveHalving> brackets;
+
+public:
+  Hyperband(std::function<std::vector<std::vector<double> >(unsigned int)> sampler,
+            unsigned int min_budget, unsigned int max_budget, double eta);
+  bool next_job(HalvingJob& job);
+  void report(const HalvingJob& job, double objective);
+  void requeue(const HalvingJob& job);
+  bool is_done();
+  std::vector<double> best_params();
+  double best_objective();
+};
+
+
+/*
+ * Command-line configurable settings shared by the offline and live drivers.
+ */
+struct HalvingOptions {
+  bool enabled;
+  bool hyperband;
+  unsigned int num_candidates;
+  unsigned int min_budget;
+  unsigned int max_budget;
+  double eta;
+  double spread;
+  unsigned int seed;
+};
+
+HalvingOptions parse_halving_options(int argc, char* argv[], unsigned int max_budget);
+
+std::vector<unsigned int> geometric_budgets(unsigned int min_budget, unsigned int max_budget, double eta);
+
+std::vector<std::vector<double> > sample_candidates(const std::vector<double>& center, double spread,
+                                                    unsigned int n, std::mt19937& rng,
+                                                    CandidateFilter filter=nullptr);
+
+
+/*
+ * A scheduler plus the bookkeeping for driving it from telemetry,
+ * one HalvingWorker per live simulator connection.
+ */
+class HalvingScheduler {
+
+private:
+  SuccessiveHalving* halving;
+  Hyperband* hyperband;
+
+public:
+  HalvingScheduler(const HalvingOptions& options, const std::vector<double>& center,
+                   CandidateFilter filter=nullptr);
+  ~HalvingScheduler();
+  bool next_job(HalvingJob& job);
+  void report(const HalvingJob& job, double objective);
+  void requeue(const HalvingJob& job);
+  bool is_done();
+  std::vector<double> best_params();
+  double best_objective();
+};
+
+class HalvingWorker {
+
+private:
+  HalvingScheduler* scheduler;
+  HalvingJob job;
+  bool busy;
+  unsigned int ndiscard;
+  unsigned int nseen;
+  std::vector<double> errors;
+
+public:
+  PID pid_steering;
+  PID pid_throttle;
+
+  HalvingWorker(HalvingScheduler* scheduler, unsigned int ndiscard);
+  ~HalvingWorker();
+  void process_error(double cte);
+};
+
+#endif /* HALVING_H */
@@ -0,0 +1,115 @@
+#include <iostream>
+#include <vector>
+#include <map>
+#include <cstring>    // strcmp
+
+#include "halving.h"
+#include "offline_sim.h"
+#include "sim_bank.h"
+#include "robustness.h"
+#include "stability.h"
+#include "vector_utils.h"
+#include "say_time.h"
+
+// Set parameters.
+#define NSAMPLES 6400
+#define NDISCARD 32
+
+/*
+ * Screen many steering gain sets on the offline simulator with
+ * successive halving (or Hyperband, with --hyperband).
+ * See parse_halving_options and parse_stability_filter for the flags.
+ *
+ * All jobs of a rung are simulated at once in a SimBank; --sim-reference makes
+ * its results identical to the one-at-a-time simulator, --sim-scalar uses that instead.
+ * With --robust N, each job's objective is instead the aggregate over N randomized
+ * scenarios (see parse_robustness_options), the same for every job, run in parallel.
+ */
+int main(int argc, char* argv[]) {
+
+    HalvingOptions options = parse_halving_options(argc, argv, NSAMPLES);
+
+    // Same starting point as twiddle_main.
+    std::vector<double> center = {0.110293, 0.000680556, 0.797399};
+
+    // Optional analytic pre-screen; the offline model has no actuation delay.
+    StabilityFilter* stability = parse_stability_filter(argc, argv, SimParams().target_speed, 0);
+    CandidateFilter filter = nullptr;
+    if(stability) {
+        filter = [stability](const std::vector<double>& p) { return stability->accept(p); };
+    }
+
+    bool scalar = false;
+    sim_bank_mode_t mode = SIM_BANK_FAST;
+    for(int i=1; i<argc; i++) {
+        if(strcmp(argv[i], "--sim-scalar") == 0) {
+            scalar = true;
+        } else if(strcmp(argv[i], "--sim-reference") == 0) {
+            mode = SIM_BANK_REFERENCE;
+        }
+    }
+
+    RobustnessOptions robust_options = parse_robustness_options(argc, argv);
+    RobustEvaluator* robust = nullptr;
+    if(robust_options.enabled) {
+        robust = new RobustEvaluator(robust_options);
+    }
+
+    HalvingScheduler scheduler(options, center, filter);
+
+    unsigned long total_samples = 0;
+    unsigned int num_jobs = 0;
+    while(!scheduler.is_done()) {
+        // Everything that can run now, by budget (Hyperband brackets differ).
+        std::map<unsigned int, std::vector<HalvingJob> > jobs;
+        HalvingJob job;
+        while(scheduler.next_job(job)) {
+            jobs[job.budget].push_back(job);
+        }
+        if(jobs.empty())
+            break;
+
+        for(auto& batch : jobs) {
+            unsigned int budget = batch.first;
+            std::vector<double> objectives;
+            if(robust) {
+                std::vector<std::vector<double> > params;
+                for(auto& j : batch.second) {
+                    params.push_back(j.params);
+                }
+                for(auto& stats : robust->evaluate(params, budget, NDISCARD)) {
+                    objectives.push_back(stats.score);
+                }
+            } else if(scalar) {
+                for(auto& j : batch.second) {
+                    objectives.push_back(evaluate_offline(j.params, budget, NDISCARD));
+                }
+            } else {
+                std::vector<std::vector<double> > params;
+                for(auto& j : batch.second) {
+                    params.push_back(j.params);
+                }
+                objectives = evaluate_offline_batch(params, budget, NDISCARD, SimParams(), 0, mode);
+            }
+            for(unsigned int k=0; k<batch.second.size(); k++) {
+                scheduler.report(batch.second[k], objectives[k]);
+            }
+            unsigned long runs = robust ? robust_options.num_scenarios : 1;
+            total_samples += runs * batch.second.size() * (budget + NDISCARD);
+            num_jobs += batch.second.size();
+        }
+    }
+
+    say_time(); std::cout << "Ran " << num_jobs << " evaluations, " << total_samples << " samples in total (";
+    std::cout << (double) total_samples / (options.max_budget + NDISCARD) << " full-length evaluations)." << std::endl;
+    say_time(); std::cout << "Best objective " << scheduler.best_objective() << " with" << std::endl;
+    say_time(); vec_print(scheduler.best_params(), "p");
+    if(robust) {
+        RobustStats best = robust->evaluate({scheduler.best_params()}, options.max_budget, NDISCARD)[0];
+        say_time(); std::cout << "Over " << robust_options.num_scenarios << " scenarios: mean " << best.mean
+                              << ", p50 " << best.p50 << ", p90 " << best.p90 << ", worst " << best.worst << std::endl;
+        delete robust;
+    }
+
+    return 0;
+}
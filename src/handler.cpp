@@ -0,0 +1,165 @@
+#include "handler.h"
+#include "metrics.h"
+#include "trace.h"
+#include "say_time.h"
+#include <iostream>
+#include <algorithm>  // min, max
+
+using namespace std;
+using json = nlohmann::json;
+
+// Telemetry speed is in mph; distances are integrated in [m].
+constexpr double MPH2MPS = 0.44704;
+
+// Longest gap between frames [s] counted towards the distance driven, e.g. across a pause.
+constexpr double MAXLAPDT = 1.0;
+
+// A car recovering from a failed probe has settled once |cte| stays below this [m].
+constexpr double SETTLEDCTE = 1.0;
+
+
+string hasData(string s) {
+    TRACE_SPAN("hasData");
+    auto found_null = s.find("null");
+    auto b1 = s.find_first_of("[");
+    auto b2 = s.find_last_of("]");
+    if (found_null != string::npos) {
+        return "";
+    } else if (b1 != string::npos && b2 != string::npos) {
+        return s.substr(b1, b2 - b1 + 1);
+    }
+    return "";
+}
+
+
+/*
+ * @brief       Read a telemetry event's fields.
+ * @param[in]   data        The event's data object, j[1] of the parsed message
+ */
+Telemetry parse_telemetry(const json& data) {
+    Telemetry telemetry;
+    telemetry.cte = stod(data["cte"].get<string>());
+    telemetry.speed = stod(data["speed"].get<string>());
+    telemetry.angle = stod(data["steering_angle"].get<string>());
+    return telemetry;
+}
+
+
+/*
+ * @brief       Update both controllers and clip their outputs: steering to [-1, 1], and throttle
+ *              to positive values, since quick switches to braking can make the simulator stick.
+ */
+Controls control_step(PID& steering, PID& throttling, const Telemetry& telemetry, double target_speed) {
+    {
+        TRACE_SPAN("PID::UpdateError");
+        steering.UpdateError(telemetry.cte);
+        throttling.UpdateError(telemetry.speed - target_speed);
+    }
+    Controls controls;
+    controls.steer = max(-1.0, min(1.0, steering.TotalError()));
+    controls.throttle = max(throttling.TotalError(), 0.0);
+    return controls;
+}
+
+
+/*
+ * @brief       Append the frame to cte.csv.
+ */
+void log_frame(ostream& log, const Telemetry& telemetry, const Controls& controls, double i_error) {
+    TRACE_SPAN("cte.csv");
+    log <<epoch_time()<<", " <<telemetry.cte<<","   <<telemetry.speed<<"," <<telemetry.angle<<",";
+    log <<controls.steer<<","   <<controls.throttle<<"," <<i_error<< endl;
+}
+
+
+/*
+ * @brief       The reply to a telemetry event.
+ */
+string steer_message(const Controls& controls) {
+    TRACE_SPAN("serialize");
+    json msgJson;
+    msgJson["steering_angle"] = controls.steer;
+    msgJson["throttle"] = controls.throttle;
+    return "42[\"steer\"," + msgJson.dump() + "]";
+}
+
+
+/*
+ * @brief       Construct the tune stage.
+ * @param[in]   offtrack        Fails probes that leave the road; nullptr to never fail them early.
+ * @param[in]   offtrack_reset  After an off-track failure, reset the simulator instead of recovering.
+ * @param[in]   lap_length      [m]; 0 disables laps.
+ * @param[in]   t               Current time [ms]
+ */
+TuneStage::TuneStage(TwiddlerManager& manager, PID& steering, PID& throttling,
+                     OffTrackDetector* offtrack, bool offtrack_reset, double lap_length, long t)
+        : manager(manager), steering(steering), throttling(throttling), offtrack(offtrack),
+          offtrack_reset(offtrack_reset), lap_length(lap_length), lap_distance(0), last_t(t) {
+}
+
+
+/*
+ * @brief       Score one frame.
+ * @param[in]   t           Time of the frame [ms]
+ * @return      Whether the simulator should be reset now; the controllers already are.
+ */
+bool TuneStage::process(const Telemetry& telemetry, long t) {
+    double cte = telemetry.cte;
+    double speed = telemetry.speed;
+
+    // Integrate the distance driven, to find the ends of windows and laps.
+    double dt = min((t - last_t) / 1000.0, MAXLAPDT);
+    last_t = t;
+    double ds = speed * MPH2MPS * dt;
+
+    unsigned long gain_changes = manager.get_num_gain_changes();
+    offtrack_t reason = OFFTRACK_NONE;
+    if(offtrack && !manager.is_recovering() && !manager.is_converged())
+        reason = offtrack->update(cte, speed);
+    bool reset = false;
+    if(reason != OFFTRACK_NONE) {
+        metrics_count(COUNTER_OFFTRACK);
+        say_time(); cout << "Off track (" << offtrack_name(reason) << ", cte " << cte
+                         << ", speed " << speed << "); failing the probe." << endl;
+        manager.fail_window(!offtrack_reset, SETTLEDCTE);
+        reset = offtrack_reset;
+    } else {
+        {
+            TRACE_SPAN("TwiddlerManager::process_error");
+            manager.process_error(cte, ds);
+        }
+        reset = manager.take_reset();
+    }
+    if(reset) {
+        // Back to the start line for the next candidate, with fresh controller state.
+        steering.Reset();
+        throttling.Reset();
+        lap_distance = 0;
+    }
+    // Swings and stalls of the old gains say nothing about the new ones.
+    if(offtrack && (reset || manager.is_recovering() || manager.get_num_gain_changes() != gain_changes))
+        offtrack->clear();
+    metrics_set(GAUGE_TUNE_WINDOWS, manager.get_num_windows());
+    metrics_set(GAUGE_TUNE_ITERATIONS, manager.get_iterations());
+    metrics_set(GAUGE_TUNE_LAST_OBJECTIVE, manager.get_last_objective());
+    metrics_set(GAUGE_TUNE_BEST_OBJECTIVE, manager.get_best_objective());
+    metrics_set(GAUGE_TUNE_CONVERGED, manager.is_converged());
+    TailQuantiles window = manager.get_window_tails();
+    metrics_set(GAUGE_WINDOW_CTE_P50, window.p50);
+    metrics_set(GAUGE_WINDOW_CTE_P95, window.p95);
+    metrics_set(GAUGE_WINDOW_CTE_P99, window.p99);
+    metrics_set(GAUGE_WINDOW_CTE_MAX, window.max);
+
+    if(lap_length > 0) {
+        lap_distance += ds;
+        if(lap_distance >= lap_length) {
+            lap_distance -= lap_length;
+            TailQuantiles lap = manager.end_lap();
+            metrics_set(GAUGE_LAP_CTE_P50, lap.p50);
+            metrics_set(GAUGE_LAP_CTE_P95, lap.p95);
+            metrics_set(GAUGE_LAP_CTE_P99, lap.p99);
+            metrics_set(GAUGE_LAP_CTE_MAX, lap.max);
+        }
+    }
+    return reset;
+}
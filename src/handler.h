@@ -0,0 +1,68 @@
+#ifndef HANDLER_H
+#define HANDLER_H
+
+#include <string>
+#include <ostream>
+#include "json.hpp"
+#include "PID.h"
+#include "twiddle.h"
+#include "offtrack.h"
+
+/*
+ * The steps of twiddle's telemetry handler that do not need the socket, so that
+ * ./alloc_replay runs (and counts the allocations of) the same code the server does.
+ */
+
+
+/*
+ * Checks if the SocketIO event has JSON data.
+ * If there is data the JSON object in string format will be returned,
+ * else the empty string "" will be returned.
+ */
+std::string hasData(std::string s);
+
+
+struct Telemetry {
+  double cte;
+  double speed;   // [mph]
+  double angle;
+};
+
+Telemetry parse_telemetry(const nlohmann::json& data);
+
+
+struct Controls {
+  double steer;     // [-1, 1]
+  double throttle;  // >= 0
+};
+
+Controls control_step(PID& steering, PID& throttling, const Telemetry& telemetry, double target_speed);
+
+void log_frame(std::ostream& log, const Telemetry& telemetry, const Controls& controls, double i_error);
+
+std::string steer_message(const Controls& controls);
+
+
+/*
+ * Scoring telemetry for twiddle: integrates the distance driven, fails probes
+ * that leave the road, feeds the TwiddlerManager and closes laps.
+ */
+class TuneStage {
+
+private:
+  TwiddlerManager& manager;
+  PID& steering;
+  PID& throttling;
+  OffTrackDetector* offtrack;
+  bool offtrack_reset;
+  double lap_length;
+  double lap_distance;
+  long last_t;
+
+public:
+  TuneStage(TwiddlerManager& manager, PID& steering, PID& throttling,
+            OffTrackDetector* offtrack, bool offtrack_reset, double lap_length, long t);
+  bool process(const Telemetry& telemetry, long t);
+};
+
+#endif /* HANDLER_H */
@@ -2,6 +2,8 @@
 #include <iostream>
 #include "json.hpp"
 #include "PID.h"
+#include "metrics.h"
+#include "trace.h"
 #include <math.h>
 #include <algorithm>  // std::min, std::max
 
@@ -22,6 +24,7 @@ double rad2deg(double x) { return x * 180 / pi(); }
 // If there is data the JSON object in string format will be returned,
 // else the empty string "" will be returned.
 std::string hasData(std::string s) {
+    TRACE_SPAN("hasData");
     auto found_null = s.find("null");
     auto b1 = s.find_first_of("[");
     auto b2 = s.find_last_of("]");
@@ -53,25 +56,40 @@ int main() {
 
     pid_throttle.Init(0.3, 0, 0.02);
 
+#ifdef PID_TRACE
+    trace_dump_at_exit("trace.json");
+#endif
+
     h.onMessage([&pid_steering, &pid_throttle](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
         // "42" at the start of the message means there's a websocket message event.
         // The 4 signifies a websocket message
         // The 2 signifies a websocket event
+        StageClock clock;
+        metrics_count(COUNTER_MESSAGES);
+        metrics_count(COUNTER_BYTES_RECEIVED, length);
         if (length && length > 2 && data[0] == '4' && data[1] == '2') {
-            auto s = hasData(std::string(data).substr(0, length));
+            auto s = hasData(std::string(data, length));
             if (s != "") {
-                auto j = json::parse(s);
+                json j;
+                {
+                    TRACE_SPAN("json::parse");
+                    j = json::parse(s);
+                }
                 std::string event = j[0].get<std::string>();
                 if (event == "telemetry") {
                     // j[1] is the data JSON object
                     double cte = std::stod(j[1]["cte"].get<std::string>());
                     double speed = std::stod(j[1]["speed"].get<std::string>());
                     //double angle = std::stod(j[1]["steering_angle"].get<std::string>());
-
-                    pid_steering.UpdateError(cte);
+                    clock.lap(STAGE_PARSE);
+                    metrics_count(COUNTER_FRAMES);
 
                     double speedTarget = TARGETSPEED;
-                    pid_throttle.UpdateError(speed - speedTarget);
+                    {
+                        TRACE_SPAN("PID::UpdateError");
+                        pid_steering.UpdateError(cte);
+                        pid_throttle.UpdateError(speed - speedTarget);
+                    }
 
                     /*
                     * Calcuate steering value here, remember the steering value is
@@ -81,26 +99,43 @@ int main() {
                     */
                     double steer_value = std::max(-1.0, std::min(1.0, pid_steering.TotalError()));
                     double throttle = pid_throttle.TotalError();
-
-                    json msgJson;
-                    msgJson["steering_angle"] = steer_value;
-                    msgJson["throttle"] = throttle;
-                    auto msg = "42[\"steer\"," + msgJson.dump() + "]";
-                    ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+                    clock.lap(STAGE_CONTROL);
+
+                    std::string msg;
+                    {
+                        TRACE_SPAN("serialize");
+                        json msgJson;
+                        msgJson["steering_angle"] = steer_value;
+                        msgJson["throttle"] = throttle;
+                        msg = "42[\"steer\"," + msgJson.dump() + "]";
+                    }
+                    clock.lap(STAGE_SERIALIZE);
+                    metrics_count(COUNTER_BYTES_SENT, msg.length());
+                    {
+                        TRACE_SPAN("ws.send");
+                        ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+                    }
+                    clock.lap(STAGE_SEND);
                 }
             } else {
                 // Manual driving
+                metrics_count(COUNTER_MANUAL);
                 std::string msg = "42[\"manual\",{}]";
                 ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
             }
         }
     });
 
-    // We don't need this since we're not using HTTP but if it's removed the program
-    // doesn't compile :-(
+    // Serve the metrics for Prometheus (or curl) at /metrics, and the spans recorded so far at /trace.
     h.onHttpRequest([](uWS::HttpResponse *res, uWS::HttpRequest req, char *data, size_t, size_t) {
         const std::string s = "<h1>Hello world!</h1>";
-        if (req.getUrl().valueLength == 1) {
+        if (req.getUrl().toString() == "/metrics") {
+            std::string body = metrics_exposition();
+            res->end(body.data(), body.length());
+        } else if (req.getUrl().toString() == "/trace") {
+            std::string body = trace_json();
+            res->end(body.data(), body.length());
+        } else if (req.getUrl().valueLength == 1) {
             res->end(s.data(), s.length());
         } else {
             // i guess this should be done more gracefully?
@@ -110,9 +145,13 @@ int main() {
 
     h.onConnection([&h](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
         std::cout << "Connected!!!" << std::endl;
+        metrics_count(COUNTER_CONNECTIONS);
+        metrics_add(GAUGE_CONNECTIONS_ACTIVE, 1);
     });
 
     h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
+        metrics_count(COUNTER_DISCONNECTIONS);
+        metrics_add(GAUGE_CONNECTIONS_ACTIVE, -1);
         ws.close();
         std::cout << "Disconnected" << std::endl;
     });
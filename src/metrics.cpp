@@ -0,0 +1,438 @@
+#include "metrics.h"
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <sstream>
+#include <new>
+#include <cstdlib>    // posix_memalign
+#include <algorithm>  // min
+
+using namespace std;
+
+static const char* COUNTER_NAMES[NUM_COUNTERS][2] = {
+    {"pid_messages_total",       "Websocket messages received."},
+    {"pid_frames_total",         "Telemetry frames received."},
+    {"pid_manual_frames_total",  "Frames without telemetry data (manual driving)."},
+    {"pid_received_bytes_total", "Websocket payload bytes received."},
+    {"pid_sent_bytes_total",     "Websocket payload bytes sent."},
+    {"pid_connections_total",    "Simulator connections accepted."},
+    {"pid_disconnections_total", "Simulator disconnections."},
+    {"pid_loop_lag_alerts_total", "Event loop lag probes over the alert threshold."},
+    {"pid_cadence_alerts_total", "Telemetry frame intervals off the nominal period by more than the alert threshold."},
+    {"pid_offtrack_total",       "Tuning probes stopped early because the car left the road, stalled or oscillated."},
+};
+
+static const char* STAGE_NAMES[NUM_STAGES] = {
+    "parse", "control", "serialize", "send", "log", "tune", "total",
+};
+
+static const char* GAUGE_NAMES[NUM_GAUGES][2] = {
+    {"pid_connections_active",     "Currently connected simulators."},
+    {"pid_send_queue_depth",       "Replies handed to the socket but not yet written."},
+    {"pid_tune_windows",           "Evaluation windows completed by the tuner."},
+    {"pid_tune_iterations",        "Twiddle loops over all parameters."},
+    {"pid_tune_last_objective",    "Objective of the last evaluation window."},
+    {"pid_tune_best_objective",    "Best objective accepted by the tuner."},
+    {"pid_tune_converged",         "Whether the tuner has converged (0 or 1)."},
+    {"pid_window_abs_cte_p50",     "Median |cte| of the last evaluation window."},
+    {"pid_window_abs_cte_p95",     "95th percentile |cte| of the last evaluation window."},
+    {"pid_window_abs_cte_p99",     "99th percentile |cte| of the last evaluation window."},
+    {"pid_window_abs_cte_max",     "Largest |cte| of the last evaluation window."},
+    {"pid_lap_abs_cte_p50",        "Median |cte| of the last completed lap."},
+    {"pid_lap_abs_cte_p95",        "95th percentile |cte| of the last completed lap."},
+    {"pid_lap_abs_cte_p99",        "99th percentile |cte| of the last completed lap."},
+    {"pid_lap_abs_cte_max",        "Largest |cte| of the last completed lap."},
+};
+
+// Exposed histogram bounds are powers of two, which are also internal bucket boundaries.
+static const unsigned int LATENCY_MIN_LOG2 = 8;    // 256 [ns]
+static const unsigned int LATENCY_MAX_LOG2 = 30;   // ~1.07 [s]
+
+struct HistogramInfo {
+  const char* name;
+  const char* help;
+  unsigned int min_log2, max_log2;
+  double scale;
+};
+
+static const HistogramInfo HISTOGRAMS[NUM_HISTOGRAMS] = {
+    {"pid_connection_frames", "Telemetry frames per finished connection.", 0, 24, 1},
+    {"pid_message_allocations", "Heap allocations per websocket message.", 0, 16, 1},
+    {"pid_loop_lag_seconds", "How late the event loop ran the lag probe's timer.", 10, 30, 1e-9},
+    {"pid_frame_interval_seconds", "Time between consecutive telemetry frames of a connection.", 20, 30, 1e-9},
+};
+
+static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+static const char* PERF_EVENT_NAMES[NUM_PERF_EVENTS][2] = {
+    {"pid_stage_cpu_cycles_total",    "CPU cycles spent in handler stages."},
+    {"pid_stage_instructions_total",  "Instructions retired in handler stages."},
+    {"pid_stage_cache_misses_total",  "Last-level cache misses in handler stages."},
+    {"pid_stage_branch_misses_total", "Mispredicted branches in handler stages."},
+};
+
+static mutex shards_mutex;
+static vector<MetricsShard*> shards;
+static atomic<double> gauges[NUM_GAUGES];
+static atomic<bool> perf_recorded(false);
+
+
+/*
+ * @brief       Add to a counter that only this thread writes, without a locked instruction.
+ */
+static inline void single_writer_add(atomic<uint64_t>& x, uint64_t n) {
+    x.store(x.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+
+/*
+ * @brief       This thread's shard, created and registered on first use.
+ * Shards are never freed, so counts from finished threads are kept.
+ */
+static MetricsShard& local_shard() {
+    thread_local MetricsShard* shard = nullptr;
+    if(!shard) {
+        // Plain new ignores over-alignment before C++17.
+        void* memory = nullptr;
+        if(posix_memalign(&memory, alignof(MetricsShard), sizeof(MetricsShard)) != 0)
+            throw bad_alloc();
+        shard = new(memory) MetricsShard();
+        lock_guard<mutex> lock(shards_mutex);
+        shards.push_back(shard);
+    }
+    return *shard;
+}
+
+
+
+/*****************************************************************
+ ***************** Log-linear histogram. *************************
+ *****************************************************************/
+
+
+LogHistogram::LogHistogram() {
+    for(auto& c : counts) {
+        c.store(0, memory_order_relaxed);
+    }
+    count.store(0, memory_order_relaxed);
+    sum.store(0, memory_order_relaxed);
+}
+
+
+/*
+ * @brief       Record one value. Must only be called by the owning thread.
+ */
+void LogHistogram::record(uint64_t value) {
+    single_writer_add(counts[bucket(value)], 1);
+    single_writer_add(count, 1);
+    single_writer_add(sum, value);
+}
+
+
+/*
+ * @brief       Upper bound of the bucket holding quantile q (0 if empty; q=1 gives the maximum).
+ */
+uint64_t LogHistogram::quantile(double q) const {
+    uint64_t n = count.load(memory_order_relaxed);
+    if(n == 0)
+        return 0;
+    uint64_t rank = min((uint64_t) (q * n), n - 1);
+    uint64_t cumulative = 0;
+    for(unsigned int i=0; i<NUM_BUCKETS; i++) {
+        cumulative += counts[i].load(memory_order_relaxed);
+        if(cumulative > rank)
+            return bucket_upper(i);
+    }
+    return 0;
+}
+
+
+/*
+ * @brief       Index of the bucket holding a value.
+ */
+unsigned int LogHistogram::bucket(uint64_t value) {
+    if(value < (1u << SUB_BITS))
+        return value;
+    unsigned int e = 63 - __builtin_clzll(value);
+    unsigned int sub = (value >> (e - SUB_BITS)) & ((1u << SUB_BITS) - 1);
+    return ((e - SUB_BITS + 1) << SUB_BITS) + sub;
+}
+
+
+/*
+ * @brief       Largest value falling in a bucket.
+ */
+uint64_t LogHistogram::bucket_upper(unsigned int index) {
+    if(index < (1u << SUB_BITS))
+        return index;
+    unsigned int e = (index >> SUB_BITS) + SUB_BITS - 1;
+    uint64_t sub = index & ((1u << SUB_BITS) - 1);
+    uint64_t lower = ((1ull << SUB_BITS) + sub) << (e - SUB_BITS);
+    return lower + (1ull << (e - SUB_BITS)) - 1;
+}
+
+
+MetricsShard::MetricsShard() {
+    for(auto& c : counters) {
+        c.store(0, memory_order_relaxed);
+    }
+    for(unsigned int s=0; s<NUM_STAGES; s++) {
+        stage_allocations[s].store(0, memory_order_relaxed);
+        stage_allocated_bytes[s].store(0, memory_order_relaxed);
+        stage_perf_samples[s].store(0, memory_order_relaxed);
+        for(auto& c : stage_perf[s]) {
+            c.store(0, memory_order_relaxed);
+        }
+    }
+}
+
+
+
+/*****************************************************************
+ ***************** Recording. ************************************
+ *****************************************************************/
+
+
+/*
+ * @brief       Monotonic time in nanoseconds.
+ */
+uint64_t metrics_now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void metrics_count(metric_counter_t counter, uint64_t n) {
+    single_writer_add(local_shard().counters[counter], n);
+}
+
+void metrics_observe(metric_stage_t stage, uint64_t ns) {
+    local_shard().stages[stage].record(ns);
+}
+
+void metrics_record(metric_histogram_t histogram, uint64_t value) {
+    local_shard().histograms[histogram].record(value);
+}
+
+void metrics_count_allocations(metric_stage_t stage, uint64_t allocations, uint64_t bytes) {
+    MetricsShard& shard = local_shard();
+    single_writer_add(shard.stage_allocations[stage], allocations);
+    single_writer_add(shard.stage_allocated_bytes[stage], bytes);
+    if(stage == STAGE_TOTAL)
+        shard.histograms[HISTOGRAM_MESSAGE_ALLOCATIONS].record(allocations);
+}
+
+void metrics_count_perf(metric_stage_t stage, const uint64_t deltas[NUM_PERF_EVENTS]) {
+    MetricsShard& shard = local_shard();
+    for(unsigned int e=0; e<NUM_PERF_EVENTS; e++) {
+        single_writer_add(shard.stage_perf[stage][e], deltas[e]);
+    }
+    single_writer_add(shard.stage_perf_samples[stage], 1);
+    if(!perf_recorded.load(memory_order_relaxed))
+        perf_recorded.store(true, memory_order_relaxed);
+}
+
+void metrics_set(metric_gauge_t gauge, double value) {
+    gauges[gauge].store(value, memory_order_relaxed);
+}
+
+void metrics_add(metric_gauge_t gauge, double delta) {
+    double old = gauges[gauge].load(memory_order_relaxed);
+    while(!gauges[gauge].compare_exchange_weak(old, old + delta, memory_order_relaxed)) {}
+}
+
+
+StageClock::StageClock() {
+    alloc_start = alloc_last = alloc_counters;
+    start = last = metrics_now_ns();
+}
+
+StageClock::~StageClock() {
+    metrics_observe(STAGE_TOTAL, metrics_now_ns() - start);
+    if(alloc_counting_enabled()) {
+        metrics_count_allocations(STAGE_TOTAL, alloc_counters.allocations - alloc_start.allocations,
+                                  alloc_counters.bytes - alloc_start.bytes);
+    }
+}
+
+/*
+ * @brief       Attribute the time and allocations since the previous lap to a stage.
+ */
+void StageClock::lap(metric_stage_t stage) {
+    uint64_t now = metrics_now_ns();
+    metrics_observe(stage, now - last);
+    last = now;
+    if(alloc_counting_enabled()) {
+        AllocCounters a = alloc_counters;
+        metrics_count_allocations(stage, a.allocations - alloc_last.allocations, a.bytes - alloc_last.bytes);
+        alloc_last = a;
+    }
+}
+
+/*
+ * @brief       Heap allocations since construction (zero without allocation counting).
+ */
+uint64_t StageClock::allocations() {
+    return alloc_counters.allocations - alloc_start.allocations;
+}
+
+
+
+/*****************************************************************
+ ***************** Exposition. ***********************************
+ *****************************************************************/
+
+
+/*
+ * @brief       Sum one histogram over all shards.
+ * @param[in]   index       A stage, or NUM_STAGES plus a metric_histogram_t.
+ */
+static void merge(unsigned int index, vector<uint64_t>& counts, uint64_t& count, uint64_t& sum) {
+    counts.assign(LogHistogram::NUM_BUCKETS, 0);
+    count = 0;
+    sum = 0;
+    for(auto shard : shards) {
+        const LogHistogram& h = index < NUM_STAGES ? shard->stages[index] : shard->histograms[index - NUM_STAGES];
+        for(unsigned int i=0; i<LogHistogram::NUM_BUCKETS; i++) {
+            counts[i] += h.counts[i].load(memory_order_relaxed);
+        }
+        count += h.count.load(memory_order_relaxed);
+        sum += h.sum.load(memory_order_relaxed);
+    }
+}
+
+
+/*
+ * @brief       Write a merged histogram as Prometheus buckets at powers of two.
+ * @param[in]   scale       Multiplier from recorded units to exposed units.
+ */
+static void write_histogram(ostringstream& out, const string& name, const string& labels,
+                            const vector<uint64_t>& counts, uint64_t count, uint64_t sum,
+                            unsigned int min_log2, unsigned int max_log2, double scale) {
+    string sep = labels.empty() ? "" : ",";
+    uint64_t cumulative = 0;
+    unsigned int i = 0;
+    for(unsigned int k=min_log2; k<=max_log2; k++) {
+        // Buckets entirely below 2^k.
+        while(i < LogHistogram::NUM_BUCKETS && LogHistogram::bucket_upper(i) < (1ull << k)) {
+            cumulative += counts[i++];
+        }
+        out << name << "_bucket{" << labels << sep << "le=\"" << (1ull << k) * scale << "\"} " << cumulative << "\n";
+    }
+    out << name << "_bucket{" << labels << sep << "le=\"+Inf\"} " << count << "\n";
+    string braced = labels.empty() ? "" : "{" + labels + "}";
+    out << name << "_sum" << braced << " " << sum * scale << "\n";
+    out << name << "_count" << braced << " " << count << "\n";
+}
+
+
+/*
+ * @brief       Upper bound of the bucket holding quantile q of a merged histogram.
+ */
+static uint64_t quantile(const vector<uint64_t>& counts, uint64_t count, double q) {
+    if(count == 0)
+        return 0;
+    uint64_t rank = min((uint64_t) (q * count), count - 1);
+    uint64_t cumulative = 0;
+    for(unsigned int i=0; i<LogHistogram::NUM_BUCKETS; i++) {
+        cumulative += counts[i];
+        if(cumulative > rank)
+            return LogHistogram::bucket_upper(i);
+    }
+    return 0;
+}
+
+
+/*
+ * @brief       All metrics in the Prometheus text exposition format.
+ */
+string metrics_exposition() {
+    lock_guard<mutex> lock(shards_mutex);
+    ostringstream out;
+
+    for(unsigned int c=0; c<NUM_COUNTERS; c++) {
+        uint64_t total = 0;
+        for(auto shard : shards) {
+            total += shard->counters[c].load(memory_order_relaxed);
+        }
+        out << "# HELP " << COUNTER_NAMES[c][0] << " " << COUNTER_NAMES[c][1] << "\n";
+        out << "# TYPE " << COUNTER_NAMES[c][0] << " counter\n";
+        out << COUNTER_NAMES[c][0] << " " << total << "\n";
+    }
+
+    for(unsigned int g=0; g<NUM_GAUGES; g++) {
+        out << "# HELP " << GAUGE_NAMES[g][0] << " " << GAUGE_NAMES[g][1] << "\n";
+        out << "# TYPE " << GAUGE_NAMES[g][0] << " gauge\n";
+        out << GAUGE_NAMES[g][0] << " " << gauges[g].load(memory_order_relaxed) << "\n";
+    }
+
+    vector<uint64_t> counts;
+    uint64_t count, sum;
+
+    out << "# HELP pid_stage_latency_seconds Telemetry handler latency by stage.\n";
+    out << "# TYPE pid_stage_latency_seconds histogram\n";
+    ostringstream quantiles;
+    for(unsigned int s=0; s<NUM_STAGES; s++) {
+        merge(s, counts, count, sum);
+        string labels = string("stage=\"") + STAGE_NAMES[s] + "\"";
+        write_histogram(out, "pid_stage_latency_seconds", labels, counts, count, sum,
+                        LATENCY_MIN_LOG2, LATENCY_MAX_LOG2, 1e-9);
+        for(auto q : QUANTILES) {
+            quantiles << "pid_stage_latency_quantile_seconds{" << labels << ",quantile=\"" << q << "\"} ";
+            quantiles << quantile(counts, count, q) * 1e-9 << "\n";
+        }
+    }
+    out << "# HELP pid_stage_latency_quantile_seconds Handler latency quantiles (bucket upper bounds, within 12.5%).\n";
+    out << "# TYPE pid_stage_latency_quantile_seconds gauge\n";
+    out << quantiles.str();
+
+    for(unsigned int i=0; i<NUM_HISTOGRAMS; i++) {
+        if(i == HISTOGRAM_MESSAGE_ALLOCATIONS && !alloc_counting_enabled())
+            continue;
+        const HistogramInfo& info = HISTOGRAMS[i];
+        merge(NUM_STAGES + i, counts, count, sum);
+        out << "# HELP " << info.name << " " << info.help << "\n";
+        out << "# TYPE " << info.name << " histogram\n";
+        write_histogram(out, info.name, "", counts, count, sum, info.min_log2, info.max_log2, info.scale);
+    }
+
+    if(alloc_counting_enabled()) {
+        out << "# HELP pid_stage_allocations_total Heap allocations by handler stage.\n";
+        out << "# TYPE pid_stage_allocations_total counter\n";
+        for(unsigned int s=0; s<NUM_STAGES; s++) {
+            uint64_t total = 0;
+            for(auto shard : shards) {
+                total += shard->stage_allocations[s].load(memory_order_relaxed);
+            }
+            out << "pid_stage_allocations_total{stage=\"" << STAGE_NAMES[s] << "\"} " << total << "\n";
+        }
+        out << "# HELP pid_stage_allocated_bytes_total Heap bytes requested by handler stage.\n";
+        out << "# TYPE pid_stage_allocated_bytes_total counter\n";
+        for(unsigned int s=0; s<NUM_STAGES; s++) {
+            uint64_t total = 0;
+            for(auto shard : shards) {
+                total += shard->stage_allocated_bytes[s].load(memory_order_relaxed);
+            }
+            out << "pid_stage_allocated_bytes_total{stage=\"" << STAGE_NAMES[s] << "\"} " << total << "\n";
+        }
+    }
+
+    if(perf_recorded.load(memory_order_relaxed)) {
+        for(unsigned int e=0; e<=NUM_PERF_EVENTS; e++) {
+            const char* name = e < NUM_PERF_EVENTS ? PERF_EVENT_NAMES[e][0] : "pid_stage_perf_samples_total";
+            const char* help = e < NUM_PERF_EVENTS ? PERF_EVENT_NAMES[e][1] : "Stage runs measured with hardware counters.";
+            out << "# HELP " << name << " " << help << "\n";
+            out << "# TYPE " << name << " counter\n";
+            for(unsigned int s=0; s<NUM_STAGES; s++) {
+                uint64_t total = 0;
+                for(auto shard : shards) {
+                    total += e < NUM_PERF_EVENTS ? shard->stage_perf[s][e].load(memory_order_relaxed)
+                                                 : shard->stage_perf_samples[s].load(memory_order_relaxed);
+                }
+                if(total)
+                    out << name << "{stage=\"" << STAGE_NAMES[s] << "\"} " << total << "\n";
+            }
+        }
+    }
+
+    return out.str();
+}
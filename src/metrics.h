@@ -0,0 +1,158 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include "alloc_count.h"
+
+/*
+ * Process-wide metrics, exposed in the Prometheus text format at /metrics.
+ *
+ * Counters and histograms are sharded per thread: each thread writes only its
+ * own cache-line-aligned shard, with relaxed atomic loads and stores and no
+ * read-modify-write, so the hot path never contends or takes a lock.
+ * A scrape sums the shards. Gauges are set rarely and are plain atomics.
+ * In builds with allocation counting (see alloc_count.h), heap allocations
+ * are also attributed to handler stages, and so are hardware counter deltas
+ * when they are collected (see perf_counters.h).
+ */
+
+enum metric_counter_enum {
+  COUNTER_MESSAGES,       // all websocket messages
+  COUNTER_FRAMES,         // telemetry frames
+  COUNTER_MANUAL,         // frames without data (manual mode)
+  COUNTER_BYTES_RECEIVED,
+  COUNTER_BYTES_SENT,
+  COUNTER_CONNECTIONS,
+  COUNTER_DISCONNECTIONS,
+  COUNTER_LOOP_LAG_ALERTS,
+  COUNTER_CADENCE_ALERTS,
+  COUNTER_OFFTRACK,       // probes failed by the off-track detector
+  NUM_COUNTERS
+};
+typedef enum metric_counter_enum metric_counter_t;
+
+enum metric_stage_enum {
+  STAGE_PARSE,
+  STAGE_CONTROL,
+  STAGE_SERIALIZE,
+  STAGE_SEND,
+  STAGE_LOG,
+  STAGE_TUNE,
+  STAGE_TOTAL,
+  NUM_STAGES
+};
+typedef enum metric_stage_enum metric_stage_t;
+
+enum metric_histogram_enum {
+  HISTOGRAM_CONNECTION_FRAMES,    // telemetry frames per finished connection
+  HISTOGRAM_MESSAGE_ALLOCATIONS,  // heap allocations per message (with allocation counting)
+  HISTOGRAM_LOOP_LAG,             // event loop lag [ns]
+  HISTOGRAM_FRAME_INTERVAL,       // time between telemetry frames on a connection [ns]
+  NUM_HISTOGRAMS
+};
+typedef enum metric_histogram_enum metric_histogram_t;
+
+enum metric_perf_event_enum {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_CACHE_MISSES,
+  PERF_BRANCH_MISSES,
+  NUM_PERF_EVENTS
+};
+typedef enum metric_perf_event_enum metric_perf_event_t;
+
+enum metric_gauge_enum {
+  GAUGE_CONNECTIONS_ACTIVE,
+  GAUGE_SEND_QUEUE_DEPTH,
+  GAUGE_TUNE_WINDOWS,
+  GAUGE_TUNE_ITERATIONS,
+  GAUGE_TUNE_LAST_OBJECTIVE,
+  GAUGE_TUNE_BEST_OBJECTIVE,
+  GAUGE_TUNE_CONVERGED,
+  GAUGE_WINDOW_CTE_P50,
+  GAUGE_WINDOW_CTE_P95,
+  GAUGE_WINDOW_CTE_P99,
+  GAUGE_WINDOW_CTE_MAX,
+  GAUGE_LAP_CTE_P50,
+  GAUGE_LAP_CTE_P95,
+  GAUGE_LAP_CTE_P99,
+  GAUGE_LAP_CTE_MAX,
+  NUM_GAUGES
+};
+typedef enum metric_gauge_enum metric_gauge_t;
+
+
+/*
+ * Log-linear ("HDR-style") histogram of non-negative integers: exact below 8,
+ * then 8 sub-buckets per power of two (at most 12.5% relative error) up to 2^64.
+ * Single writer; any number of readers.
+ */
+class LogHistogram {
+
+public:
+  static const unsigned int SUB_BITS = 3;
+  static const unsigned int NUM_BUCKETS = (64 - SUB_BITS + 1) << SUB_BITS;
+
+  std::atomic<uint64_t> counts[NUM_BUCKETS];
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> sum;
+
+  LogHistogram();
+  void record(uint64_t value);
+  uint64_t quantile(double q) const;
+
+  static unsigned int bucket(uint64_t value);
+  static uint64_t bucket_upper(unsigned int index);
+};
+
+
+/*
+ * One thread's metrics. Aligned so neighbouring shards never share a cache line.
+ */
+struct alignas(64) MetricsShard {
+  std::atomic<uint64_t> counters[NUM_COUNTERS];
+  LogHistogram stages[NUM_STAGES];
+  LogHistogram histograms[NUM_HISTOGRAMS];
+  std::atomic<uint64_t> stage_allocations[NUM_STAGES];
+  std::atomic<uint64_t> stage_allocated_bytes[NUM_STAGES];
+  std::atomic<uint64_t> stage_perf[NUM_STAGES][NUM_PERF_EVENTS];
+  std::atomic<uint64_t> stage_perf_samples[NUM_STAGES];
+
+  MetricsShard();
+};
+
+
+uint64_t metrics_now_ns();
+void metrics_count(metric_counter_t counter, uint64_t n=1);
+void metrics_observe(metric_stage_t stage, uint64_t ns);
+void metrics_record(metric_histogram_t histogram, uint64_t value);
+void metrics_count_allocations(metric_stage_t stage, uint64_t allocations, uint64_t bytes);
+void metrics_count_perf(metric_stage_t stage, const uint64_t deltas[NUM_PERF_EVENTS]);
+void metrics_set(metric_gauge_t gauge, double value);
+void metrics_add(metric_gauge_t gauge, double delta);
+std::string metrics_exposition();
+
+
+/*
+ * Times consecutive stages of a handler: each lap() records the time (and heap
+ * allocations) since the previous lap (or construction) under the given stage,
+ * and the destructor records the whole span as STAGE_TOTAL.
+ */
+class StageClock {
+
+private:
+  uint64_t start;
+  uint64_t last;
+  AllocCounters alloc_start;
+  AllocCounters alloc_last;
+
+public:
+  StageClock();
+  ~StageClock();
+  void lap(metric_stage_t stage);
+  uint64_t allocations();
+};
+
+#endif /* METRICS_H */
@@ -0,0 +1,243 @@
+#include "offline_sim.h"
+#include "twiddle.h"
+#include <cmath>
+#include <cstring>    // memcpy
+#include <type_traits>
+#include <algorithm>  // std::min, std::max, std::fill
+
+using namespace std;
+
+/*
+ * Harmonics of the track curvature profile, as fractions of a lap.
+ * Together they give a mix of straights, broad sweepers and a couple
+ * of tighter (~50 [m] radius) turns, roughly like the lake track.
+ */
+const double CURVATURE_AMPLITUDES[NUM_HARMONICS] = {0.004, 0.008, 0.006, 0.003};
+const double CURVATURE_PHASES[NUM_HARMONICS]     = {0.0,   1.3,   2.1,   0.4};
+
+
+/*
+ * @brief       Default vehicle and track parameters.
+ */
+SimParams::SimParams() {
+    dt = SIM_DT;
+    substeps = 4;
+    wheelbase = 2.67;
+    max_angle = 25.0;
+    accel_gain = 5.0;
+    drag = 0.05;
+    lap_length = 1000.0;
+    road_halfwidth = 4.0;
+    cte_noise = 0.0;
+    initial_cte = 0.0;
+    initial_speed = 0.0;
+    target_speed = 40.0;
+    delay = 0;
+}
+
+
+/*
+ * @brief       Construct the offline simulator.
+ * @param[in]   params      Vehicle and track parameters.
+ * @param[in]   seed        Seed for the measurement noise.
+ */
+OfflineSimulator::OfflineSimulator(SimParams params, unsigned int seed)
+        : params(params), noise(0.0, 1.0), seed(seed) {
+    this->params.delay = min(params.delay, (unsigned int) MAX_DELAY);
+    reset();
+}
+
+
+/*
+ * @brief       Put the car back at the start line.
+ */
+void OfflineSimulator::reset() {
+    rng.seed(seed);
+    noise.reset();
+    s = 0;
+    cte = params.initial_cte;
+    epsi = 0;
+    v = params.initial_speed * MPH2MPS;
+    angle = 0;
+    steps = 0;
+    crashed = false;
+    fill(pending_steer, pending_steer + MAX_DELAY + 1, 0.0);
+    fill(pending_throttle, pending_throttle + MAX_DELAY + 1, 0.0);
+}
+
+
+/*
+ * @brief       Signed curvature of the centerline [1/m] at arc length s.
+ */
+double OfflineSimulator::curvature(double s) const {
+    double k = 0;
+    double phase = 2 * M_PI * s / params.lap_length;
+    for(unsigned int i=0; i<NUM_HARMONICS; i++) {
+        k += CURVATURE_AMPLITUDES[i] * sin((i + 1) * phase + CURVATURE_PHASES[i]);
+    }
+    return k;
+}
+
+
+/*
+ * @brief       Advance one control period.
+ * @param[in]   steer       Steering command in [-1, 1]; positive steers toward positive cte, as in Unity.
+ * @param[in]   throttle    Throttle command in [-1, 1].
+ */
+void OfflineSimulator::step(double steer, double throttle) {
+    // The command takes effect params.delay periods from now; apply the one given that long ago.
+    unsigned int slots = params.delay + 1;
+    pending_steer[steps % slots] = steer;
+    pending_throttle[steps % slots] = throttle;
+    steer = pending_steer[(steps + 1) % slots];
+    throttle = pending_throttle[(steps + 1) % slots];
+    steps++;
+
+    // Once off the road, the car is stuck against the wall, as in Unity.
+    if(crashed)
+        return;
+
+    steer = max(-1.0, min(1.0, steer));
+    throttle = max(-1.0, min(1.0, throttle));
+    angle = steer * params.max_angle;
+    double delta = angle * M_PI / 180.0;
+
+    double h = params.dt / params.substeps;
+    for(unsigned int i=0; i<params.substeps; i++) {
+        // Semi-implicit Euler: update speed and heading first, then position.
+        v += h * (params.accel_gain * throttle - params.drag * v);
+        v = max(0.0, v);
+        double sdot = v * cos(epsi) / (1.0 + curvature(s) * cte);
+        epsi += h * (v / params.wheelbase * tan(delta) - curvature(s) * sdot);
+        cte += h * v * sin(epsi);
+        s += h * sdot;
+    }
+
+    if(fabs(cte) > params.road_halfwidth) {
+        crashed = true;
+        v = 0;
+    }
+}
+
+
+/*
+ * @brief       The cte as reported in telemetry, including measurement noise.
+ */
+double OfflineSimulator::measured_cte() {
+    if(params.cte_noise > 0)
+        return cte + params.cte_noise * noise(rng);
+    return cte;
+}
+
+
+/*
+ * @brief       Speed in the simulator's telemetry unit.
+ */
+double OfflineSimulator::speed_mph() const {
+    return v / MPH2MPS;
+}
+
+
+/*
+ * @brief       Number of completed laps.
+ */
+unsigned int OfflineSimulator::laps() const {
+    return (unsigned int) (s / params.lap_length);
+}
+
+
+/*
+ * @brief       Getter for the simulator configuration.
+ */
+const SimParams& OfflineSimulator::get_params() const {
+    return params;
+}
+
+
+/*
+ * @brief       The full state, to come back to with restore.
+ */
+SimState OfflineSimulator::save() const {
+    static_assert(is_trivially_copyable<SimState>::value, "SimState must be memcpy-able");
+    SimState state;
+    state.s = s;
+    state.cte = cte;
+    state.epsi = epsi;
+    state.v = v;
+    state.angle = angle;
+    state.steps = steps;
+    state.crashed = crashed;
+    memcpy(state.pending_steer, pending_steer, sizeof(pending_steer));
+    memcpy(state.pending_throttle, pending_throttle, sizeof(pending_throttle));
+    state.rng = rng;
+    state.noise = noise;
+    return state;
+}
+
+
+/*
+ * @brief       Continue from a saved state, possibly of another simulator with the same SimParams.
+ */
+void OfflineSimulator::restore(const SimState& state) {
+    s = state.s;
+    cte = state.cte;
+    epsi = state.epsi;
+    v = state.v;
+    angle = state.angle;
+    steps = state.steps;
+    crashed = state.crashed;
+    memcpy(pending_steer, state.pending_steer, sizeof(pending_steer));
+    memcpy(pending_throttle, state.pending_throttle, sizeof(pending_throttle));
+    rng = state.rng;
+    noise = state.noise;
+}
+
+
+/*
+ * @brief       Run the closed loop for a number of control periods.
+ * @return      The measured cte at each period.
+ */
+vector<double> simulate_cte(OfflineSimulator& sim, PID& pid_steering, PID& pid_throttle, unsigned int nsamples) {
+    vector<double> history;
+    history.reserve(nsamples);
+    double target_speed = sim.get_params().target_speed;
+    double dt = sim.get_params().dt / SIM_DT;
+
+    for(unsigned int t=0; t<nsamples; t++) {
+        double cte = sim.measured_cte();
+        history.push_back(cte);
+
+        pid_steering.UpdateError(cte, dt);
+        pid_throttle.UpdateError(sim.speed_mph() - target_speed, dt);
+
+        double steer_value = max(-1.0, min(1.0, pid_steering.TotalError()));
+        double throttle = max(pid_throttle.TotalError(), 0.0);
+        sim.step(steer_value, throttle);
+    }
+    return history;
+}
+
+
+/*
+ * @brief       Evaluate a parameter vector on a fresh offline simulator.
+ * @param[in]   params      {Kp, Ki, Kd} for steering, optionally followed by {Kp, Ki, Kd} for throttle
+ * @param[in]   nsamples    Number of samples to score
+ * @param[in]   ndiscard    Number of initial samples to run but not score
+ * @return      The Twiddle objective (lower is better)
+ */
+double evaluate_offline(const vector<double>& params, unsigned int nsamples, unsigned int ndiscard,
+                        SimParams sim_params, unsigned int seed) {
+    PID pid_steering;
+    PID pid_throttle;
+    pid_steering.Init(fabs(params[0]), fabs(params[1]), fabs(params[2]));
+    if(params.size() >= 6) {
+        pid_throttle.Init(fabs(params[3]), fabs(params[4]), fabs(params[5]));
+    } else {
+        pid_throttle.Init(0.3, 0, 0.02);
+    }
+
+    OfflineSimulator sim(sim_params, seed);
+    vector<double> history = simulate_cte(sim, pid_steering, pid_throttle, nsamples + ndiscard);
+    vector<double> errors(history.begin() + ndiscard, history.end());
+    return twiddle_objective(errors);
+}
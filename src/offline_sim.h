@@ -0,0 +1,130 @@
+#ifndef OFFLINE_SIM_H
+#define OFFLINE_SIM_H
+
+#include <vector>
+#include <random>
+#include "PID.h"
+
+/*
+ * Nominal period between telemetry messages from the simulator [s].
+ */
+#define SIM_DT 0.049
+
+/*
+ * Conversion between the simulator's speed unit and SI.
+ */
+#define MPH2MPS 0.44704
+
+/*
+ * Longest actuation delay the models hold commands for [control periods].
+ */
+#define MAX_DELAY 16
+
+/*
+ * Harmonics of the track's curvature profile (see offline_sim.cpp).
+ */
+#define NUM_HARMONICS 4
+extern const double CURVATURE_AMPLITUDES[NUM_HARMONICS];
+extern const double CURVATURE_PHASES[NUM_HARMONICS];
+
+
+/*
+ * Configuration of the offline vehicle and track model.
+ */
+struct SimParams {
+  double dt;              // control period [s]
+  unsigned int substeps;  // integration steps per control period
+  double wheelbase;       // [m]
+  double max_angle;       // steering angle at |steer| = 1 [deg]
+  double accel_gain;      // acceleration at full throttle [m/s^2]
+  double drag;            // linear speed damping [1/s]
+  double lap_length;      // length of the (periodic) track [m]
+  double road_halfwidth;  // |cte| beyond which the car leaves the road [m]
+  double cte_noise;       // standard deviation of cte measurement noise [m]
+  double initial_cte;     // [m]
+  double initial_speed;   // [mph]
+  double target_speed;    // speed set point [mph]
+  unsigned int delay;     // control periods between a command and its effect, at most MAX_DELAY
+
+  SimParams();
+};
+
+
+/*
+ * Everything an OfflineSimulator's future depends on besides its SimParams,
+ * including the noise generator and the commands still in flight, as plain
+ * data that can be copied with memcpy.
+ */
+struct SimState {
+  double s;
+  double cte;
+  double epsi;
+  double v;
+  double angle;
+  unsigned long steps;
+  bool crashed;
+  double pending_steer[MAX_DELAY + 1];
+  double pending_throttle[MAX_DELAY + 1];
+  std::mt19937 rng;
+  std::normal_distribution<double> noise;
+};
+
+
+/*
+ * A kinematic bicycle model driving along a closed road in the road's
+ * (Frenet) frame. This is a stand-in for the Unity simulator:
+ * cheap enough to run thousands of evaluations where the real thing
+ * runs one.
+ */
+class OfflineSimulator {
+
+private:
+  SimParams params;
+  std::mt19937 rng;
+  std::normal_distribution<double> noise;
+  unsigned int seed;
+
+  // Commands not yet applied, indexed by the step they were given at modulo delay + 1.
+  double pending_steer[MAX_DELAY + 1];
+  double pending_throttle[MAX_DELAY + 1];
+
+public:
+  /*
+   * State
+   */
+  double s;           // arc length along the centerline [m]
+  double cte;         // lateral offset from the centerline [m]
+  double epsi;        // heading relative to the centerline [rad]
+  double v;           // speed [m/s]
+  double angle;       // last applied steering angle [deg]
+  unsigned long steps;
+  bool crashed;
+
+  OfflineSimulator(SimParams params=SimParams(), unsigned int seed=0);
+
+  void reset();
+  double curvature(double s) const;
+  void step(double steer, double throttle);
+  double measured_cte();
+  double speed_mph() const;
+  unsigned int laps() const;
+  const SimParams& get_params() const;
+  SimState save() const;
+  void restore(const SimState& state);
+};
+
+
+/*
+ * Drive the simulator with a steering and a throttle PID,
+ * the same way twiddle_main drives the Unity simulator.
+ */
+std::vector<double> simulate_cte(OfflineSimulator& sim, PID& pid_steering, PID& pid_throttle, unsigned int nsamples);
+
+/*
+ * Score a parameter vector ({Kp, Ki, Kd} for steering, optionally followed by
+ * the throttle coefficients) with the Twiddle objective on a fresh simulator.
+ */
+double evaluate_offline(const std::vector<double>& params, unsigned int nsamples, unsigned int ndiscard,
+                        SimParams sim_params=SimParams(), unsigned int seed=0);
+
+#endif /* OFFLINE_SIM_H */
@@ -0,0 +1,99 @@
+#include "offtrack.h"
+#include <cmath>
+#include <cstring>    // strcmp
+#include <cstdlib>    // atof
+
+using namespace std;
+
+
+const char* offtrack_name(offtrack_t reason) {
+    switch(reason) {
+        case OFFTRACK_NONE:        return "none";
+        case OFFTRACK_CTE:         return "cte";
+        case OFFTRACK_STALL:       return "stall";
+        case OFFTRACK_OSCILLATION: return "oscillation";
+    }
+    return "unknown";
+}
+
+
+OffTrackDetector::OffTrackDetector(const OffTrackOptions& options) : options(options) {
+    clear();
+}
+
+
+/*
+ * @brief       Forget the run so far, e.g. after a reset or a change of gains.
+ */
+void OffTrackDetector::clear() {
+    samples = 0;
+    slow_samples = 0;
+    sign = 0;
+    swing = 0;
+    last_swing = 0;
+    growing = 0;
+}
+
+
+/*
+ * @brief       Check one telemetry sample.
+ * @param[in]   cte         Cross-track error [m]
+ * @param[in]   speed       [mph]
+ * @return      Why the run should stop now, or OFFTRACK_NONE.
+ */
+offtrack_t OffTrackDetector::update(double cte, double speed) {
+    samples++;
+
+    if(fabs(cte) > options.max_cte)
+        return OFFTRACK_CTE;
+
+    slow_samples = speed < options.min_speed ? slow_samples + 1 : 0;
+    if(samples > options.grace_samples && slow_samples >= options.stall_samples)
+        return OFFTRACK_STALL;
+
+    // At each crossing of the centerline, compare the swing just ended with the one before.
+    int s = cte > 0 ? 1 : (cte < 0 ? -1 : sign);
+    if(s != sign && sign != 0) {
+        if(swing >= options.min_swing && swing >= options.growth * last_swing) {
+            growing++;
+        } else {
+            growing = 0;
+        }
+        last_swing = swing;
+        swing = 0;
+        if(growing >= options.growing_swings)
+            return OFFTRACK_OSCILLATION;
+    }
+    sign = s;
+    swing = fmax(swing, fabs(cte));
+    return OFFTRACK_NONE;
+}
+
+
+OffTrackDetector* parse_offtrack_detector(int argc, char* argv[]) {
+    bool enabled = false;
+    OffTrackOptions options;
+    options.max_cte = 3.0;
+    options.min_speed = 5.0;
+    options.stall_samples = 40;
+    options.grace_samples = 200;
+    options.growth = 1.3;
+    options.growing_swings = 3;
+    options.min_swing = 0.3;
+
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--offtrack") == 0) {
+            enabled = true;
+        } else if(strcmp(argv[i], "--offtrack-cte") == 0 && has_value) {
+            options.max_cte = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--offtrack-speed") == 0 && has_value) {
+            options.min_speed = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--offtrack-growth") == 0 && has_value) {
+            options.growth = atof(argv[++i]);
+        }
+    }
+    if(!enabled)
+        return nullptr;
+    return new OffTrackDetector(options);
+}
@@ -0,0 +1,65 @@
+#ifndef OFFTRACK_H
+#define OFFTRACK_H
+
+
+/*
+ * Why a run was stopped early.
+ */
+enum offtrack_enum {
+  OFFTRACK_NONE,
+  OFFTRACK_CTE,           // |cte| past the threshold: off the road, or about to be
+  OFFTRACK_STALL,         // speed stayed low, e.g. stuck against a wall
+  OFFTRACK_OSCILLATION,   // swings about the centerline growing one after the other
+};
+typedef enum offtrack_enum offtrack_t;
+
+const char* offtrack_name(offtrack_t reason);
+
+
+/*
+ * Thresholds, in telemetry units.
+ */
+struct OffTrackOptions {
+  double max_cte;                 // [m]
+  double min_speed;               // [mph]
+  unsigned int stall_samples;     // samples below min_speed to call a stall
+  unsigned int grace_samples;     // samples after clear() before stalls count, to get up to speed
+  double growth;                  // each swing at least this many times the previous one...
+  unsigned int growing_swings;    // ...this many times in a row
+  double min_swing;               // swings smaller than this [m] never count
+};
+
+
+/*
+ * Watches telemetry for a probe that has lost the car, so it can be scored
+ * as failed right away instead of after a full window of huge errors.
+ *
+ * A swing is the largest |cte| between two sign changes; an oscillation
+ * growing_swings swings long, each growth times larger than the last, is
+ * called unstable before the car actually leaves the road.
+ */
+class OffTrackDetector {
+
+private:
+  OffTrackOptions options;
+  unsigned long samples;
+  unsigned int slow_samples;
+  int sign;
+  double swing;
+  double last_swing;
+  unsigned int growing;
+
+public:
+  OffTrackDetector(const OffTrackOptions& options);
+  offtrack_t update(double cte, double speed);
+  void clear();
+};
+
+
+/*
+ * Build a detector from --offtrack on the command line, with --offtrack-cte M,
+ * --offtrack-speed MPH and --offtrack-growth G overriding the defaults; nullptr without --offtrack.
+ */
+OffTrackDetector* parse_offtrack_detector(int argc, char* argv[]);
+
+#endif /* OFFTRACK_H */
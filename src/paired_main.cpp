@@ -0,0 +1,106 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstring>    // strcmp
+#include <cstdlib>    // atoi, atof
+
+#include "snapshot.h"
+#include "offline_sim.h"
+#include "pool.h"
+#include "twiddle.h"
+#include "say_time.h"
+
+// Set parameters.
+#define TRIALS 200
+#define STEP 0.1
+#define WARMUP_MAX 2000
+#define TRUTH_SAMPLES 6400
+#define NDISCARD 32
+
+/*
+ * How many samples does a Twiddle decision need? Compare a +dp and a -dp probe
+ * of one steering gain the way twiddle does, one window after the other on the
+ * road ahead, and forked from the same snapshot of the car, and count how often
+ * each picks the probe a long evaluation from the start line prefers.
+ *
+ *   ./paired [--trials N] [--step X] [--noise SIGMA] [--threads N]
+ *
+ * Each trial drives a random distance with the current gains, then probes a random
+ * gain by +-X (relative, 0.1 by default). Trials run in parallel.
+ */
+int main(int argc, char* argv[]) {
+
+    unsigned int trials = TRIALS;
+    double step = STEP;
+    unsigned int threads = 0;
+    SimParams sim_params;
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--trials") == 0 && has_value) {
+            trials = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--step") == 0 && has_value) {
+            step = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--noise") == 0 && has_value) {
+            sim_params.cte_noise = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--threads") == 0 && has_value) {
+            threads = atoi(argv[++i]);
+        }
+    }
+
+    // pid_steering.Init in main.cpp.
+    std::vector<double> center = {0.174668, 0.000780556, 1.6099};
+    std::vector<unsigned int> windows = {50, 100, 200, 400, 800, 1600};
+
+    // Per trial and window, whether each way agreed with the long evaluation.
+    std::vector<std::vector<bool> > sequential_right(trials), forked_right(trials);
+
+    WorkStealingPool pool(threads);
+    for(unsigned int k=0; k<trials; k++) {
+        pool.submit([&, k]() {
+            std::mt19937 rng(k);
+            unsigned int param = std::uniform_int_distribution<unsigned int>(0, 2)(rng);
+            unsigned int warmup = std::uniform_int_distribution<unsigned int>(0, WARMUP_MAX)(rng);
+            std::vector<double> plus = center, minus = center;
+            plus[param] *= 1 + step;
+            minus[param] *= 1 - step;
+
+            bool truth = evaluate_offline(plus, TRUTH_SAMPLES, NDISCARD, sim_params, k)
+                         < evaluate_offline(minus, TRUTH_SAMPLES, NDISCARD, sim_params, k);
+
+            // Where twiddle would be when it starts the probes.
+            OfflineSimulator sim(sim_params, k);
+            PID pid_steering, pid_throttle;
+            pid_steering.Init(center[0], center[1], center[2]);
+            pid_throttle.Init(0.3, 0, 0.02);
+            simulate_cte(sim, pid_steering, pid_throttle, warmup);
+            LoopSnapshot start = take_snapshot(sim, pid_steering, pid_throttle);
+
+            for(auto w : windows) {
+                bool forked = evaluate_from(start, plus, w, sim_params) < evaluate_from(start, minus, w, sim_params);
+                forked_right[k].push_back(forked == truth);
+
+                restore_snapshot(start, sim, pid_steering, pid_throttle);
+                pid_steering.Init(plus[0], plus[1], plus[2]);
+                double first = twiddle_objective(simulate_cte(sim, pid_steering, pid_throttle, w));
+                pid_steering.Init(minus[0], minus[1], minus[2]);
+                double second = twiddle_objective(simulate_cte(sim, pid_steering, pid_throttle, w));
+                sequential_right[k].push_back((first < second) == truth);
+            }
+        });
+    }
+    pool.wait();
+
+    say_time(); std::cout << "Decisions agreeing with " << TRUTH_SAMPLES << "-sample evaluations, over "
+                          << trials << " trials:" << std::endl;
+    say_time(); std::cout << "  window   sequential   forked" << std::endl;
+    for(unsigned int j=0; j<windows.size(); j++) {
+        unsigned int sequential = 0, forked = 0;
+        for(unsigned int k=0; k<trials; k++) {
+            sequential += sequential_right[k][j];
+            forked += forked_right[k][j];
+        }
+        say_time(); std::cout << "  " << windows[j] << "\t   " << 100.0 * sequential / trials << "%\t\t"
+                              << 100.0 * forked / trials << "%" << std::endl;
+    }
+    return 0;
+}
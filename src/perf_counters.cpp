@@ -0,0 +1,165 @@
+#include "perf_counters.h"
+#include "say_time.h"
+#include <iostream>
+#include <cstring>    // memset, strcmp
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+
+#ifdef __linux__
+
+static const uint64_t EVENT_CONFIGS[NUM_PERF_EVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+
+/*
+ * @brief       Open one hardware counter on the calling thread, any CPU.
+ */
+static int open_event(uint64_t config, int group_fd, bool exclude_kernel) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group_fd == -1;  // the leader starts the group
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+#endif
+
+
+/*
+ * @brief       Open and start the counters, with kernel-mode counts if permitted.
+ */
+PerfCounters::PerfCounters() {
+    open = false;
+    user_only = false;
+    for(auto& fd : fds) {
+        fd = -1;
+    }
+
+#ifdef __linux__
+    for(int attempt=0; attempt<2 && !open; attempt++) {
+        user_only = attempt == 1;
+        fds[0] = open_event(EVENT_CONFIGS[0], -1, user_only);
+        if(fds[0] < 0)
+            continue;
+        open = true;
+        for(unsigned int i=1; i<NUM_PERF_EVENTS; i++) {
+            fds[i] = open_event(EVENT_CONFIGS[i], fds[0], user_only);
+            if(fds[i] < 0)
+                open = false;
+        }
+        if(!open) {
+            for(auto& fd : fds) {
+                if(fd >= 0)
+                    close(fd);
+                fd = -1;
+            }
+        }
+    }
+    if(open) {
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        say_time(); cout << "Counting cycles, instructions, cache misses and branch misses";
+        cout << (user_only ? " (user mode only; see perf_event_paranoid)" : "") << "." << endl;
+    }
+#endif
+
+    if(!open) {
+        say_time(); cout << "Hardware performance counters are not available." << endl;
+    }
+}
+
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for(auto fd : fds) {
+        if(fd >= 0)
+            close(fd);
+    }
+#endif
+}
+
+
+/*
+ * @brief       Whether the counters were opened.
+ */
+bool PerfCounters::is_open() {
+    return open;
+}
+
+
+/*
+ * @brief       Read the running totals, scaled up if the group was multiplexed.
+ * @param[out]  values      One total per metric_perf_event_t
+ * @return      Whether the read succeeded.
+ */
+bool PerfCounters::read(uint64_t values[NUM_PERF_EVENTS]) {
+#ifdef __linux__
+    if(!open)
+        return false;
+    // nr, time_enabled, time_running, then one value per event.
+    uint64_t buffer[3 + NUM_PERF_EVENTS];
+    if(::read(fds[0], buffer, sizeof(buffer)) != (ssize_t) sizeof(buffer) || buffer[0] != NUM_PERF_EVENTS)
+        return false;
+    double scale = buffer[2] > 0 ? (double) buffer[1] / buffer[2] : 1;
+    for(unsigned int i=0; i<NUM_PERF_EVENTS; i++) {
+        values[i] = (uint64_t) (buffer[3 + i] * scale);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+
+PerfScope::PerfScope(PerfCounters* counters, metric_stage_t stage) {
+    this->counters = counters;
+    this->stage = stage;
+    if(counters && !counters->read(start))
+        this->counters = nullptr;
+}
+
+
+PerfScope::~PerfScope() {
+    uint64_t end[NUM_PERF_EVENTS];
+    if(!counters || !counters->read(end))
+        return;
+    for(unsigned int i=0; i<NUM_PERF_EVENTS; i++) {
+        end[i] = end[i] > start[i] ? end[i] - start[i] : 0;
+    }
+    metrics_count_perf(stage, end);
+}
+
+
+/*
+ * @brief       Open the counters if asked to with --perf.
+ */
+PerfCounters* parse_perf_counters(int argc, char* argv[]) {
+    for(int i=1; i<argc; i++) {
+        if(strcmp(argv[i], "--perf") == 0) {
+            PerfCounters* counters = new PerfCounters();
+            if(counters->is_open())
+                return counters;
+            delete counters;
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,54 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include "metrics.h"
+
+/*
+ * Hardware performance counters for the calling thread, via Linux perf_event_open.
+ *
+ * Cycles, instructions, cache misses and branch misses are opened as one group,
+ * so they are scheduled (and multiplexed) together and read with one syscall.
+ * Kernel-mode counts are included when perf_event_paranoid allows it, so
+ * syscall-heavy stages show up as cycles without matching user instructions.
+ * On other systems, or without permission, is_open() is false and reads fail.
+ */
+class PerfCounters {
+
+private:
+  int fds[NUM_PERF_EVENTS];
+  bool open;
+  bool user_only;
+
+public:
+  PerfCounters();
+  ~PerfCounters();
+  bool is_open();
+  bool read(uint64_t values[NUM_PERF_EVENTS]);
+};
+
+
+/*
+ * Adds the counter deltas over its lifetime to a stage's totals in the metrics.
+ * Does nothing when given nullptr, so call sites need no branches.
+ * Each read is a syscall (about a microsecond), which the stage's latency includes.
+ */
+class PerfScope {
+
+private:
+  PerfCounters* counters;
+  metric_stage_t stage;
+  uint64_t start[NUM_PERF_EVENTS];
+
+public:
+  PerfScope(PerfCounters* counters, metric_stage_t stage);
+  ~PerfScope();
+};
+
+
+/*
+ * Open the counters if --perf is on the command line; nullptr if not given or unavailable.
+ */
+PerfCounters* parse_perf_counters(int argc, char* argv[]);
+
+#endif /* PERF_COUNTERS_H */
@@ -0,0 +1,512 @@
+#include "pidlog.h"
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <cstring>    // memchr, memcpy, strlen
+#include <cstdlib>    // strtod
+#include <cstdint>
+#include <utility>    // move
+#include <algorithm>  // min, search
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// Powers of ten that are exact in a double.
+static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Digits kept in the mantissa (19 always fit in 64 bits).
+static const int MAX_MANTISSA_DIGITS = 19;
+
+
+/*****************************************************************
+ ***************** Memory-mapped input. **************************
+ *****************************************************************/
+
+
+MappedFile::MappedFile() {
+    mapped = nullptr;
+    length = 0;
+}
+
+
+MappedFile::~MappedFile() {
+    if(mapped)
+        munmap((void*) mapped, length);
+}
+
+
+/*
+ * @brief       Map a file for reading.
+ * @return      Whether the file could be opened and mapped.
+ */
+bool MappedFile::open(const string& fname) {
+    int fd = ::open(fname.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    length = st.st_size;
+    if(length > 0) {
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p == MAP_FAILED) {
+            close(fd);
+            length = 0;
+            return false;
+        }
+        madvise(p, length, MADV_SEQUENTIAL);
+        mapped = (const char*) p;
+    }
+    close(fd);
+    return true;
+}
+
+
+const char* MappedFile::data() const {
+    return mapped;
+}
+
+
+size_t MappedFile::size() const {
+    return length;
+}
+
+
+/*
+ * @brief       Cut a buffer into line-aligned ranges for parallel parsing.
+ */
+vector<size_t> split_lines(const char* data, size_t size, unsigned int n) {
+    vector<size_t> offsets = {0};
+    for(unsigned int i=1; i<n; i++) {
+        size_t pos = max(offsets.back(), size / n * i);
+        const char* nl = pos < size ? (const char*) memchr(data + pos, '\n', size - pos) : nullptr;
+        pos = nl ? nl - data + 1 : size;
+        if(pos > offsets.back() && pos < size)
+            offsets.push_back(pos);
+    }
+    offsets.push_back(size);
+    return offsets;
+}
+
+
+/*
+ * @brief       Call f(begin, end) for each line in [begin, end), without the newline.
+ */
+template <typename F>
+static void for_each_line(const char* begin, const char* end, F f) {
+    while(begin < end) {
+        const char* nl = (const char*) memchr(begin, '\n', end - begin);
+        const char* eol = nl ? nl : end;
+        f(begin, eol);
+        begin = eol + 1;
+    }
+}
+
+
+/*
+ * @brief       Run f(i, begin, end) for each line-aligned range of a buffer, one thread per range.
+ * @return      The number of ranges.
+ */
+template <typename F>
+static size_t parallel_ranges(const char* data, size_t size, unsigned int nthreads, F f) {
+    vector<size_t> offsets = split_lines(data, size, max(1u, nthreads));
+    size_t nranges = offsets.size() - 1;
+    vector<thread> threads;
+    for(size_t i=0; i<nranges; i++) {
+        threads.emplace_back(f, i, data + offsets[i], data + offsets[i + 1]);
+    }
+    for(auto& th : threads) {
+        th.join();
+    }
+    return nranges;
+}
+
+
+
+/*****************************************************************
+ ***************** Number parsing. *******************************
+ *****************************************************************/
+
+
+/*
+ * @brief       Parse a double, exactly when possible without strtod.
+ */
+bool parse_double(const char*& p, const char* end, double& x) {
+    const char* s = p;
+    while(s < end && (*s == ' ' || *s == '\t'))
+        s++;
+    const char* start = s;
+
+    bool negative = false;
+    if(s < end && (*s == '-' || *s == '+')) {
+        negative = *s == '-';
+        s++;
+    }
+
+    uint64_t mantissa = 0;
+    int ndigits = 0, exponent = 0;
+    bool any = false, dropped = false;
+    for(; s < end && *s >= '0' && *s <= '9'; s++) {
+        any = true;
+        if(ndigits < MAX_MANTISSA_DIGITS) {
+            mantissa = mantissa * 10 + (*s - '0');
+            if(mantissa)
+                ndigits++;
+        } else {
+            exponent++;
+            dropped |= *s != '0';
+        }
+    }
+    if(s < end && *s == '.') {
+        s++;
+        for(; s < end && *s >= '0' && *s <= '9'; s++) {
+            any = true;
+            if(ndigits < MAX_MANTISSA_DIGITS) {
+                mantissa = mantissa * 10 + (*s - '0');
+                if(mantissa)
+                    ndigits++;
+                exponent--;
+            } else {
+                dropped |= *s != '0';
+            }
+        }
+    }
+
+    if(any && s < end && (*s == 'e' || *s == 'E')) {
+        const char* e = s + 1;
+        bool negative_exponent = false;
+        if(e < end && (*e == '-' || *e == '+')) {
+            negative_exponent = *e == '-';
+            e++;
+        }
+        if(e < end && *e >= '0' && *e <= '9') {
+            int value = 0;
+            for(; e < end && *e >= '0' && *e <= '9'; e++) {
+                value = min(value * 10 + (*e - '0'), 100000);
+            }
+            exponent += negative_exponent ? -value : value;
+            s = e;
+        }
+    }
+
+    if(any && !dropped && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        x = exponent < 0 ? mantissa / POW10[-exponent] : mantissa * POW10[exponent];
+        if(negative)
+            x = -x;
+        p = s;
+        return true;
+    }
+
+    // Long mantissas, large exponents, inf and nan: hand a terminated copy to strtod.
+    size_t len = any ? s - start : min((size_t) (end - start), (size_t) 63);
+    string copy(start, len);
+    char* stop;
+    x = strtod(copy.c_str(), &stop);
+    if(stop == copy.c_str())
+        return false;
+    p = start + (stop - copy.c_str());
+    return true;
+}
+
+
+/*
+ * @brief       Parse a decimal integer.
+ */
+bool parse_long(const char*& p, const char* end, long& x) {
+    const char* s = p;
+    while(s < end && (*s == ' ' || *s == '\t'))
+        s++;
+    bool negative = false;
+    if(s < end && (*s == '-' || *s == '+')) {
+        negative = *s == '-';
+        s++;
+    }
+    if(s == end || *s < '0' || *s > '9')
+        return false;
+    long value = 0;
+    for(; s < end && *s >= '0' && *s <= '9'; s++) {
+        value = value * 10 + (*s - '0');
+    }
+    x = negative ? -value : value;
+    p = s;
+    return true;
+}
+
+
+
+/*****************************************************************
+ ***************** Telemetry (cte.csv). **************************
+ *****************************************************************/
+
+
+/*
+ * @brief       Parse the values of one cte.csv line.
+ */
+bool parse_telemetry_fields(const char* begin, const char* end, long& t, double fields[6]) {
+    const char* p = begin;
+    if(!parse_long(p, end, t))
+        return false;
+
+    unsigned int nfields = 0;
+    while(nfields < 6 && p < end && *p == ',') {
+        p++;
+        if(!parse_double(p, end, fields[nfields]))
+            break;
+        nfields++;
+    }
+    if(nfields < 5)
+        return false;
+    if(nfields == 5)
+        fields[5] = numeric_limits<double>::quiet_NaN();
+    return true;
+}
+
+
+/*
+ * @brief       Parse one cte.csv line onto the end of a log.
+ */
+bool parse_telemetry_line(const char* begin, const char* end, TelemetryLog& log) {
+    long t;
+    double fields[6];
+    if(!parse_telemetry_fields(begin, end, t, fields))
+        return false;
+
+    log.t.push_back(t);
+    log.cte.push_back(fields[0]);
+    log.speed.push_back(fields[1]);
+    log.angle.push_back(fields[2]);
+    log.steer.push_back(fields[3]);
+    log.throttle.push_back(fields[4]);
+    log.i_error.push_back(fields[5]);
+    return true;
+}
+
+
+/*
+ * @brief       Append all columns of one log to another.
+ */
+static void append_telemetry(TelemetryLog& log, const TelemetryLog& part) {
+    log.t.insert(log.t.end(), part.t.begin(), part.t.end());
+    log.cte.insert(log.cte.end(), part.cte.begin(), part.cte.end());
+    log.speed.insert(log.speed.end(), part.speed.begin(), part.speed.end());
+    log.angle.insert(log.angle.end(), part.angle.begin(), part.angle.end());
+    log.steer.insert(log.steer.end(), part.steer.begin(), part.steer.end());
+    log.throttle.insert(log.throttle.end(), part.throttle.begin(), part.throttle.end());
+    log.i_error.insert(log.i_error.end(), part.i_error.begin(), part.i_error.end());
+}
+
+
+/*
+ * @brief       Parse a cte.csv buffer, one thread per line-aligned chunk.
+ */
+void parse_telemetry(const char* data, size_t size, TelemetryLog& log, unsigned int nthreads, long discard_ms) {
+    // The first parseable line fixes t0 for the discard.
+    TelemetryLog first;
+    const char* line = data;
+    while(line < data + size && !parse_telemetry_line(line, data + size, first)) {
+        const char* nl = (const char*) memchr(line, '\n', data + size - line);
+        line = nl ? nl + 1 : data + size;
+    }
+    if(first.t.empty())
+        return;
+    long t0 = first.t[0];
+
+    vector<TelemetryLog> parts(max(1u, nthreads));
+    size_t nranges = parallel_ranges(data, size, nthreads, [&parts, t0, discard_ms](size_t i, const char* begin, const char* end) {
+        TelemetryLog& part = parts[i];
+        // About 60 bytes per line.
+        size_t estimate = (end - begin) / 60 + 1;
+        part.t.reserve(estimate);
+        part.cte.reserve(estimate);
+        part.speed.reserve(estimate);
+        part.angle.reserve(estimate);
+        part.steer.reserve(estimate);
+        part.throttle.reserve(estimate);
+        part.i_error.reserve(estimate);
+        for_each_line(begin, end, [&part, t0, discard_ms](const char* b, const char* e) {
+            if(parse_telemetry_line(b, e, part) && part.t.back() - t0 < discard_ms) {
+                part.t.pop_back();
+                part.cte.pop_back();
+                part.speed.pop_back();
+                part.angle.pop_back();
+                part.steer.pop_back();
+                part.throttle.pop_back();
+                part.i_error.pop_back();
+            }
+        });
+    });
+
+    for(size_t i=0; i<nranges; i++) {
+        if(log.t.empty()) {
+            log = move(parts[i]);
+        } else {
+            append_telemetry(log, parts[i]);
+        }
+    }
+}
+
+
+
+/*****************************************************************
+ ***************** Twiddle stdout log. ***************************
+ *****************************************************************/
+
+
+static bool contains(const char* begin, const char* end, const char* needle) {
+    const char* needle_end = needle + strlen(needle);
+    return search(begin, end, needle, needle_end) != end;
+}
+
+
+/*
+ * @brief       Parse the "[a, b, c, ]" list after the first '['.
+ */
+static bool parse_list(const char* begin, const char* end, TuneEvent& event) {
+    const char* p = (const char*) memchr(begin, '[', end - begin);
+    if(!p)
+        return false;
+    p++;
+    event.n = 0;
+    double x;
+    while(parse_double(p, end, x)) {
+        if(event.n < MAX_EVENT_VALUES)
+            event.values[event.n] = x;
+        event.n++;
+        while(p < end && (*p == ' ' || *p == ','))
+            p++;
+    }
+    return true;
+}
+
+
+/*
+ * @brief       Parse the number after the last '='.
+ */
+static bool parse_assignment(const char* begin, const char* end, TuneEvent& event) {
+    const char* eq = end;
+    while(eq > begin && *(eq - 1) != '=')
+        eq--;
+    if(eq == begin)
+        return false;
+    event.n = 1;
+    return parse_double(eq, end, event.values[0]);
+}
+
+
+/*
+ * @brief       Classify and parse a twiddle log line the way bin/plot.py does.
+ */
+bool parse_tune_line(const char* begin, const char* end, TuneEvent& event) {
+    const char* bar = (const char*) memchr(begin, '|', end - begin);
+    if(!bar)
+        return false;
+    const char* p = begin;
+    if(!parse_long(p, bar, event.t))
+        return false;
+    const char* text = bar + 1;
+
+    event.n = 0;
+    if(contains(text, end, "succeed")) {
+        event.kind = EVENT_SUCCESS;
+        return true;
+    } else if(contains(text, end, "dp =")) {
+        event.kind = EVENT_DIFF_PARAMS;
+        return parse_list(text, end, event);
+    } else if(contains(text, end, "p =")) {
+        event.kind = EVENT_PARAMS;
+        return parse_list(text, end, event);
+    } else if(contains(text, end, ">Mean absolute error")) {
+        event.kind = EVENT_MAE;
+        return parse_assignment(text, end, event);
+    } else if(contains(text, end, ">Stdd error")) {
+        event.kind = EVENT_STDD;
+        return parse_assignment(text, end, event);
+    } else if(contains(text, end, "objective = ")) {
+        event.kind = EVENT_OBJECTIVE;
+        return parse_assignment(text, end, event);
+    } else if(contains(text, end, "Twiddle iteration")) {
+        event.kind = EVENT_ITERATION;
+        return true;
+    }
+    return false;
+}
+
+
+TuneLog::TuneLog(unsigned int nparam) {
+    this->nparam = nparam;
+}
+
+
+/*
+ * @brief       Extend the series with one event; events must come in log order.
+ */
+void TuneLog::apply(const TuneEvent& event) {
+    switch(event.kind) {
+    case EVENT_SUCCESS:
+        // The parameters that just succeeded are the last ones tried.
+        if(!params_t.empty()) {
+            accepted_t.push_back(params_t.back());
+            accepted.insert(accepted.end(), params.end() - nparam, params.end());
+        }
+        success_t.push_back(event.t);
+        break;
+    case EVENT_DIFF_PARAMS:
+        if(event.n == nparam) {
+            diff_params_t.push_back(event.t);
+            diff_params.insert(diff_params.end(), event.values, event.values + nparam);
+        }
+        break;
+    case EVENT_PARAMS:
+        modification_t.push_back(event.t);
+        if(event.n == nparam) {
+            params_t.push_back(event.t);
+            params.insert(params.end(), event.values, event.values + nparam);
+        }
+        break;
+    case EVENT_MAE:
+        mae_t.push_back(event.t);
+        mae.push_back(event.values[0]);
+        break;
+    case EVENT_STDD:
+        stdd_t.push_back(event.t);
+        stdd.push_back(event.values[0]);
+        break;
+    case EVENT_OBJECTIVE:
+        objective_t.push_back(event.t);
+        objective.push_back(event.values[0]);
+        break;
+    case EVENT_ITERATION:
+        iteration_t.push_back(event.t);
+        break;
+    }
+}
+
+
+/*
+ * @brief       Parse a twiddle log buffer: classify lines in parallel, then apply them in order.
+ */
+void parse_tune_log(const char* data, size_t size, TuneLog& log, unsigned int nthreads) {
+    vector<vector<TuneEvent>> parts(max(1u, nthreads));
+    size_t nranges = parallel_ranges(data, size, nthreads, [&parts](size_t i, const char* begin, const char* end) {
+        vector<TuneEvent>& events = parts[i];
+        TuneEvent event;
+        for_each_line(begin, end, [&events, &event](const char* b, const char* e) {
+            if(parse_tune_line(b, e, event))
+                events.push_back(event);
+        });
+    });
+
+    for(size_t i=0; i<nranges; i++) {
+        for(auto& event : parts[i]) {
+            log.apply(event);
+        }
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef PIDLOG_H
+#define PIDLOG_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include "sysid.h"
+
+/*
+ * A read-only memory map of a whole file (empty files map to nothing).
+ */
+class MappedFile {
+
+private:
+  const char* mapped;
+  size_t length;
+
+public:
+  MappedFile();
+  ~MappedFile();
+  bool open(const std::string& fname);
+  const char* data() const;
+  size_t size() const;
+};
+
+
+/*
+ * Split a buffer into at most n consecutive ranges that each end just after a newline
+ * (or at the end of the buffer), so each range can be parsed line by line on its own.
+ * Returns n + 1 offsets or fewer; range i is [offsets[i], offsets[i + 1]).
+ */
+std::vector<size_t> split_lines(const char* data, size_t size, unsigned int n);
+
+
+/*
+ * Parse a decimal number at p, not reading past end, and advance p past it.
+ * Most values take an exact fast path (an integer mantissa below 2^53 times or over
+ * a power of ten up to 1e22); anything else falls back to strtod on a bounded copy,
+ * so results are always correctly rounded. Leading spaces are skipped.
+ */
+bool parse_double(const char*& p, const char* end, double& x);
+bool parse_long(const char*& p, const char* end, long& x);
+
+
+/*
+ * Parse one "t, cte, speed, angle, steer, throttle, i_error" line of cte.csv, into
+ * the time and the six fields or appended to a log. Lines without at least the
+ * first six values are rejected; a missing i_error is NaN.
+ */
+bool parse_telemetry_fields(const char* begin, const char* end, long& t, double fields[6]);
+bool parse_telemetry_line(const char* begin, const char* end, TelemetryLog& log);
+
+/*
+ * Parse a whole cte.csv buffer on several threads, keeping lines at or after t0 + discard_ms,
+ * where t0 is the time of the first line.
+ */
+void parse_telemetry(const char* data, size_t size, TelemetryLog& log, unsigned int nthreads, long discard_ms=0);
+
+
+/*
+ * The lines of twiddle's stdout log that bin/plot.py reads.
+ */
+enum tune_event_enum {
+  EVENT_PARAMS,         // "p = [...]"
+  EVENT_DIFF_PARAMS,    // "dp = [...]"
+  EVENT_SUCCESS,        // "...succeeded!"
+  EVENT_MAE,            // ">Mean absolute error = x"
+  EVENT_STDD,           // ">Stdd error = x"
+  EVENT_OBJECTIVE,      // "==> objective = x"
+  EVENT_ITERATION,      // "=====Twiddle iteration n====="
+};
+typedef enum tune_event_enum tune_event_t;
+
+#define MAX_EVENT_VALUES 16
+
+struct TuneEvent {
+  long t;
+  tune_event_t kind;
+  unsigned int n;  // how many values the line had (only the first MAX_EVENT_VALUES are kept)
+  double values[MAX_EVENT_VALUES];
+};
+
+/*
+ * Parse one "time | message" line; false for lines without a timestamp or of no interest.
+ */
+bool parse_tune_line(const char* begin, const char* end, TuneEvent& event);
+
+
+/*
+ * The series bin/plot.py derives from a twiddle log. Parameter vectors are
+ * stored flat, nparam values per row; vectors of another length are not kept
+ * (but a "p = " line still counts as a parameter modification).
+ */
+struct TuneLog {
+  unsigned int nparam;
+
+  std::vector<long> params_t;
+  std::vector<double> params;
+  std::vector<long> accepted_t;
+  std::vector<double> accepted;
+  std::vector<long> diff_params_t;
+  std::vector<double> diff_params;
+
+  std::vector<long> mae_t, stdd_t, objective_t;
+  std::vector<double> mae, stdd, objective;
+
+  std::vector<long> iteration_t;
+  std::vector<long> modification_t;
+  std::vector<long> success_t;
+
+  TuneLog(unsigned int nparam=3);
+  void apply(const TuneEvent& event);
+};
+
+/*
+ * Parse a whole twiddle log buffer; lines are parsed on several threads and applied in order.
+ */
+void parse_tune_log(const char* data, size_t size, TuneLog& log, unsigned int nthreads);
+
+#endif /* PIDLOG_H */
@@ -0,0 +1,221 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <cstdio>     // snprintf
+#include <cstring>    // strcmp
+#include <cstdlib>    // atoi, atol
+#include <cerrno>
+#include <algorithm>  // std::min, std::max
+#include <sys/stat.h> // mkdir
+
+#include "pidlog.h"
+#include "vector_utils.h"
+
+// Set parameters.
+#define NPARAM 3
+#define DISCARD_MS 6000
+
+using namespace std;
+
+
+/*
+ * @brief       Milliseconds since a steady_clock time point.
+ */
+static double ms_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+
+/*
+ * @brief       Write "t,<columns>" rows, ncols values per row (none for a list of times).
+ * @return      Whether the file could be written.
+ */
+static bool write_series(const string& fname, const string& header, const vector<long>& t,
+                         const vector<double>& values, unsigned int ncols) {
+    ofstream f(fname, ios::trunc);
+    if(!f.is_open())
+        return false;
+    f.precision(10);
+    f << header << "\n";
+    for(size_t i=0; i<t.size(); i++) {
+        f << t[i];
+        for(unsigned int j=0; j<ncols; j++) {
+            f << "," << values[i * ncols + j];
+        }
+        f << "\n";
+    }
+    return f.good();
+}
+
+
+/*
+ * @brief       Write the telemetry as CSV, rows formatted on several threads.
+ * Ten significant digits keep everything cte.csv wrote (six). Formatting costs
+ * a few hundred ns per value, so this is far slower than the binary output.
+ */
+static bool write_telemetry_csv(const string& fname, const TelemetryLog& log, unsigned int nthreads) {
+    ofstream f(fname, ios::trunc | ios::binary);
+    if(!f.is_open())
+        return false;
+    f << "t,cte,speed,angle,steer,throttle,i_error\n";
+
+    size_t n = log.t.size();
+    nthreads = max(1u, nthreads);
+    vector<string> parts(nthreads);
+    vector<thread> threads;
+    for(unsigned int k=0; k<nthreads; k++) {
+        threads.emplace_back([&log, &parts, n, nthreads, k]() {
+            size_t begin = n * k / nthreads, end = n * (k + 1) / nthreads;
+            string& out = parts[k];
+            out.reserve((end - begin) * 80);
+            char row[256];
+            for(size_t i=begin; i<end; i++) {
+                int len = snprintf(row, sizeof(row), "%ld,%.10g,%.10g,%.10g,%.10g,%.10g,%.10g\n", log.t[i],
+                                   log.cte[i], log.speed[i], log.angle[i], log.steer[i], log.throttle[i], log.i_error[i]);
+                out.append(row, len);
+            }
+        });
+    }
+    for(unsigned int k=0; k<nthreads; k++) {
+        threads[k].join();
+        f.write(parts[k].data(), parts[k].size());
+    }
+    return f.good();
+}
+
+
+/*
+ * @brief       Write the telemetry as rows of 7 little-endian float64s
+ *              (t [ms], cte, speed, angle, steer, throttle, i_error).
+ */
+static bool write_telemetry_binary(const string& fname, const TelemetryLog& log) {
+    ofstream f(fname, ios::trunc | ios::binary);
+    if(!f.is_open())
+        return false;
+    // Buffer a few thousand rows at a time.
+    const size_t ROWS = 4096;
+    vector<double> buffer;
+    buffer.reserve(ROWS * 7);
+    for(size_t i=0; i<log.t.size(); i++) {
+        const double row[7] = {(double) log.t[i], log.cte[i], log.speed[i], log.angle[i],
+                               log.steer[i], log.throttle[i], log.i_error[i]};
+        buffer.insert(buffer.end(), row, row + 7);
+        if(buffer.size() == ROWS * 7 || i + 1 == log.t.size()) {
+            f.write((const char*) buffer.data(), buffer.size() * sizeof(double));
+            buffer.clear();
+        }
+    }
+    return f.good();
+}
+
+
+/*
+ * Parse a twiddle stdout log and its cte.csv into the series bin/plot.py plots,
+ * and write them as small CSV files, and the telemetry as raw float64s (or CSV).
+ *
+ *   ./pidlog twiddle.out [cte.csv] [--out DIR] [--threads N] [--nparam N] [--discard-ms MS] [--csv]
+ */
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        cerr << "Usage: " << argv[0] << " twiddle.out [cte.csv] [--out DIR] [--threads N]"
+             << " [--nparam N] [--discard-ms MS] [--csv]" << endl;
+        return -1;
+    }
+
+    string tune_fname = argv[1];
+    string cte_fname;
+    string out_dir = "pidlog";
+    unsigned int nthreads = max(1u, thread::hardware_concurrency());
+    unsigned int nparam = NPARAM;
+    long discard_ms = DISCARD_MS;
+    bool csv = false;
+    for(int i=2; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--out") == 0 && has_value) {
+            out_dir = argv[++i];
+        } else if(strcmp(argv[i], "--threads") == 0 && has_value) {
+            nthreads = max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--nparam") == 0 && has_value) {
+            nparam = max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--discard-ms") == 0 && has_value) {
+            discard_ms = atol(argv[++i]);
+        } else if(strcmp(argv[i], "--csv") == 0) {
+            csv = true;
+        } else if(argv[i][0] != '-' && cte_fname.empty()) {
+            cte_fname = argv[i];
+        }
+    }
+
+    // Parse the twiddle log.
+    auto start = chrono::steady_clock::now();
+    MappedFile tune_file;
+    if(!tune_file.open(tune_fname)) {
+        cerr << "Failed to read " << tune_fname << endl;
+        return -1;
+    }
+    TuneLog tune(nparam);
+    parse_tune_log(tune_file.data(), tune_file.size(), tune, nthreads);
+    cout << "Parsed " << tune_file.size() << " bytes of " << tune_fname << " in " << ms_since(start) << " ms: ";
+    cout << tune.params_t.size() << " parameter vectors, " << tune.accepted_t.size() << " accepted, ";
+    cout << tune.objective.size() << " windows, " << tune.iteration_t.size() << " iterations." << endl;
+
+    // Parse the telemetry.
+    TelemetryLog telemetry;
+    if(!cte_fname.empty()) {
+        start = chrono::steady_clock::now();
+        MappedFile cte_file;
+        if(!cte_file.open(cte_fname)) {
+            cerr << "Failed to read " << cte_fname << endl;
+            return -1;
+        }
+        parse_telemetry(cte_file.data(), cte_file.size(), telemetry, nthreads, discard_ms);
+        double ms = ms_since(start);
+        cout << "Parsed " << cte_file.size() << " bytes of " << cte_fname << " in " << ms << " ms: ";
+        cout << telemetry.t.size() << " samples (" << cte_file.size() / max(ms, 1e-3) / 1e6 << " GB/s on ";
+        cout << nthreads << " threads)." << endl;
+    }
+
+    // Write the series.
+    start = chrono::steady_clock::now();
+    if(mkdir(out_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        cerr << "Failed to create " << out_dir << endl;
+        return -1;
+    }
+    string p_header = "t", dp_header = "t";
+    for(unsigned int j=0; j<nparam; j++) {
+        p_header += ",p" + to_string(j);
+        dp_header += ",dp" + to_string(j);
+    }
+    const vector<double> none;
+    bool ok = write_series(out_dir + "/params.csv", p_header, tune.params_t, tune.params, nparam)
+           && write_series(out_dir + "/accepted.csv", p_header, tune.accepted_t, tune.accepted, nparam)
+           && write_series(out_dir + "/dp.csv", dp_header, tune.diff_params_t, tune.diff_params, nparam)
+           && write_series(out_dir + "/mae.csv", "t,mae", tune.mae_t, tune.mae, 1)
+           && write_series(out_dir + "/stdd.csv", "t,stdd", tune.stdd_t, tune.stdd, 1)
+           && write_series(out_dir + "/objective.csv", "t,objective", tune.objective_t, tune.objective, 1)
+           && write_series(out_dir + "/iterations.csv", "t", tune.iteration_t, none, 0)
+           && write_series(out_dir + "/modifications.csv", "t", tune.modification_t, none, 0)
+           && write_series(out_dir + "/successes.csv", "t", tune.success_t, none, 0);
+    if(!cte_fname.empty()) {
+        if(csv) {
+            ok = ok && write_telemetry_csv(out_dir + "/telemetry.csv", telemetry, nthreads);
+        } else {
+            ok = ok && write_telemetry_binary(out_dir + "/telemetry.bin", telemetry);
+        }
+    }
+    if(!ok) {
+        cerr << "Failed to write to " << out_dir << endl;
+        return -1;
+    }
+    cout << "Wrote " << out_dir << "/ in " << ms_since(start) << " ms." << endl;
+
+    if(!tune.accepted_t.empty()) {
+        vector<double> last(tune.accepted.end() - nparam, tune.accepted.end());
+        vec_print(last, "accepted");
+    }
+    if(!tune.objective.empty()) {
+        cout << "Best objective = " << *min_element(tune.objective.begin(), tune.objective.end()) << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include "pool.h"
+#include <algorithm>  // max
+
+using namespace std;
+
+
+/*
+ * @brief       Start the threads.
+ * @param[in]   nthreads    Number of threads; 0 for one per hardware thread.
+ */
+WorkStealingPool::WorkStealingPool(unsigned int nthreads) {
+    if(nthreads == 0)
+        nthreads = max(1u, thread::hardware_concurrency());
+    next_queue = 0;
+    queued = 0;
+    unfinished = 0;
+    stopping = false;
+    for(unsigned int i=0; i<nthreads; i++) {
+        queues.emplace_back(new Queue());
+    }
+    for(unsigned int i=0; i<nthreads; i++) {
+        threads.emplace_back(&WorkStealingPool::run, this, i);
+    }
+}
+
+
+/*
+ * @brief       Finish the submitted tasks, then stop the threads.
+ */
+WorkStealingPool::~WorkStealingPool() {
+    wait();
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(auto& th : threads) {
+        th.join();
+    }
+}
+
+
+/*
+ * @brief       Queue a task to run on some thread.
+ */
+void WorkStealingPool::submit(function<void()> task) {
+    Queue& q = *queues[next_queue];
+    next_queue = (next_queue + 1) % queues.size();
+    {
+        lock_guard<std::mutex> lock(q.mutex);
+        q.tasks.push_back(task);
+    }
+    {
+        lock_guard<std::mutex> lock(mutex);
+        queued++;
+        unfinished++;
+    }
+    wake.notify_one();
+}
+
+
+/*
+ * @brief       Block until every task submitted so far has run.
+ */
+void WorkStealingPool::wait() {
+    unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]() { return unfinished == 0; });
+}
+
+
+unsigned int WorkStealingPool::size() const {
+    return threads.size();
+}
+
+
+/*
+ * @brief       The newest task of this thread's queue, or else the oldest of another's.
+ */
+bool WorkStealingPool::take(unsigned int me, function<void()>& task) {
+    unsigned int n = queues.size();
+    for(unsigned int k=0; k<n; k++) {
+        Queue& q = *queues[(me + k) % n];
+        lock_guard<std::mutex> lock(q.mutex);
+        if(q.tasks.empty())
+            continue;
+        if(k == 0) {
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+        } else {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+
+void WorkStealingPool::run(unsigned int me) {
+    while(true) {
+        {
+            unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || queued > 0; });
+            if(queued == 0)
+                return;
+            // Claim a task; it is in some queue, though maybe not yet visible to take().
+            queued--;
+        }
+
+        function<void()> task;
+        while(!take(me, task)) {
+            this_thread::yield();
+        }
+        task();
+
+        bool done;
+        {
+            lock_guard<std::mutex> lock(mutex);
+            done = --unfinished == 0;
+        }
+        if(done)
+            idle.notify_all();
+    }
+}
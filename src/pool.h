@@ -0,0 +1,53 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+
+/*
+ * A fixed set of threads running submitted tasks, for evaluations that take
+ * uneven times (a crashed run ends early, a long one does not).
+ *
+ * Tasks are dealt round-robin to per-thread queues. Each thread takes the
+ * newest task from its own queue, and once that is empty steals the oldest
+ * from another's, so no thread idles while others have a backlog.
+ */
+class WorkStealingPool {
+
+private:
+  struct Queue {
+    std::deque<std::function<void()> > tasks;
+    std::mutex mutex;
+  };
+
+  std::vector<std::unique_ptr<Queue> > queues;
+  std::vector<std::thread> threads;
+  unsigned int next_queue;
+
+  // Guards the counts below, for sleeping and waiting.
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable idle;
+  unsigned long queued;
+  unsigned long unfinished;
+  bool stopping;
+
+  bool take(unsigned int me, std::function<void()>& task);
+  void run(unsigned int me);
+
+public:
+  WorkStealingPool(unsigned int nthreads=0);
+  ~WorkStealingPool();
+
+  void submit(std::function<void()> task);
+  void wait();
+  unsigned int size() const;
+};
+
+#endif /* POOL_H */
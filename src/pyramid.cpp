@@ -0,0 +1,375 @@
+#include "pyramid.h"
+#include <cmath>
+#include <cstdio>     // remove, rename
+#include <cstring>    // memchr, memcmp
+#include <fstream>
+#include <algorithm>  // min, max
+#include <unistd.h>   // truncate
+#include <sys/stat.h> // stat, mkdir
+#include "pidlog.h"
+
+using namespace std;
+
+static const char STATE_MAGIC[8] = {'P', 'I', 'D', 'P', 'Y', 'R', '0', '1'};
+
+// Samples buffered before the level files are appended to.
+static const size_t FLUSH_ROWS = 1 << 16;
+
+
+/*
+ * @brief       Bytes per row of a level file.
+ */
+static size_t record_size(unsigned int level) {
+    return level == 0 ? (1 + PYRAMID_COLUMNS) * sizeof(double) : sizeof(PyramidItem);
+}
+
+
+/*
+ * @brief       Twice the area of the triangle (at, av), (bt, bv), (ct, cv).
+ */
+static inline double triangle_area(double at, double av, double bt, double bv, double ct, double cv) {
+    return fabs((at - ct) * (bv - av) - (at - bt) * (cv - av));
+}
+
+
+
+/*****************************************************************
+ ***************** One level of LTTB downsampling. ***************
+ *****************************************************************/
+
+
+PyramidLevel::PyramidLevel() {
+    has_prev = false;
+    for(unsigned int c=0; c<PYRAMID_COLUMNS; c++) {
+        prev_t[c] = prev_v[c] = 0;
+    }
+}
+
+
+/*
+ * @brief       Merge the pending group into one bucket, now that the next group (current) is complete.
+ */
+PyramidItem PyramidLevel::finish() {
+    PyramidItem bucket;
+    bucket.t_first = pending.front().t_first;
+    bucket.t_last = pending.back().t_last;
+    bucket.count = 0;
+    for(auto& item : pending) {
+        bucket.count += item.count;
+    }
+
+    for(unsigned int c=0; c<PYRAMID_COLUMNS; c++) {
+        // Average of the next group's representatives.
+        double next_t = 0, next_v = 0;
+        for(auto& item : current) {
+            next_t += item.columns[c].t_rep;
+            next_v += item.columns[c].v_rep;
+        }
+        next_t /= current.size();
+        next_v /= current.size();
+
+        // The very first bucket has nothing before it; anchor it on its own first point.
+        double at = has_prev ? prev_t[c] : pending.front().columns[c].t_rep;
+        double av = has_prev ? prev_v[c] : pending.front().columns[c].v_rep;
+
+        PyramidColumn& out = bucket.columns[c];
+        out = pending.front().columns[c];
+        double best_area = -1;
+        for(auto& item : pending) {
+            const PyramidColumn& col = item.columns[c];
+            double area = triangle_area(at, av, col.t_rep, col.v_rep, next_t, next_v);
+            if(area > best_area) {
+                best_area = area;
+                out.t_rep = col.t_rep;
+                out.v_rep = col.v_rep;
+            }
+            out.min = min(out.min, col.min);
+            out.max = max(out.max, col.max);
+        }
+        prev_t[c] = out.t_rep;
+        prev_v[c] = out.v_rep;
+    }
+    has_prev = true;
+    return bucket;
+}
+
+
+
+/*****************************************************************
+ ***************** The pyramid of all levels. ********************
+ *****************************************************************/
+
+
+/*
+ * @brief       Open (or start) the pyramid kept in a directory.
+ * @param[in]   dir         Directory for the level files and the state, created if needed.
+ * @param[in]   fanout      Items of one level per bucket of the next; a different value than
+ *                          the existing pyramid was built with rebuilds it.
+ */
+TelemetryPyramid::TelemetryPyramid(const string& dir, unsigned int fanout) {
+    this->dir = dir;
+    this->fanout = max(2u, fanout);
+    mkdir(dir.c_str(), 0755);
+    if(!load())
+        reset();
+}
+
+
+string TelemetryPyramid::level_fname(unsigned int level) {
+    return dir + "/level_" + to_string(level) + ".bin";
+}
+
+
+/*
+ * @brief       Forget everything and delete the level files, to rebuild from the start of the log.
+ */
+void TelemetryPyramid::reset() {
+    source_offset = 0;
+    source_device = source_inode = 0;
+    num_samples = 0;
+    levels.clear();
+    raw_out.clear();
+    for(unsigned int k=0; k<PYRAMID_MAX_LEVELS; k++) {
+        emitted[k] = 0;
+        out[k].clear();
+        remove(level_fname(k).c_str());
+    }
+}
+
+
+/*
+ * @brief       Add one sample to level 0 and every level above.
+ */
+void TelemetryPyramid::add(long t, const double values[PYRAMID_COLUMNS]) {
+    PyramidItem item;
+    item.t_first = item.t_last = t;
+    item.count = 1;
+    raw_out.push_back(t);
+    for(unsigned int c=0; c<PYRAMID_COLUMNS; c++) {
+        item.columns[c] = {(double) t, values[c], values[c], values[c]};
+        raw_out.push_back(values[c]);
+    }
+    num_samples++;
+    push(0, item);
+}
+
+
+/*
+ * @brief       Feed an item of one level to the builder of the next.
+ */
+void TelemetryPyramid::push(unsigned int level, const PyramidItem& item) {
+    if(level + 1 >= PYRAMID_MAX_LEVELS)
+        return;
+    if(levels.size() <= level)
+        levels.resize(level + 1);
+
+    PyramidLevel& builder = levels[level];
+    builder.current.push_back(item);
+    if(builder.current.size() < fanout)
+        return;
+
+    bool finished = !builder.pending.empty();
+    PyramidItem bucket;
+    if(finished)
+        bucket = builder.finish();
+    builder.pending.swap(builder.current);
+    builder.current.clear();
+
+    // Last, since it may grow levels (and move the builder).
+    if(finished) {
+        out[level + 1].push_back(bucket);
+        push(level + 1, bucket);
+    }
+}
+
+
+/*
+ * @brief       Add the lines appended to a cte.csv log since the last update, and save.
+ * @return      Whether the log could be read and the pyramid written.
+ */
+bool TelemetryPyramid::update(const string& log_fname) {
+    struct stat st;
+    if(stat(log_fname.c_str(), &st) != 0)
+        return false;
+    bool replaced = source_inode != 0 && (st.st_dev != source_device || st.st_ino != source_inode);
+    if(replaced || (uint64_t) st.st_size < source_offset)
+        reset();
+    source_device = st.st_dev;
+    source_inode = st.st_ino;
+
+    MappedFile log;
+    if(!log.open(log_fname))
+        return false;
+
+    // Only complete lines; an unfinished last line is read next time.
+    const char* begin = log.data() + min((uint64_t) log.size(), source_offset);
+    const char* end = log.data() + log.size();
+    while(end > begin && *(end - 1) != '\n')
+        end--;
+
+    long t;
+    double values[PYRAMID_COLUMNS];
+    for(const char* line=begin; line<end; ) {
+        const char* nl = (const char*) memchr(line, '\n', end - line);
+        if(parse_telemetry_fields(line, nl, t, values))
+            add(t, values);
+        line = nl + 1;
+        if(raw_out.size() >= FLUSH_ROWS * (1 + PYRAMID_COLUMNS) && !write_levels())
+            return false;
+    }
+    source_offset = end - log.data();
+
+    return write_levels() && save();
+}
+
+
+/*
+ * @brief       Append the rows produced since the last write to the level files.
+ */
+bool TelemetryPyramid::write_levels() {
+    if(!raw_out.empty()) {
+        ofstream f(level_fname(0), ios::app | ios::binary);
+        f.write((const char*) raw_out.data(), raw_out.size() * sizeof(double));
+        if(!f.good())
+            return false;
+        emitted[0] += raw_out.size() / (1 + PYRAMID_COLUMNS);
+        raw_out.clear();
+    }
+    for(unsigned int k=1; k<PYRAMID_MAX_LEVELS; k++) {
+        if(out[k].empty())
+            continue;
+        ofstream f(level_fname(k), ios::app | ios::binary);
+        f.write((const char*) out[k].data(), out[k].size() * sizeof(PyramidItem));
+        if(!f.good())
+            return false;
+        emitted[k] += out[k].size();
+        out[k].clear();
+    }
+    return true;
+}
+
+
+template <typename T>
+static void write_pod(ofstream& f, const T& x) {
+    f.write((const char*) &x, sizeof(T));
+}
+
+template <typename T>
+static bool read_pod(ifstream& f, T& x) {
+    return (bool) f.read((char*) &x, sizeof(T));
+}
+
+
+static void write_items(ofstream& f, const vector<PyramidItem>& items) {
+    write_pod(f, (uint32_t) items.size());
+    f.write((const char*) items.data(), items.size() * sizeof(PyramidItem));
+}
+
+static bool read_items(ifstream& f, vector<PyramidItem>& items, unsigned int fanout) {
+    uint32_t n;
+    if(!read_pod(f, n) || n > fanout)
+        return false;
+    items.resize(n);
+    return (bool) f.read((char*) items.data(), n * sizeof(PyramidItem));
+}
+
+
+/*
+ * @brief       Save where the log was read to and the partial groups, atomically.
+ */
+bool TelemetryPyramid::save() {
+    string fname = dir + "/state.bin";
+    {
+        ofstream f(fname + ".tmp", ios::trunc | ios::binary);
+        f.write(STATE_MAGIC, sizeof(STATE_MAGIC));
+        write_pod(f, (uint32_t) fanout);
+        write_pod(f, (uint32_t) PYRAMID_COLUMNS);
+        write_pod(f, source_offset);
+        write_pod(f, source_device);
+        write_pod(f, source_inode);
+        write_pod(f, num_samples);
+        f.write((const char*) emitted, sizeof(emitted));
+        write_pod(f, (uint32_t) levels.size());
+        for(auto& level : levels) {
+            write_pod(f, (uint8_t) level.has_prev);
+            f.write((const char*) level.prev_t, sizeof(level.prev_t));
+            f.write((const char*) level.prev_v, sizeof(level.prev_v));
+            write_items(f, level.pending);
+            write_items(f, level.current);
+        }
+        if(!f.good())
+            return false;
+    }
+    return rename((fname + ".tmp").c_str(), fname.c_str()) == 0;
+}
+
+
+/*
+ * @brief       Load the saved state, and cut the level files back to it
+ *              (rows written after the state was last saved are written again).
+ * @return      Whether a compatible state was found.
+ */
+bool TelemetryPyramid::load() {
+    ifstream f(dir + "/state.bin", ios::binary);
+    char magic[sizeof(STATE_MAGIC)];
+    uint32_t saved_fanout, ncols, nlevels;
+    if(!f.read(magic, sizeof(magic)) || memcmp(magic, STATE_MAGIC, sizeof(magic)) != 0)
+        return false;
+    if(!read_pod(f, saved_fanout) || saved_fanout != fanout || !read_pod(f, ncols) || ncols != PYRAMID_COLUMNS)
+        return false;
+    if(!read_pod(f, source_offset) || !read_pod(f, source_device) || !read_pod(f, source_inode)
+       || !read_pod(f, num_samples) || !f.read((char*) emitted, sizeof(emitted)) || !read_pod(f, nlevels)
+       || nlevels > PYRAMID_MAX_LEVELS)
+        return false;
+    levels.assign(nlevels, PyramidLevel());
+    for(auto& level : levels) {
+        uint8_t has_prev;
+        if(!read_pod(f, has_prev) || !f.read((char*) level.prev_t, sizeof(level.prev_t))
+           || !f.read((char*) level.prev_v, sizeof(level.prev_v))
+           || !read_items(f, level.pending, fanout) || !read_items(f, level.current, fanout))
+            return false;
+        level.has_prev = has_prev;
+    }
+
+    for(unsigned int k=0; k<PYRAMID_MAX_LEVELS; k++) {
+        struct stat st;
+        if(stat(level_fname(k).c_str(), &st) != 0) {
+            if(emitted[k] > 0)
+                return false;
+            continue;
+        }
+        off_t size = emitted[k] * record_size(k);
+        if(st.st_size < size)
+            return false;
+        if(st.st_size > size && truncate(level_fname(k).c_str(), size) != 0)
+            return false;
+    }
+    return true;
+}
+
+
+/*
+ * @brief       Samples in the pyramid (all of level 0).
+ */
+uint64_t TelemetryPyramid::get_num_samples() {
+    return num_samples;
+}
+
+
+/*
+ * @brief       Levels with at least one bucket written, counting level 0.
+ */
+unsigned int TelemetryPyramid::get_num_levels() {
+    unsigned int n = 0;
+    while(n < PYRAMID_MAX_LEVELS && emitted[n] > 0)
+        n++;
+    return n;
+}
+
+
+/*
+ * @brief       Rows written to one level's file.
+ */
+uint64_t TelemetryPyramid::get_num_buckets(unsigned int level) {
+    return level < PYRAMID_MAX_LEVELS ? emitted[level] : 0;
+}
@@ -0,0 +1,101 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Columns of cte.csv after the time: cte, speed, angle, steer, throttle, i_error.
+#define PYRAMID_COLUMNS 6
+
+// Level k buckets hold fanout^k samples; deeper levels are not built.
+#define PYRAMID_MAX_LEVELS 16
+
+
+/*
+ * One column of a bucket: its Largest-Triangle-Three-Buckets representative
+ * point, and the envelope of all samples in the bucket.
+ */
+struct PyramidColumn {
+  double t_rep, v_rep;
+  double min, max;
+};
+
+/*
+ * A bucket of consecutive samples (a single sample at level 0).
+ * Stored as 3 + 4 * PYRAMID_COLUMNS float64s.
+ */
+struct PyramidItem {
+  double t_first, t_last;
+  double count;
+  PyramidColumn columns[PYRAMID_COLUMNS];
+};
+
+
+/*
+ * Builds level k + 1 from the items of level k, fanout items per bucket.
+ *
+ * LTTB picks, in each bucket, the point forming the largest triangle with the
+ * point picked in the previous bucket and the average of the next bucket. So a
+ * full group waits as pending until the following group is complete too.
+ */
+struct PyramidLevel {
+  std::vector<PyramidItem> pending, current;
+  bool has_prev;
+  double prev_t[PYRAMID_COLUMNS], prev_v[PYRAMID_COLUMNS];
+
+  PyramidLevel();
+  PyramidItem finish();
+};
+
+
+/*
+ * A multi-resolution summary of a cte.csv log, kept in a directory next to it.
+ *
+ * level_0.bin holds the samples as rows of 1 + PYRAMID_COLUMNS float64s
+ * (t, then the columns), and level_k.bin (k >= 1) holds buckets of fanout^k
+ * samples as PyramidItem rows. Any time range can then be drawn from the finest
+ * level with no more than a few thousand buckets in it: a line through the
+ * representative points plus the min/max envelope.
+ *
+ * update() only parses the bytes appended to the log since the last call, and
+ * appends only completed buckets; the partial groups of every level, and how far
+ * the log was read, are kept in a state file. So the newest fanout^k to
+ * 2 fanout^k samples are not yet in level k, and a reader should take the
+ * time after a level's last bucket from the level below. If the log was truncated
+ * or replaced, the pyramid is rebuilt from scratch.
+ */
+class TelemetryPyramid {
+
+private:
+  std::string dir;
+  unsigned int fanout;
+
+  uint64_t source_offset;
+  uint64_t source_device, source_inode;
+  uint64_t num_samples;
+  uint64_t emitted[PYRAMID_MAX_LEVELS];
+  std::vector<PyramidLevel> levels;
+
+  // Rows not yet appended to the files.
+  std::vector<double> raw_out;
+  std::vector<PyramidItem> out[PYRAMID_MAX_LEVELS];
+
+  std::string level_fname(unsigned int level);
+  void reset();
+  void push(unsigned int level, const PyramidItem& item);
+  bool load();
+  bool save();
+  bool write_levels();
+
+public:
+  TelemetryPyramid(const std::string& dir, unsigned int fanout=8);
+  void add(long t, const double values[PYRAMID_COLUMNS]);
+  bool update(const std::string& log_fname);
+
+  uint64_t get_num_samples();
+  unsigned int get_num_levels();
+  uint64_t get_num_buckets(unsigned int level);
+};
+
+#endif /* PYRAMID_H */
@@ -0,0 +1,52 @@
+#include <iostream>
+#include <chrono>
+#include <cstring>    // strcmp
+#include <cstdlib>    // atoi
+
+#include "pyramid.h"
+
+// Set parameters.
+#define FANOUT 8
+
+/*
+ * Build, or bring up to date, the multi-resolution plotting pyramid of a cte.csv log.
+ *
+ *   ./pyramid cte.csv [--dir DIR] [--fanout F]
+ *
+ * The pyramid goes in cte.csv.pyramid/ unless --dir says otherwise; run it again
+ * as the log grows and only the new lines are processed.
+ */
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " cte.csv [--dir DIR] [--fanout F]" << std::endl;
+        return -1;
+    }
+
+    std::string log_fname = argv[1];
+    std::string dir = log_fname + ".pyramid";
+    unsigned int fanout = FANOUT;
+    for(int i=2; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--dir") == 0 && has_value) {
+            dir = argv[++i];
+        } else if(strcmp(argv[i], "--fanout") == 0 && has_value) {
+            fanout = atoi(argv[++i]);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    TelemetryPyramid pyramid(dir, fanout);
+    uint64_t before = pyramid.get_num_samples();
+    if(!pyramid.update(log_fname)) {
+        std::cerr << "Failed to update " << dir << " from " << log_fname << std::endl;
+        return -1;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Added " << pyramid.get_num_samples() - before << " samples to " << dir;
+    std::cout << " in " << ms << " ms (" << pyramid.get_num_samples() << " in all)." << std::endl;
+    for(unsigned int k=0; k<pyramid.get_num_levels(); k++) {
+        std::cout << "  level " << k << ": " << pyramid.get_num_buckets(k) << " buckets" << std::endl;
+    }
+    return 0;
+}
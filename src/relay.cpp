@@ -0,0 +1,237 @@
+#include "relay.h"
+#include "vector_utils.h"
+#include "say_time.h"
+#include <iostream>
+#include <cmath>
+#include <cstring>    // strcmp
+#include <cstdlib>    // atoi, atof
+#include <algorithm>  // max
+
+using namespace std;
+
+// Cycles after the first relay switch that are not scored, while the oscillation settles.
+constexpr unsigned int SETTLING_CYCLES = 2;
+
+// Relative spread of the last cycles' periods and amplitudes accepted as a steady limit cycle.
+constexpr double CYCLE_TOLERANCE = 0.1;
+
+
+/*
+ * @brief       Construct the autotuner.
+ * @param[in]   lead        Derivative lead time of the relay input, in nominal sampling periods.
+ * @param[in]   amplitude   Relay output h (steering value, in [0, 1]).
+ * @param[in]   hysteresis  Relay dead band eps around zero cte [m].
+ * @param[in]   max_frames  Give up after this many frames.
+ * @param[in]   min_cycles  Consistent cycles required before estimating.
+ * @param[in]   max_cte     Give up if the oscillation grows beyond this |cte| [m].
+ */
+RelayAutotuner::RelayAutotuner(double lead, double amplitude, double hysteresis, unsigned int max_frames,
+                               unsigned int min_cycles, double max_cte) {
+    this->lead = lead;
+    this->amplitude = amplitude;
+    this->hysteresis = hysteresis;
+    this->max_frames = max_frames;
+    this->min_cycles = max(2u, min_cycles);
+    this->max_cte = max_cte;
+
+    output = 0;
+    last_cte = NAN;
+    t = 0;
+    frames = 0;
+    last_switch_up = -1;
+    cycle_max = -INFINITY;
+    cycle_min = INFINITY;
+
+    done = false;
+    success = false;
+    Ku = 0;
+    Tu = 0;
+}
+
+
+/*
+ * @brief       Compute the relay's steering command for one telemetry frame.
+ * @param[in]   cte         The error signal.
+ * @param[in]   dt          Time since the last frame, in nominal sampling periods.
+ * @return      The steering value to send.
+ */
+double RelayAutotuner::control(double cte, double dt) {
+    if(done)
+        return 0;
+
+    t += dt;
+    frames++;
+    double e = cte;
+    if(!std::isnan(last_cte))
+        e += lead * (cte - last_cte) / dt;
+    last_cte = cte;
+    cycle_max = max(cycle_max, e);
+    cycle_min = min(cycle_min, e);
+
+    // Reverse-acting relay with hysteresis: steer against the error once it leaves the dead band.
+    if(e > hysteresis && output >= 0) {
+        output = -amplitude;
+    } else if(e < -hysteresis && output <= 0) {
+        bool switched_up = output < 0;
+        output = amplitude;
+        if(switched_up) {
+            if(last_switch_up >= 0)
+                finish_cycle(t - last_switch_up);
+            last_switch_up = t;
+            cycle_max = -INFINITY;
+            cycle_min = INFINITY;
+        }
+    }
+
+    if(!done && fabs(cte) > max_cte) {
+        finish(false, "the oscillation grew too large");
+    } else if(!done && frames >= max_frames) {
+        finish(false, "no steady limit cycle within the frame budget");
+    }
+    return done ? 0 : output;
+}
+
+
+/*
+ * @brief       Record one full relay cycle, and finish once the last few agree.
+ */
+void RelayAutotuner::finish_cycle(double period) {
+    periods.push_back(period);
+    amplitudes.push_back((cycle_max - cycle_min) / 2);
+    say_time(); cout << "Relay cycle " << periods.size() << ": period " << period;
+    cout << ", amplitude " << amplitudes.back() << endl;
+
+    if(periods.size() < SETTLING_CYCLES + min_cycles)
+        return;
+
+    vector<double> last_periods(periods.end() - min_cycles, periods.end());
+    vector<double> last_amplitudes(amplitudes.end() - min_cycles, amplitudes.end());
+    double mean_period = vec_mean(last_periods);
+    double mean_amplitude = vec_mean(last_amplitudes);
+    for(unsigned int i=0; i<min_cycles; i++) {
+        if(fabs(last_periods[i] - mean_period) > CYCLE_TOLERANCE * mean_period
+           || fabs(last_amplitudes[i] - mean_amplitude) > CYCLE_TOLERANCE * mean_amplitude)
+            return;
+    }
+
+    // Describing function of a relay with hysteresis.
+    double a2 = mean_amplitude * mean_amplitude - hysteresis * hysteresis;
+    if(a2 <= 0) {
+        finish(false, "the limit cycle is inside the hysteresis band");
+        return;
+    }
+    Ku = 4 * amplitude / (M_PI * sqrt(a2));
+    Tu = mean_period;
+    finish(true, "steady limit cycle");
+}
+
+
+/*
+ * @brief       Stop relaying and report.
+ */
+void RelayAutotuner::finish(bool success, const char* reason) {
+    done = true;
+    this->success = success;
+    say_time(); cout << "Relay autotune " << (success ? "succeeded" : "failed") << " after " << frames;
+    cout << " frames: " << reason << "." << endl;
+    if(success) {
+        say_time(); cout << "Ku = " << Ku << ", Tu = " << Tu << " periods" << endl;
+    }
+}
+
+
+/*
+ * @brief       Whether the relay phase is over, successfully or not.
+ */
+bool RelayAutotuner::is_done() {
+    return done;
+}
+
+
+/*
+ * @brief       Whether Ku and Tu were estimated.
+ */
+bool RelayAutotuner::succeeded() {
+    return success;
+}
+
+
+/*
+ * @brief       The estimated ultimate (critical) gain.
+ */
+double RelayAutotuner::ultimate_gain() {
+    return Ku;
+}
+
+
+/*
+ * @brief       The estimated ultimate period, in nominal sampling periods.
+ */
+double RelayAutotuner::ultimate_period() {
+    return Tu;
+}
+
+
+/*
+ * @brief       PID gains from Ku and Tu, in the PID class's units (time in nominal periods).
+ * The rule gives a PID C on the compensated error cte + lead * d(cte)/dt; expanding
+ * C(cte + lead * d(cte)/dt) and dropping the second-derivative term gives a PID on cte with
+ * Kp' = Kp + lead * Ki, Ki' = Ki, Kd' = Kd + lead * Kp.
+ * @return      {Kp, Ki, Kd}
+ */
+vector<double> RelayAutotuner::gains(tuning_rule_t rule) {
+    // Kp / Ku, Ti / Tu, Td / Tu
+    double kp, ti, td;
+    switch(rule) {
+        case PESSEN:         kp = 0.7;  ti = 0.4; td = 0.15;  break;
+        case SOME_OVERSHOOT: kp = 0.33; ti = 0.5; td = 0.33;  break;
+        case NO_OVERSHOOT:   kp = 0.2;  ti = 0.5; td = 0.33;  break;
+        default:             kp = 0.6;  ti = 0.5; td = 0.125; break;
+    }
+    double Kp = kp * Ku;
+    double Ki = Kp / (ti * Tu);
+    double Kd = Kp * td * Tu;
+    return {Kp + lead * Ki, Ki, Kd + lead * Kp};
+}
+
+
+/*
+ * @brief       Build an autotuner from the command line.
+ * @param[in]   default_lead    Relay input lead if --relay-lead is not given, e.g. Kd / Kp of the current gains.
+ * @param[out]  rule        The tuning rule to apply to the estimates.
+ * @return      A new autotuner, or nullptr if --relay was not given.
+ */
+RelayAutotuner* parse_relay_autotuner(int argc, char* argv[], double default_lead, tuning_rule_t& rule) {
+    bool enabled = false;
+    double lead = default_lead;
+    double amplitude = 0.1, hysteresis = 0.05;
+    unsigned int frames = 1200;
+    rule = ZIEGLER_NICHOLS;
+
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--relay") == 0) {
+            enabled = true;
+        } else if(strcmp(argv[i], "--relay-lead") == 0 && has_value) {
+            lead = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--relay-amplitude") == 0 && has_value) {
+            amplitude = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--relay-hysteresis") == 0 && has_value) {
+            hysteresis = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--relay-frames") == 0 && has_value) {
+            frames = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--relay-rule") == 0 && has_value) {
+            i++;
+            if(strcmp(argv[i], "pessen") == 0) {
+                rule = PESSEN;
+            } else if(strcmp(argv[i], "some") == 0) {
+                rule = SOME_OVERSHOOT;
+            } else if(strcmp(argv[i], "none") == 0) {
+                rule = NO_OVERSHOOT;
+            }
+        }
+    }
+    if(!enabled)
+        return nullptr;
+    return new RelayAutotuner(lead, amplitude, hysteresis, frames);
+}
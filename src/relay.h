@@ -0,0 +1,72 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <vector>
+
+
+/*
+ * Tuning rules mapping the ultimate gain and period to PID gains.
+ */
+enum tuning_rule_enum { ZIEGLER_NICHOLS, PESSEN, SOME_OVERSHOOT, NO_OVERSHOOT };
+typedef enum tuning_rule_enum tuning_rule_t;
+
+
+/*
+ * Relay-feedback (Astrom-Hagglund) autotuning.
+ *
+ * While active, steering is a bang-bang relay (with hysteresis) on the
+ * lead-compensated error e = cte + lead * d(cte)/dt, which drives the car into
+ * a limit cycle at the compensated loop's critical frequency. The lead is needed
+ * because the lateral dynamics are a double integrator: without it, the phase
+ * never rises above -180 degrees and the relay oscillation grows instead of settling.
+ * A streaming detector times the relay switches and tracks the extremes of e
+ * between them; once consecutive cycles agree, the describing-function
+ * estimates Ku = 4 h / (pi sqrt(a^2 - eps^2)) and Tu give the PID gains
+ * for the compensated error, which are then folded back onto the raw cte.
+ */
+class RelayAutotuner {
+
+private:
+  double amplitude;
+  double hysteresis;
+  double lead;
+  double last_cte;
+  double max_cte;
+  unsigned int max_frames;
+  unsigned int min_cycles;
+
+  double output;
+  double t;
+  unsigned long frames;
+  double last_switch_up;
+  double cycle_max, cycle_min;
+  std::vector<double> periods;
+  std::vector<double> amplitudes;
+
+  bool done;
+  bool success;
+  double Ku, Tu;
+
+  void finish_cycle(double period);
+  void finish(bool success, const char* reason);
+
+public:
+  RelayAutotuner(double lead, double amplitude=0.1, double hysteresis=0.05, unsigned int max_frames=1200,
+                 unsigned int min_cycles=4, double max_cte=2.5);
+  double control(double cte, double dt);
+  bool is_done();
+  bool succeeded();
+  double ultimate_gain();
+  double ultimate_period();
+  std::vector<double> gains(tuning_rule_t rule=ZIEGLER_NICHOLS);
+};
+
+
+/*
+ * Build an autotuner from --relay on the command line; nullptr if not given.
+ * Also recognizes --relay-lead X, --relay-amplitude X, --relay-hysteresis X,
+ * --relay-frames N and --relay-rule {zn,pessen,some,none}.
+ */
+RelayAutotuner* parse_relay_autotuner(int argc, char* argv[], double default_lead, tuning_rule_t& rule);
+
+#endif /* RELAY_H */
@@ -0,0 +1,171 @@
+#include "robustness.h"
+#include "sim_bank.h"
+#include <cmath>
+#include <cstring>    // strcmp
+#include <cstdlib>    // atoi, atof
+#include <limits>
+#include <random>
+#include <algorithm>  // min, max, sort, copy
+
+using namespace std;
+
+
+RobustnessOptions parse_robustness_options(int argc, char* argv[]) {
+    RobustnessOptions options;
+    options.enabled = false;
+    options.num_scenarios = 32;
+    options.spread.initial_cte = 1.0;
+    options.spread.target_speed = 5.0;
+    options.spread.cte_noise = 0.1;
+    options.spread.delay = 2;
+    options.spread.plant = 0.1;
+    options.objective = ROBUST_MEAN;
+    options.level = 0.9;
+    options.threads = 0;
+    options.seed = 0;
+
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--robust") == 0 && has_value) {
+            options.enabled = true;
+            options.num_scenarios = max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--robust-initial-cte") == 0 && has_value) {
+            options.spread.initial_cte = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--robust-speed") == 0 && has_value) {
+            options.spread.target_speed = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--robust-noise") == 0 && has_value) {
+            options.spread.cte_noise = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--robust-delay") == 0 && has_value) {
+            options.spread.delay = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--robust-plant") == 0 && has_value) {
+            options.spread.plant = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--robust-objective") == 0 && has_value) {
+            i++;
+            if(strcmp(argv[i], "worst") == 0) {
+                options.objective = ROBUST_WORST;
+            } else if(strcmp(argv[i], "mean") == 0) {
+                options.objective = ROBUST_MEAN;
+            } else {
+                // A quantile level, e.g. 0.9.
+                options.objective = ROBUST_QUANTILE;
+                options.level = max(0.0, min(1.0, atof(argv[i])));
+            }
+        } else if(strcmp(argv[i], "--threads") == 0 && has_value) {
+            options.threads = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--robust-seed") == 0 && has_value) {
+            options.seed = atoi(argv[++i]);
+        }
+    }
+    return options;
+}
+
+
+/*
+ * @brief       The conditions of one randomized scenario, the same for a given seed and index.
+ * @param[out]  noise_seed  Seed for the scenario's measurement noise.
+ */
+SimParams sample_scenario(const SimParams& nominal, const ScenarioSpread& spread,
+                          unsigned int seed, unsigned int index, unsigned int& noise_seed) {
+    seed_seq seq{seed, index};
+    mt19937 rng(seq);
+    uniform_real_distribution<double> symmetric(-1.0, 1.0);
+    uniform_real_distribution<double> unit(0.0, 1.0);
+
+    SimParams p = nominal;
+    p.initial_cte = nominal.initial_cte + spread.initial_cte * symmetric(rng);
+    p.target_speed = nominal.target_speed + spread.target_speed * symmetric(rng);
+    p.cte_noise = nominal.cte_noise + spread.cte_noise * unit(rng);
+    p.delay = nominal.delay + uniform_int_distribution<unsigned int>(0, spread.delay)(rng);
+    p.wheelbase = nominal.wheelbase * (1 + spread.plant * symmetric(rng));
+    p.max_angle = nominal.max_angle * (1 + spread.plant * symmetric(rng));
+    p.accel_gain = nominal.accel_gain * (1 + spread.plant * symmetric(rng));
+    p.drag = nominal.drag * (1 + spread.plant * symmetric(rng));
+    noise_seed = rng();
+    return p;
+}
+
+
+/*
+ * @brief       Draw the scenarios and start the pool.
+ * @param[in]   nominal     The model the scenarios perturb.
+ */
+RobustEvaluator::RobustEvaluator(const RobustnessOptions& options, SimParams nominal)
+        : options(options), nominal(nominal), pool(options.threads) {
+    scenarios.resize(options.num_scenarios);
+    noise_seeds.resize(options.num_scenarios);
+    for(unsigned int i=0; i<options.num_scenarios; i++) {
+        scenarios[i] = sample_scenario(nominal, options.spread, options.seed, i, noise_seeds[i]);
+    }
+}
+
+
+/*
+ * @brief       Linearly interpolated quantile of sorted values.
+ */
+static double sorted_quantile(const vector<double>& sorted, double level) {
+    double pos = level * (sorted.size() - 1);
+    unsigned int lo = (unsigned int) floor(pos);
+    unsigned int hi = min(lo + 1, (unsigned int) sorted.size() - 1);
+    double f = pos - lo;
+    // inf - inf would be NaN.
+    if(f == 0 || sorted[lo] == sorted[hi])
+        return sorted[lo];
+    return (1 - f) * sorted[lo] + f * sorted[hi];
+}
+
+
+/*
+ * @brief       Score candidates across all scenarios.
+ * @param[in]   candidates  Parameter vectors, as for evaluate_offline.
+ * @return      Each candidate's objectives over the scenarios, summarized.
+ */
+vector<RobustStats> RobustEvaluator::evaluate(const vector<vector<double> >& candidates,
+                                              unsigned int nsamples, unsigned int ndiscard) {
+    unsigned int n = candidates.size();
+    unsigned int m = scenarios.size();
+    vector<vector<double> > objectives(m, vector<double>(n));
+    // One task per scenario and chunk of candidates, so a few scenarios still keep every thread busy.
+    for(unsigned int i=0; i<m; i++) {
+        for(unsigned int k0=0; k0<n; k0+=ROBUST_CHUNK) {
+            unsigned int k1 = min(n, k0 + ROBUST_CHUNK);
+            pool.submit([this, i, k0, k1, &candidates, &objectives, nsamples, ndiscard]() {
+                vector<vector<double> > chunk(candidates.begin() + k0, candidates.begin() + k1);
+                vector<double> values = evaluate_offline_batch(chunk, nsamples, ndiscard, scenarios[i], noise_seeds[i]);
+                copy(values.begin(), values.end(), objectives[i].begin() + k0);
+            });
+        }
+    }
+    pool.wait();
+
+    vector<RobustStats> stats(n);
+    vector<double> values(m);
+    for(unsigned int k=0; k<n; k++) {
+        double sum = 0;
+        for(unsigned int i=0; i<m; i++) {
+            // A diverged run is as bad as it gets.
+            values[i] = std::isnan(objectives[i][k]) ? numeric_limits<double>::infinity() : objectives[i][k];
+            sum += values[i];
+        }
+        sort(values.begin(), values.end());
+
+        RobustStats& s = stats[k];
+        s.mean = sum / m;
+        double sum_sq = 0;
+        for(unsigned int i=0; i<m; i++) {
+            sum_sq += (values[i] - s.mean) * (values[i] - s.mean);
+        }
+        s.stddev = m > 1 ? sqrt(sum_sq / (m - 1)) : 0;
+        if(std::isinf(s.mean))
+            s.stddev = numeric_limits<double>::infinity();
+        s.worst = values.back();
+        s.p50 = sorted_quantile(values, 0.5);
+        s.p90 = sorted_quantile(values, 0.9);
+        s.quantile = sorted_quantile(values, options.level);
+        switch(options.objective) {
+            case ROBUST_MEAN:     s.score = s.mean; break;
+            case ROBUST_WORST:    s.score = s.worst; break;
+            case ROBUST_QUANTILE: s.score = s.quantile; break;
+        }
+    }
+    return stats;
+}
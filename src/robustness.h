@@ -0,0 +1,94 @@
+#ifndef ROBUSTNESS_H
+#define ROBUSTNESS_H
+
+#include <vector>
+#include "offline_sim.h"
+#include "pool.h"
+
+// Most candidates one task simulates at once.
+#define ROBUST_CHUNK 256
+
+
+/*
+ * How much the randomized scenarios differ from the nominal offline model.
+ */
+struct ScenarioSpread {
+  double initial_cte;     // initial offset, uniform in +-initial_cte [m]
+  double target_speed;    // speed set point, uniform in +-target_speed [mph]
+  double cte_noise;       // measurement noise sigma, uniform in [0, cte_noise] [m]
+  unsigned int delay;     // actuation delay, uniform in [0, delay] control periods
+  double plant;           // wheelbase, steering range, acceleration and drag each
+                          // scaled by a factor uniform in 1 +- plant
+};
+
+
+/*
+ * How to score a candidate from its objectives over the scenarios.
+ */
+enum robust_objective_enum {
+  ROBUST_MEAN,
+  ROBUST_WORST,
+  ROBUST_QUANTILE,
+};
+typedef enum robust_objective_enum robust_objective_t;
+
+
+/*
+ * A candidate's Twiddle objectives over all scenarios, summarized.
+ */
+struct RobustStats {
+  double mean;
+  double stddev;
+  double worst;
+  double p50;
+  double p90;
+  double quantile;    // at the configured level
+  double score;       // the configured aggregate of the above
+};
+
+
+/*
+ * Command-line configurable settings.
+ */
+struct RobustnessOptions {
+  bool enabled;
+  unsigned int num_scenarios;
+  ScenarioSpread spread;
+  robust_objective_t objective;
+  double level;           // for ROBUST_QUANTILE
+  unsigned int threads;   // 0 for one per hardware thread
+  unsigned int seed;
+};
+
+RobustnessOptions parse_robustness_options(int argc, char* argv[]);
+
+SimParams sample_scenario(const SimParams& nominal, const ScenarioSpread& spread,
+                          unsigned int seed, unsigned int index, unsigned int& noise_seed);
+
+
+/*
+ * Evaluates candidates on the same set of randomized scenarios (common random
+ * numbers): scenario i has the same conditions and the same noise sequence for
+ * every candidate and every call, so differences between candidates are not
+ * drowned by differences between draws.
+ *
+ * Each scenario simulates up to ROBUST_CHUNK candidates at once in a SimBank,
+ * one lane each, and the scenarios and chunks run in parallel on a work-stealing pool.
+ */
+class RobustEvaluator {
+
+private:
+  RobustnessOptions options;
+  SimParams nominal;
+  WorkStealingPool pool;
+  std::vector<SimParams> scenarios;
+  std::vector<unsigned int> noise_seeds;
+
+public:
+  RobustEvaluator(const RobustnessOptions& options, SimParams nominal=SimParams());
+
+  std::vector<RobustStats> evaluate(const std::vector<std::vector<double> >& candidates,
+                                    unsigned int nsamples, unsigned int ndiscard);
+};
+
+#endif /* ROBUSTNESS_H */
@@ -0,0 +1,205 @@
+#include "sensitivity.h"
+#include "sweep.h"    // sobol_points
+#include <cmath>
+#include <cstring>    // strcmp
+#include <cstdlib>    // atoi, atof
+#include <fstream>
+#include <random>
+#include <algorithm>  // max, sort
+
+using namespace std;
+
+
+SensitivityOptions parse_sensitivity_options(int argc, char* argv[], const vector<double>& lower,
+                                             const vector<double>& upper, unsigned int nsamples) {
+    SensitivityOptions options;
+    options.base = 256;
+    options.lower = lower;
+    options.upper = upper;
+    options.nsamples = nsamples;
+    options.bootstrap = 200;
+    options.out = "sensitivity.csv";
+
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--base") == 0 && has_value) {
+            options.base = max(2, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--bounds") == 0 && i + 3 < argc) {
+            // --bounds K LO HI for parameter K.
+            unsigned int k = atoi(argv[++i]);
+            double lo = atof(argv[++i]);
+            double hi = atof(argv[++i]);
+            if(k < options.lower.size()) {
+                options.lower[k] = lo;
+                options.upper[k] = hi;
+            }
+        } else if(strcmp(argv[i], "--samples") == 0 && has_value) {
+            options.nsamples = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--bootstrap") == 0 && has_value) {
+            options.bootstrap = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--out") == 0 && has_value) {
+            options.out = argv[++i];
+        }
+    }
+    return options;
+}
+
+
+/*
+ * @brief       The Saltelli sample: matrices A and B from the two halves of a 2d-dimensional
+ *              Sobol sequence (its first point, a corner, skipped), then for each parameter i
+ *              the matrix AB_i, A with column i taken from B. N rows each, in that order.
+ * @return      N * (d + 2) parameter vectors.
+ */
+vector<vector<double> > saltelli_design(const SensitivityOptions& options) {
+    unsigned int n = options.base;
+    unsigned int d = options.lower.size();
+    vector<vector<double> > points = sobol_points(n + 1, 2 * d);
+
+    vector<vector<double> > a(n, vector<double>(d)), b(n, vector<double>(d));
+    for(unsigned int r=0; r<n; r++) {
+        for(unsigned int k=0; k<d; k++) {
+            double lo = options.lower[k], hi = options.upper[k];
+            double u = points[r + 1][k], v = points[r + 1][d + k];
+            if(lo > 0) {
+                a[r][k] = lo * pow(hi / lo, u);
+                b[r][k] = lo * pow(hi / lo, v);
+            } else {
+                a[r][k] = lo + (hi - lo) * u;
+                b[r][k] = lo + (hi - lo) * v;
+            }
+        }
+    }
+
+    vector<vector<double> > design(a);
+    design.insert(design.end(), b.begin(), b.end());
+    for(unsigned int i=0; i<d; i++) {
+        for(unsigned int r=0; r<n; r++) {
+            vector<double> ab = a[r];
+            ab[i] = b[r][i];
+            design.push_back(ab);
+        }
+    }
+    return design;
+}
+
+
+/*
+ * @brief       Saltelli (2010) first-order and Jansen total-order estimators over the given rows.
+ */
+static void estimate(const vector<double>& y, unsigned int n, unsigned int d, const vector<unsigned int>& rows,
+                     vector<double>& first, vector<double>& total) {
+    const double* fa = &y[0];
+    const double* fb = &y[n];
+
+    double sum = 0, sum_sq = 0;
+    for(auto r : rows) {
+        sum += fa[r] + fb[r];
+        sum_sq += fa[r] * fa[r] + fb[r] * fb[r];
+    }
+    double m = 2.0 * rows.size();
+    double variance = (sum_sq - sum * sum / m) / (m - 1);
+
+    // A constant objective (flat, or every run clamped to the same value) explains nothing: leave the indices 0, not NaN.
+    first.assign(d, 0);
+    total.assign(d, 0);
+    if(!(variance > 0))
+        return;
+    for(unsigned int i=0; i<d; i++) {
+        const double* fab = &y[(2 + i) * n];
+        double s = 0, t = 0;
+        for(auto r : rows) {
+            s += fb[r] * (fab[r] - fa[r]);
+            t += (fa[r] - fab[r]) * (fa[r] - fab[r]);
+        }
+        first[i] = s / rows.size() / variance;
+        total[i] = t / (2 * rows.size()) / variance;
+    }
+}
+
+
+/*
+ * @brief       Sobol indices from the objectives of a saltelli_design, in its order. If the objective does
+ *              not vary (variance 0), the indices are undefined and left 0; callers should check the variance.
+ * @param[in]   bootstrap   Number of resamples of the N rows for the confidence intervals (0 for none).
+ */
+SensitivityIndices saltelli_indices(vector<double> y, unsigned int base, unsigned int dims,
+                                    unsigned int bootstrap, unsigned int seed) {
+    SensitivityIndices indices;
+    unsigned int n = base;
+
+    // A diverged run would make every variance infinite; count it as the worst finite one.
+    double largest = 0;
+    for(double v : y) {
+        if(isfinite(v))
+            largest = max(largest, v);
+    }
+    indices.num_clamped = 0;
+    for(double& v : y) {
+        if(!isfinite(v)) {
+            v = largest;
+            indices.num_clamped++;
+        }
+    }
+
+    vector<unsigned int> rows(n);
+    for(unsigned int r=0; r<n; r++) {
+        rows[r] = r;
+    }
+    estimate(y, n, dims, rows, indices.first, indices.total);
+
+    double sum = 0, sum_sq = 0;
+    for(unsigned int r=0; r<2*n; r++) {
+        sum += y[r];
+        sum_sq += y[r] * y[r];
+    }
+    indices.variance = (sum_sq - sum * sum / (2 * n)) / (2 * n - 1);
+
+    indices.first_conf.assign(dims, 0);
+    indices.total_conf.assign(dims, 0);
+    if(bootstrap == 0)
+        return indices;
+
+    mt19937 rng(seed);
+    uniform_int_distribution<unsigned int> pick(0, n - 1);
+    vector<vector<double> > firsts(dims), totals(dims);
+    vector<double> first, total;
+    for(unsigned int b=0; b<bootstrap; b++) {
+        for(auto& r : rows) {
+            r = pick(rng);
+        }
+        estimate(y, n, dims, rows, first, total);
+        for(unsigned int i=0; i<dims; i++) {
+            firsts[i].push_back(first[i]);
+            totals[i].push_back(total[i]);
+        }
+    }
+
+    // Half the width of the central 95% of the resampled estimates.
+    for(unsigned int i=0; i<dims; i++) {
+        sort(firsts[i].begin(), firsts[i].end());
+        sort(totals[i].begin(), totals[i].end());
+        unsigned int lo = (unsigned int) (0.025 * (bootstrap - 1));
+        unsigned int hi = (unsigned int) (0.975 * (bootstrap - 1));
+        indices.first_conf[i] = (firsts[i][hi] - firsts[i][lo]) / 2;
+        indices.total_conf[i] = (totals[i][hi] - totals[i][lo]) / 2;
+    }
+    return indices;
+}
+
+
+/*
+ * @brief       Write one line of gain,first,first_conf,total,total_conf per parameter after a header,
+ *              the format parse_freeze_options reads.
+ */
+bool write_sensitivity(const string& fname, const vector<string>& names, const SensitivityIndices& indices) {
+    ofstream f(fname, ios::trunc);
+    if(!f)
+        return false;
+    f << "gain,first,first_conf,total,total_conf" << endl;
+    for(unsigned int i=0; i<names.size(); i++) {
+        f << names[i] << "," << indices.first[i] << "," << indices.first_conf[i] << ","
+          << indices.total[i] << "," << indices.total_conf[i] << endl;
+    }
+    return (bool) f;
+}
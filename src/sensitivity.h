@@ -0,0 +1,43 @@
+#ifndef SENSITIVITY_H
+#define SENSITIVITY_H
+
+#include <vector>
+#include <string>
+
+
+/*
+ * Command-line configurable settings.
+ */
+struct SensitivityOptions {
+  unsigned int base;              // Saltelli base sample size N; N * (d + 2) evaluations
+  std::vector<double> lower;      // bounds of each gain: log-uniform if lower > 0, else uniform
+  std::vector<double> upper;
+  unsigned int nsamples;
+  unsigned int bootstrap;         // resamples for the confidence intervals
+  std::string out;
+};
+
+SensitivityOptions parse_sensitivity_options(int argc, char* argv[], const std::vector<double>& lower,
+                                             const std::vector<double>& upper, unsigned int nsamples);
+
+
+/*
+ * First-order and total-order Sobol indices of each parameter, with the
+ * half-widths of their 95% bootstrap confidence intervals.
+ */
+struct SensitivityIndices {
+  std::vector<double> first;
+  std::vector<double> first_conf;
+  std::vector<double> total;
+  std::vector<double> total_conf;
+  double variance;                // of the objective over the box
+  unsigned int num_clamped;       // non-finite objectives, clamped to the largest finite one
+};
+
+std::vector<std::vector<double> > saltelli_design(const SensitivityOptions& options);
+SensitivityIndices saltelli_indices(std::vector<double> y, unsigned int base, unsigned int dims,
+                                    unsigned int bootstrap, unsigned int seed=0);
+bool write_sensitivity(const std::string& fname, const std::vector<std::string>& names,
+                       const SensitivityIndices& indices);
+
+#endif /* SENSITIVITY_H */
@@ -0,0 +1,94 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>  // std::min
+
+#include "sensitivity.h"
+#include "robustness.h"
+#include "say_time.h"
+
+// Set parameters.
+#define NSAMPLES 6400
+#define NDISCARD 32
+#define FREEZE_BELOW 0.05
+#define BLOCK 4096
+
+/*
+ * Variance-based (Sobol) sensitivity of the Twiddle objective on the offline simulator
+ * to each of the six gains, steering Kp, Ki, Kd then throttle Kp, Ki, Kd.
+ *
+ *   ./sensitivity [--base N] [--bounds K LO HI] [--samples N] [--bootstrap B]
+ *                 [--out FILE] [--robust N ...] [--threads N]
+ *
+ * Draws N * 8 gain sets (Saltelli's scheme, N = 256 by default) within the bounds,
+ * by default a quarter to four times the gains main.cpp drives with, and 0 to 0.01 for
+ * the throttle Ki, scores them on every core, and prints each gain's first-order index
+ * (the share of the objective's variance it explains alone) and total-order index (with
+ * its interactions). Writes them to sensitivity.csv, which ./twiddle --freeze-from reads
+ * to hold the gains below a threshold fixed.
+ */
+int main(int argc, char* argv[]) {
+
+    std::vector<std::string> names = {"steer_kp", "steer_ki", "steer_kd", "throttle_kp", "throttle_ki", "throttle_kd"};
+    // pid_steering.Init and pid_throttle.Init in main.cpp, times 1/4 and 4.
+    std::vector<double> center = {0.174668, 0.000780556, 1.6099, 0.3, 0, 0.02};
+    std::vector<double> lower, upper;
+    for(double c : center) {
+        lower.push_back(c / 4);
+        upper.push_back(c * 4);
+    }
+    upper[4] = 0.01;
+    SensitivityOptions options = parse_sensitivity_options(argc, argv, lower, upper, NSAMPLES);
+
+    RobustnessOptions robust_options = parse_robustness_options(argc, argv);
+    if(!robust_options.enabled) {
+        // A single scenario, the nominal model.
+        robust_options.num_scenarios = 1;
+        robust_options.spread = ScenarioSpread();
+    }
+    RobustEvaluator evaluator(robust_options);
+
+    std::vector<std::vector<double> > design = saltelli_design(options);
+    say_time(); std::cout << "Evaluating " << design.size() << " gain sets over " << robust_options.num_scenarios
+                          << " scenarios." << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<double> y;
+    for(unsigned int k0=0; k0<design.size(); k0+=BLOCK) {
+        unsigned int k1 = std::min((unsigned int) design.size(), k0 + BLOCK);
+        std::vector<std::vector<double> > block(design.begin() + k0, design.begin() + k1);
+        for(auto& stats : evaluator.evaluate(block, options.nsamples, NDISCARD)) {
+            y.push_back(stats.score);
+        }
+        say_time(); std::cout << k1 << " / " << design.size() << " gain sets done." << std::endl;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    say_time(); std::cout << "Done in " << seconds << " s." << std::endl;
+
+    SensitivityIndices indices = saltelli_indices(y, options.base, names.size(), options.bootstrap);
+    if(indices.num_clamped > 0) {
+        say_time(); std::cout << indices.num_clamped << " runs diverged; counted as the worst finite objective." << std::endl;
+    }
+    if(!(indices.variance > 0)) {
+        std::cerr << "The objective did not vary over the " << y.size() << " gain sets (variance " << indices.variance
+                  << "), so no gain can be ranked; not writing " << options.out << "." << std::endl;
+        return 1;
+    }
+    say_time(); std::cout << "Objective variance " << indices.variance << "; first-order / total-order indices:" << std::endl;
+    std::string frozen;
+    for(unsigned int i=0; i<names.size(); i++) {
+        say_time(); std::cout << "  p[" << i << "] " << names[i] << ": " << indices.first[i] << " +- " << indices.first_conf[i]
+                              << " / " << indices.total[i] << " +- " << indices.total_conf[i] << std::endl;
+        if(indices.total[i] < FREEZE_BELOW)
+            frozen += (frozen.empty() ? "" : ",") + std::to_string(i);
+    }
+
+    if(!write_sensitivity(options.out, names, indices)) {
+        std::cerr << "Failed to write " << options.out << std::endl;
+        return -1;
+    }
+    say_time(); std::cout << "Wrote " << options.out << "; total-order index below " << FREEZE_BELOW << ": "
+                          << (frozen.empty() ? "none" : frozen) << " (./twiddle --freeze-from " << options.out << ")." << std::endl;
+    return 0;
+}
@@ -0,0 +1,252 @@
+#include "shadow.h"
+#include "twiddle.h"
+#include "vector_utils.h"
+#include "say_time.h"
+#include <iostream>
+#include <cmath>
+#include <chrono>
+#include <cstring>    // strcmp
+#include <cstdlib>    // atoi, atof
+#include <algorithm>  // sort, min, max
+#include <numeric>    // iota
+
+using namespace std;
+
+// Telemetry speed is in mph; the plant gain wants [m/s].
+constexpr double MPH_TO_MPS = 0.44704;
+
+// Nominal telemetry period [s], as assumed by PID::UpdateError.
+constexpr double NOMINAL_PERIOD = 0.049;
+
+
+/*
+ * @brief       Read the shadow mode settings from the command line.
+ * Recognized flags: --shadow K, --shadow-window N, --shadow-margin X,
+ * --shadow-divergence X, --shadow-budget-us X, --spread X, --seed N.
+ */
+ShadowOptions parse_shadow_options(int argc, char* argv[]) {
+    ShadowOptions options;
+    options.num_candidates = 0;
+    options.window = 1600;
+    options.margin = 0.05;
+    options.max_divergence = 0.1;
+    options.budget_us = 1000;
+    options.spread = 0.3;
+    options.seed = 0;
+
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--shadow") == 0 && has_value) {
+            options.num_candidates = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--shadow-window") == 0 && has_value) {
+            // The objective needs a variance, so at least two frames.
+            options.window = max(2, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--shadow-margin") == 0 && has_value) {
+            options.margin = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--shadow-divergence") == 0 && has_value) {
+            options.max_divergence = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--shadow-budget-us") == 0 && has_value) {
+            options.budget_us = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--spread") == 0 && has_value) {
+            options.spread = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--seed") == 0 && has_value) {
+            options.seed = atoi(argv[++i]);
+        }
+    }
+    return options;
+}
+
+
+/*
+ * @brief       Construct the tournament.
+ * @param[in]   active      The controller actually driving; its gains are replaced on promotion.
+ * @param[in]   candidates  {Kp, Ki, Kd} of each shadow controller.
+ * @param[in]   max_angle   Steering angle at |steer| = 1 [deg].
+ * @param[in]   wheelbase   [m]
+ */
+ShadowTournament::ShadowTournament(PID* active, const vector<vector<double> >& candidates, ShadowOptions options,
+                                   double max_angle, double wheelbase)
+        : bank(candidates.size()) {
+    this->active = active;
+    this->options = options;
+    this->max_angle = max_angle;
+    this->wheelbase = wheelbase;
+    for(unsigned int k=0; k<candidates.size(); k++) {
+        bank.Init(k, fabs(candidates[k][0]), fabs(candidates[k][1]), fabs(candidates[k][2]));
+    }
+    steer.assign(bank.size(), 0);
+    sum_divergence.assign(bank.size(), 0);
+    sum_abs.assign(bank.size(), 0);
+    sum.assign(bank.size(), 0);
+    sum_squared.assign(bank.size(), 0);
+    active_abs = active_sum = active_squared = 0;
+
+    frames = 0;
+    rounds = 0;
+    have_last = false;
+    last_steer = 0;
+    last_speed = 0;
+    last_t = epoch_time();
+    latency_us = 0;
+
+    say_time(); cout << "Shadowing " << bank.size() << " candidate controllers, " << options.window;
+    cout << " frames per round." << endl;
+}
+
+
+/*
+ * @brief       Score last frame's shadow commands against this frame's cte, then compute new ones.
+ * @param[in]   cte             The cte just received.
+ * @param[in]   speed           The speed just received [mph].
+ * @param[in]   actual_steer    The command the active controller is sending for this frame.
+ */
+void ShadowTournament::process(double cte, double speed, double actual_steer) {
+    auto start = chrono::steady_clock::now();
+    unsigned int n = bank.size();
+
+    if(have_last) {
+        // First-order response of cte to one period of steering difference:
+        // d(cte) ~= v * dt * d(psi), with d(psi) ~= v / L * d(delta) * dt.
+        double v = last_speed * MPH_TO_MPS;
+        double gain = v * v * NOMINAL_PERIOD * NOMINAL_PERIOD / wheelbase * max_angle * M_PI / 180.0;
+
+        for(unsigned int k=0; k<n; k++) {
+            double diff = steer[k] - last_steer;
+            double c = cte + gain * diff;
+            sum_divergence[k] += diff * diff;
+            sum_abs[k] += fabs(c);
+            sum[k] += c;
+            sum_squared[k] += c * c;
+        }
+        active_abs += fabs(cte);
+        active_sum += cte;
+        active_squared += cte * cte;
+        frames++;
+    }
+
+    long t = epoch_time();
+    double dt = ((double (t)) - last_t) / 49.0;
+    last_t = t;
+    if(!have_last)
+        dt = 1;
+
+    bank.UpdateError(cte, dt);
+    bank.TotalError(steer.data());
+    for(unsigned int k=0; k<n; k++) {
+        steer[k] = max(-1.0, min(1.0, steer[k]));
+    }
+    last_steer = actual_steer;
+    last_speed = speed;
+    have_last = true;
+
+    double elapsed = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    latency_us = 0.99 * latency_us + 0.01 * elapsed;
+
+    if(frames >= options.window) {
+        finish_round();
+    } else if(latency_us > options.budget_us && n > 1) {
+        shed_load();
+    }
+}
+
+
+/*
+ * @brief       The Twiddle objective (2 * MAE + stddev, see twiddle_objective) from running sums.
+ */
+double ShadowTournament::objective(double sabs, double s, double ssq) {
+    double mae = sabs / frames;
+    double mean = s / frames;
+    double variance = (ssq - frames * mean * mean) / max(1u, frames - 1);
+    return twiddle_objective(mae, sqrt(max(0.0, variance)));
+}
+
+
+/*
+ * @brief       Rank the candidates, maybe promote the best, and start a new round.
+ */
+void ShadowTournament::finish_round() {
+    rounds++;
+    double active_objective = objective(active_abs, active_sum, active_squared);
+
+    int best = -1;
+    double best_objective = numeric_limits<double>::infinity();
+    for(unsigned int k=0; k<bank.size(); k++) {
+        double divergence = sqrt(sum_divergence[k] / frames);
+        double o = objective(sum_abs[k], sum[k], sum_squared[k]);
+        if(divergence <= options.max_divergence && o < best_objective) {
+            best_objective = o;
+            best = k;
+        }
+    }
+
+    say_time(); cout << "Shadow round " << rounds << " (" << frames << " frames, " << mean_latency_us();
+    cout << " us/frame): active objective " << active_objective;
+    if(best >= 0) {
+        cout << ", best candidate " << best << " estimated at " << best_objective;
+        cout << " (RMS divergence " << sqrt(sum_divergence[best] / frames) << ")";
+    }
+    cout << "." << endl;
+
+    if(best >= 0 && best_objective < (1.0 - options.margin) * active_objective) {
+        // Swap: the old active gains become a shadow candidate in the promoted one's lane.
+        double Kp = bank.Kp[best], Ki = bank.Ki[best], Kd = bank.Kd[best];
+        bank.Init(best, active->Kp, active->Ki, active->Kd);
+        active->Init(Kp, Ki, Kd);
+        say_time(); cout << "Promoted shadow candidate " << best << " to active control." << endl;
+        say_time(); vec_print(vector<double>({Kp, Ki, Kd}), "p");
+    }
+
+    fill(sum_divergence.begin(), sum_divergence.end(), 0);
+    fill(sum_abs.begin(), sum_abs.end(), 0);
+    fill(sum.begin(), sum.end(), 0);
+    fill(sum_squared.begin(), sum_squared.end(), 0);
+    active_abs = active_sum = active_squared = 0;
+    frames = 0;
+}
+
+
+/*
+ * @brief       Over the latency budget: drop the worse-scoring half of the candidates.
+ */
+void ShadowTournament::shed_load() {
+    unsigned int n = bank.size();
+    vector<unsigned int> lanes(n);
+    iota(lanes.begin(), lanes.end(), 0);
+    if(frames > 0) {
+        sort(lanes.begin(), lanes.end(), [this](unsigned int a, unsigned int b) {
+            return objective(sum_abs[a], sum[a], sum_squared[a]) < objective(sum_abs[b], sum[b], sum_squared[b]);
+        });
+    }
+    lanes.resize(n / 2);
+
+    vector<double>* fields[] = {&steer, &sum_divergence, &sum_abs, &sum, &sum_squared};
+    for(auto field : fields) {
+        vector<double> kept(lanes.size());
+        for(unsigned int k=0; k<lanes.size(); k++) {
+            kept[k] = (*field)[lanes[k]];
+        }
+        *field = kept;
+    }
+    bank.Select(lanes);
+
+    say_time(); cout << "Shadow update took " << latency_us << " us > budget " << options.budget_us;
+    cout << " us; keeping the best " << bank.size() << " candidates." << endl;
+    // Measure afresh at the new size.
+    latency_us = 0;
+}
+
+
+/*
+ * @brief       Number of shadow candidates.
+ */
+unsigned int ShadowTournament::size() const {
+    return bank.size();
+}
+
+
+/*
+ * @brief       Moving average of the per-frame batch update time [us].
+ */
+double ShadowTournament::mean_latency_us() const {
+    return latency_us;
+}
@@ -0,0 +1,75 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <vector>
+#include "PID.h"
+#include "PIDBank.h"
+
+
+/*
+ * Command-line configurable settings for shadow mode.
+ */
+struct ShadowOptions {
+  unsigned int num_candidates;  // 0 disables shadow mode
+  unsigned int window;          // frames per tournament round
+  double margin;                // relative improvement required for promotion
+  double max_divergence;        // RMS steering difference beyond which the proxy is not trusted
+  double budget_us;             // per-frame latency budget for the batch update [us]
+  double spread;
+  unsigned int seed;
+};
+
+ShadowOptions parse_shadow_options(int argc, char* argv[]);
+
+
+/*
+ * Feed every telemetry frame to a batch of candidate steering controllers
+ * that compute, but never send, their commands.
+ *
+ * A candidate's counterfactual cte is estimated to first order from the
+ * actual cte and the difference between its command and the one sent
+ * (the kinematic response of cte to steering over one period at the current speed).
+ * After each window, the best candidate replaces the active gains if its
+ * estimated objective beats the active one by a margin and it stayed close
+ * enough to the actual commands for that estimate to be meaningful.
+ */
+class ShadowTournament {
+
+private:
+  PID* active;
+  PIDBank bank;
+  ShadowOptions options;
+
+  // Per-candidate accumulators for the current round.
+  std::vector<double> steer;
+  std::vector<double> sum_divergence;
+  std::vector<double> sum_abs;
+  std::vector<double> sum;
+  std::vector<double> sum_squared;
+
+  // The active controller's own statistics over the same frames.
+  double active_abs, active_sum, active_squared;
+
+  unsigned int frames;
+  unsigned int rounds;
+  bool have_last;
+  double last_steer;
+  double last_speed;
+  long last_t;
+  double latency_us;
+  double max_angle;
+  double wheelbase;
+
+  double objective(double sabs, double s, double ssq);
+  void finish_round();
+  void shed_load();
+
+public:
+  ShadowTournament(PID* active, const std::vector<std::vector<double> >& candidates, ShadowOptions options,
+                   double max_angle=25.0, double wheelbase=2.67);
+  void process(double cte, double speed, double actual_steer);
+  unsigned int size() const;
+  double mean_latency_us() const;
+};
+
+#endif /* SHADOW_H */
@@ -0,0 +1,375 @@
+#include "sim_bank.h"
+#include "twiddle.h"
+#include <cmath>
+#include <algorithm>  // std::min, std::max
+
+using namespace std;
+
+// Adding and subtracting 1.5 * 2^52 rounds a double (|x| < 2^51) to the nearest integer,
+// without a call or an instruction that needs SSE4.1.
+static const double ROUND_MAGIC = 6755399441055744.0;
+
+// pi/2 split in two for an exact Cody-Waite reduction (from fdlibm).
+static const double PIO2_HI = 1.57079632673412561417e+00;
+static const double PIO2_LO = 6.07710050650619224932e-11;
+
+
+static inline double round_nearest(double x) {
+    return (x + ROUND_MAGIC) - ROUND_MAGIC;
+}
+
+
+/*
+ * @brief       sin(x) and cos(x) from the fdlibm kernel polynomials, branch-free so loops over it vectorize.
+ *              Accurate to about 1 ulp for |x| up to a few thousand.
+ */
+static inline void fast_sincos(double x, double& sin_x, double& cos_x) {
+    double q = round_nearest(x * (2 / M_PI));
+    double r = (x - q * PIO2_HI) - q * PIO2_LO;
+    double z = r * r;
+
+    double sr = r + r * z * (-1.66666666666666324348e-01 + z * (8.33333333332248946124e-03
+              + z * (-1.98412698298579493134e-04 + z * (2.75573137070700676789e-06
+              + z * (-2.50507602534068634195e-08 + z * 1.58969099521155010221e-10)))));
+    double cr = 1.0 - 0.5 * z + z * z * (4.16666666666666019037e-02 + z * (-1.38888888888741095749e-03
+              + z * (2.48015872894767294178e-05 + z * (-2.75573143513906633035e-07
+              + z * (2.08757232129817482790e-09 + z * -1.13596475577881948265e-11)))));
+
+    // Quadrant q mod 4, as -2, -1, 0, 1 or 2 (where -2 and 2 are the same quadrant).
+    double m = q - 4 * round_nearest(q * 0.25);
+    bool odd = m == 1 || m == -1;
+    double s = odd ? cr : sr;
+    double c = odd ? sr : cr;
+    sin_x = (m == 2 || m == -2 || m == -1) ? -s : s;
+    cos_x = (m == 2 || m == -2 || m == 1) ? -c : c;
+}
+
+
+/*
+ * @brief       sin and cos as the mode requires.
+ */
+template <bool FAST>
+static inline void mode_sincos(double x, double& sin_x, double& cos_x) {
+    if(FAST) {
+        fast_sincos(x, sin_x, cos_x);
+    } else {
+        sin_x = sin(x);
+        cos_x = cos(x);
+    }
+}
+
+
+/*
+ * @brief       One integration substep of all lanes, the same semi-implicit Euler as OfflineSimulator::step.
+ * @param[in]   k           Curvature at each lane's s.
+ * @param[in]   tan_delta   tan of each lane's steering angle.
+ * @param[in]   accel       accel_gain times each lane's throttle.
+ * A crashed lane has v = 0 and accel = 0, so all its increments are exactly 0
+ * and it stays put without a branch.
+ */
+template <bool FAST>
+static void substep(unsigned int n, double h, const SimParams& params,
+                    const double* __restrict__ k, const double* __restrict__ tan_delta,
+                    const double* __restrict__ accel, double* __restrict__ s, double* __restrict__ cte,
+                    double* __restrict__ epsi, double* __restrict__ v) {
+    double drag = params.drag;
+    double wheelbase = params.wheelbase;
+    for(unsigned int i=0; i<n; i++) {
+        double sin_e, cos_e;
+        double vi = v[i] + h * (accel[i] - drag * v[i]);
+        vi = max(0.0, vi);
+        mode_sincos<FAST>(epsi[i], sin_e, cos_e);
+        double sdot = vi * cos_e / (1.0 + k[i] * cte[i]);
+        double ei = epsi[i] + h * (vi / wheelbase * tan_delta[i] - k[i] * sdot);
+        mode_sincos<FAST>(ei, sin_e, cos_e);
+        double ci = cte[i] + h * vi * sin_e;
+        double si = s[i] + h * sdot;
+
+        v[i] = vi;
+        epsi[i] = ei;
+        cte[i] = ci;
+        s[i] = si;
+    }
+}
+
+
+
+/*****************************************************************
+ ***************** A batch of offline simulators. ****************
+ *****************************************************************/
+
+
+/*
+ * @brief       Construct n simulators.
+ * @param[in]   params      Vehicle and track parameters, shared by all lanes.
+ * @param[in]   seed        Seed for the measurement noise of every lane; see set_seeds.
+ * @param[in]   mode        Reference (bit-identical to OfflineSimulator) or fast trigonometry.
+ */
+SimBank::SimBank(unsigned int n, SimParams params, unsigned int seed, sim_bank_mode_t mode)
+        : params(params), mode(mode), n(n) {
+    this->params.delay = min(params.delay, (unsigned int) MAX_DELAY);
+    seeds.assign(n, seed);
+    rngs.resize(n);
+    noise.assign(n, normal_distribution<double>(0.0, 1.0));
+    tan_delta.assign(n, 0);
+    accel.assign(n, 0);
+    k.assign(n, 0);
+    reset();
+}
+
+
+unsigned int SimBank::size() const {
+    return n;
+}
+
+
+/*
+ * @brief       Give each lane its own noise seed, and reset.
+ */
+void SimBank::set_seeds(const vector<unsigned int>& seeds) {
+    for(unsigned int i=0; i<n && i<seeds.size(); i++) {
+        this->seeds[i] = seeds[i];
+    }
+    reset();
+}
+
+
+/*
+ * @brief       Put all cars back at the start line.
+ */
+void SimBank::reset() {
+    for(unsigned int i=0; i<n; i++) {
+        rngs[i].seed(seeds[i]);
+        noise[i].reset();
+    }
+    s.assign(n, 0);
+    cte.assign(n, params.initial_cte);
+    epsi.assign(n, 0);
+    v.assign(n, params.initial_speed * MPH2MPS);
+    angle.assign(n, 0);
+    crashed.assign(n, 0);
+    steps = 0;
+}
+
+
+/*
+ * @brief       Curvature at each lane's s, with libm as in OfflineSimulator::curvature.
+ */
+void SimBank::curvature_reference() {
+    for(unsigned int i=0; i<n; i++) {
+        double ki = 0;
+        double phase = 2 * M_PI * s[i] / params.lap_length;
+        for(unsigned int j=0; j<NUM_HARMONICS; j++) {
+            ki += CURVATURE_AMPLITUDES[j] * sin((j + 1) * phase + CURVATURE_PHASES[j]);
+        }
+        k[i] = ki;
+    }
+}
+
+
+/*
+ * @brief       Curvature at each lane's s from one sin and cos of the phase:
+ *              the higher harmonics follow by angle addition.
+ */
+void SimBank::curvature_fast() {
+    double sin_c[NUM_HARMONICS], cos_c[NUM_HARMONICS];
+    for(unsigned int j=0; j<NUM_HARMONICS; j++) {
+        sin_c[j] = CURVATURE_AMPLITUDES[j] * sin(CURVATURE_PHASES[j]);
+        cos_c[j] = CURVATURE_AMPLITUDES[j] * cos(CURVATURE_PHASES[j]);
+    }
+    double lap = params.lap_length;
+    const double* __restrict__ sp = s.data();
+    double* __restrict__ kp = k.data();
+    for(unsigned int i=0; i<n; i++) {
+        // Within half a lap of the start, so the phase is in [-pi, pi].
+        double si = sp[i] - lap * round_nearest(sp[i] / lap);
+        double sin_1, cos_1;
+        fast_sincos(2 * M_PI * si / lap, sin_1, cos_1);
+
+        double sin_h = sin_1, cos_h = cos_1;
+        double ki = 0;
+        for(unsigned int j=0; j<NUM_HARMONICS; j++) {
+            // A sin(h phase + c) = sin(h phase) A cos(c) + cos(h phase) A sin(c)
+            ki += sin_h * cos_c[j] + cos_h * sin_c[j];
+            double next_sin = sin_h * cos_1 + cos_h * sin_1;
+            cos_h = cos_h * cos_1 - sin_h * sin_1;
+            sin_h = next_sin;
+        }
+        kp[i] = ki;
+    }
+}
+
+
+/*
+ * @brief       Advance every lane one control period, as OfflineSimulator::step.
+ * @param[in]   steer       n steering commands in [-1, 1].
+ * @param[in]   throttle    n throttle commands in [-1, 1].
+ */
+void SimBank::step(const double* steer, const double* throttle) {
+    steps++;
+
+    bool fast = mode == SIM_BANK_FAST;
+    for(unsigned int i=0; i<n; i++) {
+        double steer_i = max(-1.0, min(1.0, steer[i]));
+        double throttle_i = max(-1.0, min(1.0, throttle[i]));
+        // Crashed cars keep their last angle, as OfflineSimulator does.
+        angle[i] = crashed[i] ? angle[i] : steer_i * params.max_angle;
+        accel[i] = crashed[i] ? 0.0 : params.accel_gain * throttle_i;
+    }
+    // Constant over the substeps, unlike the curvature.
+    for(unsigned int i=0; i<n; i++) {
+        double delta = angle[i] * M_PI / 180.0;
+        if(fast) {
+            double sin_d, cos_d;
+            fast_sincos(delta, sin_d, cos_d);
+            tan_delta[i] = sin_d / cos_d;
+        } else {
+            tan_delta[i] = tan(delta);
+        }
+    }
+
+    double h = params.dt / params.substeps;
+    for(unsigned int j=0; j<params.substeps; j++) {
+        if(fast) {
+            curvature_fast();
+            substep<true>(n, h, params, k.data(), tan_delta.data(), accel.data(),
+                          s.data(), cte.data(), epsi.data(), v.data());
+        } else {
+            curvature_reference();
+            substep<false>(n, h, params, k.data(), tan_delta.data(), accel.data(),
+                           s.data(), cte.data(), epsi.data(), v.data());
+        }
+    }
+
+    for(unsigned int i=0; i<n; i++) {
+        if(fabs(cte[i]) > params.road_halfwidth) {
+            crashed[i] = 1;
+            v[i] = 0;
+        }
+    }
+}
+
+
+/*
+ * @brief       The cte of each lane as reported in telemetry, including measurement noise.
+ * @param[out]  out         n values
+ */
+void SimBank::measured_cte(double* out) {
+    for(unsigned int i=0; i<n; i++) {
+        out[i] = cte[i];
+    }
+    if(params.cte_noise > 0) {
+        for(unsigned int i=0; i<n; i++) {
+            out[i] += params.cte_noise * noise[i](rngs[i]);
+        }
+    }
+}
+
+
+/*
+ * @brief       Each lane's speed in the simulator's telemetry unit.
+ * @param[out]  out         n values
+ */
+void SimBank::speed_mph(double* out) const {
+    for(unsigned int i=0; i<n; i++) {
+        out[i] = v[i] / MPH2MPS;
+    }
+}
+
+
+/*
+ * @brief       Number of lanes that left the road.
+ */
+unsigned int SimBank::num_crashed() const {
+    unsigned int count = 0;
+    for(unsigned int i=0; i<n; i++) {
+        count += crashed[i];
+    }
+    return count;
+}
+
+
+/*
+ * @brief       Getter for the simulator configuration.
+ */
+const SimParams& SimBank::get_params() const {
+    return params;
+}
+
+
+/*
+ * @brief       Run the closed loop of every lane for a number of control periods.
+ * @param[out]  history     nsamples * sim.size() values: lane 0's measured cte, then lane 1's, ...
+ */
+void simulate_bank(SimBank& sim, PIDBank& pid_steering, PIDBank& pid_throttle,
+                   unsigned int nsamples, double* history) {
+    unsigned int n = sim.size();
+    vector<double> cte(n), speed_error(n);
+    double target_speed = sim.get_params().target_speed;
+    double dt = sim.get_params().dt / SIM_DT;
+
+    // Commands in flight for the actuation delay, one row of n lanes per control period.
+    unsigned int slots = sim.get_params().delay + 1;
+    vector<double> steer_queue(slots * n, 0), throttle_queue(slots * n, 0);
+
+    for(unsigned int t=0; t<nsamples; t++) {
+        sim.measured_cte(cte.data());
+        for(unsigned int i=0; i<n; i++) {
+            history[(size_t) i * nsamples + t] = cte[i];
+        }
+
+        sim.speed_mph(speed_error.data());
+        for(unsigned int i=0; i<n; i++) {
+            speed_error[i] -= target_speed;
+        }
+        pid_steering.UpdateError(cte.data(), dt);
+        pid_throttle.UpdateError(speed_error.data(), dt);
+
+        double* steer = &steer_queue[(t % slots) * n];
+        double* throttle = &throttle_queue[(t % slots) * n];
+        pid_steering.TotalError(steer);
+        pid_throttle.TotalError(throttle);
+        for(unsigned int i=0; i<n; i++) {
+            steer[i] = max(-1.0, min(1.0, steer[i]));
+            throttle[i] = max(throttle[i], 0.0);
+        }
+        unsigned int applied = (t + 1) % slots;
+        sim.step(&steer_queue[applied * n], &throttle_queue[applied * n]);
+    }
+}
+
+
+/*
+ * @brief       Evaluate many parameter vectors on fresh offline simulators, all in one SimBank.
+ * @param[in]   params      One vector per lane, as for evaluate_offline
+ * @return      The Twiddle objective of each vector; in reference mode exactly what evaluate_offline returns
+ */
+vector<double> evaluate_offline_batch(const vector<vector<double> >& params,
+                                      unsigned int nsamples, unsigned int ndiscard,
+                                      SimParams sim_params, unsigned int seed, sim_bank_mode_t mode) {
+    unsigned int n = params.size();
+    PIDBank pid_steering(n);
+    PIDBank pid_throttle(n);
+    for(unsigned int i=0; i<n; i++) {
+        const vector<double>& p = params[i];
+        pid_steering.Init(i, fabs(p[0]), fabs(p[1]), fabs(p[2]));
+        if(p.size() >= 6) {
+            pid_throttle.Init(i, fabs(p[3]), fabs(p[4]), fabs(p[5]));
+        } else {
+            pid_throttle.Init(i, 0.3, 0, 0.02);
+        }
+    }
+
+    SimBank sim(n, sim_params, seed, mode);
+    unsigned int length = nsamples + ndiscard;
+    vector<double> history((size_t) n * length);
+    simulate_bank(sim, pid_steering, pid_throttle, length, history.data());
+
+    vector<double> objectives(n);
+    for(unsigned int i=0; i<n; i++) {
+        auto lane = history.begin() + (size_t) i * length;
+        vector<double> errors(lane + ndiscard, lane + length);
+        objectives[i] = twiddle_objective(errors);
+    }
+    return objectives;
+}
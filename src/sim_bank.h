@@ -0,0 +1,93 @@
+#ifndef SIM_BANK_H
+#define SIM_BANK_H
+
+#include <vector>
+#include <random>
+#include "offline_sim.h"
+#include "PIDBank.h"
+
+
+/*
+ * How a SimBank evaluates the model's trigonometry.
+ *
+ * SIM_BANK_REFERENCE calls libm like OfflineSimulator, so every lane matches
+ * the scalar simulator bit for bit. SIM_BANK_FAST uses inline polynomials and
+ * evaluates the curvature harmonics by angle addition, so the compiler can
+ * vectorize the lane loops; it agrees with the reference to about 1e-15 per step,
+ * which chaotic runs (e.g. near a crash) can amplify.
+ */
+enum sim_bank_mode_enum {
+  SIM_BANK_REFERENCE,
+  SIM_BANK_FAST,
+};
+typedef enum sim_bank_mode_enum sim_bank_mode_t;
+
+
+/*
+ * A batch of OfflineSimulator cars on the same track, stepped in lockstep.
+ *
+ * As in PIDBank, the state is one array per quantity (structure of arrays),
+ * so a step over all lanes is a few tight loops, one per substep.
+ * Every lane starts like OfflineSimulator(params, seed), unless set_seeds
+ * gives them different noise.
+ */
+class SimBank {
+
+private:
+  SimParams params;
+  sim_bank_mode_t mode;
+  unsigned int n;
+  std::vector<unsigned int> seeds;
+  std::vector<std::mt19937> rngs;
+  std::vector<std::normal_distribution<double> > noise;
+
+  // Per-step scratch.
+  std::vector<double> tan_delta;
+  std::vector<double> accel;
+  std::vector<double> k;
+
+  void curvature_reference();
+  void curvature_fast();
+
+public:
+  /*
+   * State, one entry per lane; see OfflineSimulator.
+   */
+  std::vector<double> s;
+  std::vector<double> cte;
+  std::vector<double> epsi;
+  std::vector<double> v;
+  std::vector<double> angle;
+  std::vector<unsigned char> crashed;
+  unsigned long steps;
+
+  SimBank(unsigned int n, SimParams params=SimParams(), unsigned int seed=0,
+          sim_bank_mode_t mode=SIM_BANK_FAST);
+
+  unsigned int size() const;
+  void set_seeds(const std::vector<unsigned int>& seeds);
+  void reset();
+  void step(const double* steer, const double* throttle);
+  void measured_cte(double* out);
+  void speed_mph(double* out) const;
+  unsigned int num_crashed() const;
+  const SimParams& get_params() const;
+};
+
+
+/*
+ * Drive a SimBank with banks of steering and throttle PIDs, lane by lane as
+ * simulate_cte does. history (nsamples values per lane, lane after lane) gets the measured cte.
+ */
+void simulate_bank(SimBank& sim, PIDBank& pid_steering, PIDBank& pid_throttle,
+                   unsigned int nsamples, double* history);
+
+/*
+ * evaluate_offline for many parameter vectors at once, one lane each.
+ */
+std::vector<double> evaluate_offline_batch(const std::vector<std::vector<double> >& params,
+                                           unsigned int nsamples, unsigned int ndiscard,
+                                           SimParams sim_params=SimParams(), unsigned int seed=0,
+                                           sim_bank_mode_t mode=SIM_BANK_FAST);
+
+#endif /* SIM_BANK_H */
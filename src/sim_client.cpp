@@ -0,0 +1,328 @@
+#include <uWS/uWS.h>
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cmath>
+#include <cstdio>     // snprintf
+#include <cstring>    // strcmp
+#include <cstdlib>    // atoi, atof
+#include <algorithm>  // std::min, std::max
+#include "json.hpp"
+
+#include "offline_sim.h"
+#include "track.h"
+#include "track_sim.h"
+#include "sketch.h"
+#include "say_time.h"
+
+// Set parameters.
+#define HOST "127.0.0.1"
+#define PORT 4567
+#define FRAMES 2000
+
+// for convenience
+using json = nlohmann::json;
+
+typedef std::chrono::steady_clock Clock;
+
+
+/*
+ * One simulated car, connected as the Unity simulator would be.
+ */
+struct SimConnection {
+    unsigned int id;
+    TrackSimulator sim;
+    uWS::WebSocket<uWS::CLIENT>* ws = nullptr;
+    bool done = false;
+
+    // Last command received; held until the next one, as Unity does.
+    double steer = 0;
+    double throttle = 0;
+
+    unsigned long frames = 0;
+    unsigned long episode_frames = 0;
+    unsigned int episodes = 1;
+    unsigned int crashes = 0;
+    double sum_abs_cte = 0;
+
+    Clock::time_point sent_at;
+    KLLSketch round_trip_ms;
+
+    SimConnection(unsigned int id, const Track& track, SimParams params) : id(id), sim(track, params, id) {}
+};
+
+
+/*
+ * Command-line settings.
+ */
+struct ClientOptions {
+    std::string host = HOST;
+    int port = PORT;
+    unsigned int connections = 1;
+    unsigned long frames = FRAMES;
+    unsigned long episode_frames = 0;
+    double speedup = 1;
+    bool lockstep = false;
+    double max_mae = 0;
+    std::string track;      // waypoints file; empty for the synthetic track
+    double spacing = 0;
+    SimParams sim;
+};
+
+
+/*
+ * @brief       Send the car's current state as a Unity telemetry event. Unity sends numbers as strings.
+ */
+void send_telemetry(SimConnection& c) {
+    char cte[32], speed[32], angle[32], throttle[32];
+    snprintf(cte, sizeof(cte), "%.4f", c.sim.measured_cte());
+    snprintf(speed, sizeof(speed), "%.4f", c.sim.speed_mph());
+    snprintf(angle, sizeof(angle), "%.4f", c.sim.angle);
+    snprintf(throttle, sizeof(throttle), "%.4f", c.throttle);
+    std::string msg = std::string("42[\"telemetry\",{\"cte\":\"") + cte + "\",\"speed\":\"" + speed
+                      + "\",\"steering_angle\":\"" + angle + "\",\"throttle\":\"" + throttle + "\",\"image\":\"\"}]";
+    c.sent_at = Clock::now();
+    c.ws->send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+}
+
+
+/*
+ * @brief       Put the car back at the start line for a new episode.
+ */
+void reset(SimConnection& c) {
+    c.sim.reset();
+    c.steer = c.throttle = 0;
+    c.episode_frames = 0;
+    c.episodes++;
+}
+
+
+/*
+ * @brief       Advance the car one frame with the last command, and account for it.
+ * @return      Whether the connection has sent all its frames.
+ */
+bool step(SimConnection& c, const ClientOptions& options) {
+    bool was_crashed = c.sim.crashed;
+    c.sim.step(c.steer, c.throttle);
+    c.frames++;
+    c.episode_frames++;
+    c.sum_abs_cte += fabs(c.sim.cte);
+
+    if(c.sim.crashed && !was_crashed) {
+        c.crashes++;
+        say_time(); std::cout << "Car " << c.id << " left the road " << c.episode_frames << " frames into episode "
+                              << c.episodes << "." << std::endl;
+    }
+    if(options.episode_frames > 0 && c.episode_frames >= options.episode_frames)
+        reset(c);
+    return c.frames >= options.frames;
+}
+
+
+ClientOptions parse_client_options(int argc, char* argv[]) {
+    ClientOptions options;
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--host") == 0 && has_value) {
+            options.host = argv[++i];
+        } else if(strcmp(argv[i], "--port") == 0 && has_value) {
+            options.port = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--connections") == 0 && has_value) {
+            options.connections = std::max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--frames") == 0 && has_value) {
+            options.frames = atol(argv[++i]);
+        } else if(strcmp(argv[i], "--episode-frames") == 0 && has_value) {
+            options.episode_frames = atol(argv[++i]);
+        } else if(strcmp(argv[i], "--speedup") == 0 && has_value) {
+            options.speedup = std::max(1e-3, atof(argv[++i]));
+        } else if(strcmp(argv[i], "--lockstep") == 0) {
+            options.lockstep = true;
+        } else if(strcmp(argv[i], "--max-mae") == 0 && has_value) {
+            options.max_mae = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--noise") == 0 && has_value) {
+            options.sim.cte_noise = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--initial-cte") == 0 && has_value) {
+            options.sim.initial_cte = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--track") == 0 && has_value) {
+            options.track = argv[++i];
+        } else if(strcmp(argv[i], "--spacing") == 0 && has_value) {
+            options.spacing = atof(argv[++i]);
+        }
+    }
+    return options;
+}
+
+
+/*
+ * Everything the event loop's callbacks share.
+ */
+struct ClientState {
+    ClientOptions options;
+    std::vector<SimConnection*> cars;
+    unsigned int finished = 0;
+    Clock::time_point start;
+};
+
+
+/*
+ * @brief       Print each car's results and exit, with status 1 if a car never connected
+ *              or (with --max-mae) drove worse than allowed.
+ */
+void summarize(ClientState& state) {
+    double seconds = std::chrono::duration<double>(Clock::now() - state.start).count();
+    unsigned long total_frames = 0;
+    bool failed = false;
+    for(auto c : state.cars) {
+        total_frames += c->frames;
+        double mae = c->frames > 0 ? c->sum_abs_cte / c->frames : NAN;
+        TailQuantiles rtt = tail_quantiles(c->round_trip_ms);
+        say_time(); std::cout << "Car " << c->id << ": " << c->frames << " frames, " << c->episodes << " episodes, "
+                              << c->crashes << " crashes, MAE " << mae << ", round trip p50/p99/max = "
+                              << rtt.p50 << "/" << rtt.p99 << "/" << rtt.max << " ms" << std::endl;
+        if(c->frames == 0 || (state.options.max_mae > 0 && !(mae <= state.options.max_mae)))
+            failed = true;
+    }
+    say_time(); std::cout << total_frames << " frames in " << seconds << " s (" << total_frames / seconds
+                          << " frames/s)." << std::endl;
+    exit(failed ? 1 : 0);
+}
+
+
+/*
+ * @brief       Stop driving a car; once all are stopped, summarize.
+ */
+void finish(ClientState& state, SimConnection& c) {
+    if(c.done)
+        return;
+    c.done = true;
+    if(c.ws)
+        c.ws->close();
+    if(++state.finished == state.cars.size())
+        summarize(state);
+}
+
+
+/*
+ * @brief       In real-time mode, every car advances one frame per tick, answered or not, as in Unity.
+ */
+void on_tick(uv_timer_t* handle) {
+    ClientState& state = *(ClientState*) handle->data;
+    for(auto c : state.cars) {
+        if(!c->ws || c->done)
+            continue;
+        if(step(*c, state.options)) {
+            finish(state, *c);
+        } else {
+            send_telemetry(*c);
+        }
+    }
+}
+
+
+/*
+ * Stand in for the Unity simulator: connect to pid or twiddle on port 4567 as one or more
+ * cars driving the offline vehicle model on a track, send telemetry events and apply the steer replies.
+ *
+ *   ./sim_client [--host H] [--port P] [--connections N] [--frames N] [--episode-frames N]
+ *                [--speedup X | --lockstep] [--noise SIGMA] [--initial-cte M] [--max-mae X]
+ *                [--track waypoints.csv [--spacing M]]
+ *
+ * The track is loaded from a file of "x,y" waypoints, as ./track does, or is the synthetic
+ * 1 km loop; cte is the car's distance to its centerline. By default each car sends a frame
+ * every 49 ms (divided by --speedup) whether or not the last was answered, like Unity;
+ * --lockstep instead sends the next frame as soon as the reply arrives, as fast as the
+ * server goes. A "reset" event, or --episode-frames, puts a car back at the start.
+ */
+int main(int argc, char* argv[]) {
+    ClientState state;
+    state.options = parse_client_options(argc, argv);
+    const ClientOptions& options = state.options;
+    Track track;
+    if(options.track.empty()) {
+        std::vector<double> x, y;
+        synthetic_waypoints(x, y);
+        track.set_waypoints(x, y, options.spacing);
+    } else if(!track.load(options.track, options.spacing)) {
+        std::cerr << "Could not read at least three waypoints from " << options.track << std::endl;
+        return 2;
+    }
+    say_time(); std::cout << "Track of " << track.size() << " waypoints, " << track.get_length() << " m per lap." << std::endl;
+    for(unsigned int i=0; i<options.connections; i++) {
+        state.cars.push_back(new SimConnection(i, track, options.sim));
+    }
+
+    uWS::Hub h;
+
+    h.onConnection([](uWS::WebSocket<uWS::CLIENT> ws, uWS::HttpRequest req) {
+        SimConnection* c = (SimConnection*) ws.getUserData();
+        c->ws = new uWS::WebSocket<uWS::CLIENT>(ws);
+        say_time(); std::cout << "Car " << c->id << " connected." << std::endl;
+        send_telemetry(*c);
+    });
+
+    h.onError([&state](void* user) {
+        SimConnection* c = (SimConnection*) user;
+        say_time(); std::cout << "Car " << c->id << " could not connect." << std::endl;
+        finish(state, *c);
+    });
+
+    h.onMessage([&state](uWS::WebSocket<uWS::CLIENT> ws, char *data, size_t length, uWS::OpCode opCode) {
+        SimConnection* c = (SimConnection*) ws.getUserData();
+        if(!c || c->done || length <= 2 || data[0] != '4' || data[1] != '2')
+            return;
+        std::string s(data + 2, length - 2);
+        json j = json::parse(s);
+        std::string event = j[0].get<std::string>();
+
+        if(event == "reset") {
+            // A reset follows the steer reply to the same frame, which already drives the next one.
+            reset(*c);
+            say_time(); std::cout << "Car " << c->id << " reset, episode " << c->episodes << "." << std::endl;
+            return;
+        } else if(event == "steer") {
+            c->steer = j[1]["steering_angle"].get<double>();
+            c->throttle = j[1]["throttle"].get<double>();
+            c->round_trip_ms.add(std::chrono::duration<double, std::milli>(Clock::now() - c->sent_at).count());
+        } else if(event != "manual") {
+            return;
+        }
+
+        if(state.options.lockstep) {
+            if(step(*c, state.options)) {
+                finish(state, *c);
+            } else {
+                send_telemetry(*c);
+            }
+        }
+    });
+
+    h.onDisconnection([&state](uWS::WebSocket<uWS::CLIENT> ws, int code, char *message, size_t length) {
+        SimConnection* c = (SimConnection*) ws.getUserData();
+        if(!c)
+            return;
+        if(!c->done) {
+            say_time(); std::cout << "Car " << c->id << " was disconnected after " << c->frames << " frames." << std::endl;
+        }
+        delete c->ws;
+        c->ws = nullptr;
+        finish(state, *c);
+    });
+
+    // The path the Unity simulator's Socket.IO client uses; the servers ignore it.
+    std::string uri = "ws://" + options.host + ":" + std::to_string(options.port) + "/socket.io/?EIO=4&transport=websocket";
+    for(auto c : state.cars) {
+        h.connect(uri, c);
+    }
+    state.start = Clock::now();
+
+    uv_timer_t timer;
+    if(!options.lockstep) {
+        uint64_t period_ms = std::max(1.0, round(options.sim.dt * 1000 / options.speedup));
+        timer.data = &state;
+        uv_timer_init(h.getLoop(), &timer);
+        uv_timer_start(&timer, on_tick, period_ms, period_ms);
+    }
+
+    h.run();
+    summarize(state);
+}
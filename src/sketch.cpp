@@ -0,0 +1,215 @@
+#include "sketch.h"
+#include <cmath>
+#include <limits>
+#include <utility>    // pair
+#include <algorithm>  // sort, max
+
+using namespace std;
+
+// Capacity ratio between consecutive levels, from the top down.
+static const double LEVEL_RATIO = 2.0 / 3.0;
+
+
+/*
+ * @brief       Construct an empty sketch.
+ * @param[in]   k           Capacity of the top level; rank error is about 1.7 / k.
+ */
+KLLSketch::KLLSketch(unsigned int k) {
+    this->k = std::max(8u, k);
+    random_state = 0x9e3779b97f4a7c15ull;
+    clear();
+}
+
+
+/*
+ * @brief       Forget all samples, keeping the buffers.
+ */
+void KLLSketch::clear() {
+    for(auto& c : compactors) {
+        c.clear();
+    }
+    if(compactors.empty())
+        compactors.resize(1);
+    height = 1;
+    max_retained = total_capacity();
+    num_retained = 0;
+    n = 0;
+    min_value = numeric_limits<double>::infinity();
+    max_value = -numeric_limits<double>::infinity();
+}
+
+
+/*
+ * @brief       How many values a level may hold before it is compacted.
+ */
+unsigned int KLLSketch::capacity(unsigned int level) const {
+    unsigned int depth = height - level - 1;
+    return std::max(2u, (unsigned int) ceil(k * pow(LEVEL_RATIO, depth)));
+}
+
+
+size_t KLLSketch::total_capacity() const {
+    size_t total = 0;
+    for(unsigned int h=0; h<height; h++) {
+        total += capacity(h);
+    }
+    return total;
+}
+
+
+/*
+ * @brief       Add a level on top; every level below gets a little smaller.
+ */
+void KLLSketch::grow() {
+    height++;
+    if(compactors.size() < height)
+        compactors.resize(height);
+    max_retained = total_capacity();
+}
+
+
+/*
+ * @brief       A fair coin, from a xorshift generator (deterministic per sketch).
+ */
+bool KLLSketch::random_bit() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state & 1;
+}
+
+
+/*
+ * @brief       Compact the lowest full level(s) until the sketch fits again.
+ */
+void KLLSketch::compress() {
+    for(unsigned int h=0; h<height; h++) {
+        if(compactors[h].size() < capacity(h))
+            continue;
+        if(h + 1 == height)
+            grow();
+        vector<double>& level = compactors[h];
+        vector<double>& next = compactors[h + 1];
+
+        // Promote every other value of the sorted level; an odd one out stays.
+        sort(level.begin(), level.end());
+        size_t keep = level.size() % 2;
+        size_t promoted = 0;
+        for(size_t i=keep+random_bit(); i<level.size(); i+=2) {
+            next.push_back(level[i]);
+            promoted++;
+        }
+        num_retained -= level.size() - keep - promoted;
+        level.resize(keep);
+
+        if(num_retained < max_retained)
+            break;
+    }
+}
+
+
+/*
+ * @brief       Add one sample.
+ */
+void KLLSketch::add(double x) {
+    compactors[0].push_back(x);
+    num_retained++;
+    n++;
+    min_value = std::min(min_value, x);
+    max_value = std::max(max_value, x);
+    if(num_retained >= max_retained)
+        compress();
+}
+
+
+/*
+ * @brief       Add all of another sketch's samples (approximately) to this one.
+ */
+void KLLSketch::merge(const KLLSketch& other) {
+    if(other.n == 0)
+        return;
+    while(height < other.height) {
+        grow();
+    }
+    for(unsigned int h=0; h<other.height; h++) {
+        compactors[h].insert(compactors[h].end(), other.compactors[h].begin(), other.compactors[h].end());
+        num_retained += other.compactors[h].size();
+    }
+    n += other.n;
+    min_value = std::min(min_value, other.min_value);
+    max_value = std::max(max_value, other.max_value);
+    while(num_retained >= max_retained) {
+        size_t before = num_retained;
+        compress();
+        if(num_retained == before)
+            break;
+    }
+}
+
+
+/*
+ * @brief       Approximate q-quantile (exact for q = 0 and q = 1); NaN if empty.
+ */
+double KLLSketch::quantile(double q) const {
+    if(n == 0)
+        return numeric_limits<double>::quiet_NaN();
+    if(q <= 0)
+        return min_value;
+    if(q >= 1)
+        return max_value;
+
+    vector<pair<double, uint64_t>>& weighted = scratch;
+    weighted.clear();
+    weighted.reserve(num_retained);
+    uint64_t total = 0;
+    for(unsigned int h=0; h<height; h++) {
+        for(auto x : compactors[h]) {
+            weighted.push_back(make_pair(x, 1ull << h));
+            total += 1ull << h;
+        }
+    }
+    sort(weighted.begin(), weighted.end());
+
+    double target = q * total;
+    uint64_t cumulative = 0;
+    for(auto& w : weighted) {
+        cumulative += w.second;
+        if(cumulative >= target)
+            return w.first;
+    }
+    return max_value;
+}
+
+
+/*
+ * @brief       Number of samples added (including merged ones).
+ */
+uint64_t KLLSketch::count() const {
+    return n;
+}
+
+
+/*
+ * @brief       Number of values currently stored.
+ */
+size_t KLLSketch::retained() const {
+    return num_retained;
+}
+
+
+double KLLSketch::min() const {
+    return min_value;
+}
+
+
+double KLLSketch::max() const {
+    return max_value;
+}
+
+
+/*
+ * @brief       Median, 95th and 99th percentiles and maximum of a sketch.
+ */
+TailQuantiles tail_quantiles(const KLLSketch& sketch) {
+    return {sketch.quantile(0.5), sketch.quantile(0.95), sketch.quantile(0.99), sketch.max()};
+}
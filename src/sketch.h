@@ -0,0 +1,65 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+/*
+ * KLL quantile sketch (Karnin, Lang, Liberty 2016).
+ *
+ * Keeps a stack of compactors; level h holds values standing for 2^h samples each.
+ * When the sketch is over capacity, the lowest full level is sorted and every
+ * other value (from a random offset) is promoted to the next level. Memory stays
+ * around 3k values however many samples are added, the rank error is about
+ * 1.7 / k with high probability, and sketches built with the same k can be merged.
+ * The exact minimum and maximum are tracked separately.
+ * Buffers are kept when cleared, so a reused sketch stops allocating once warm.
+ */
+class KLLSketch {
+
+private:
+  unsigned int k;
+  std::vector<std::vector<double>> compactors;
+  unsigned int height;  // levels in use; compactors may hold spare ones from before a clear()
+  size_t num_retained;
+  size_t max_retained;  // total_capacity() at the current height
+  uint64_t n;
+  double min_value, max_value;
+  uint64_t random_state;
+
+  // Weighted values sorted by quantile(), kept so that queries stop allocating once warm too
+  // (and so one sketch must not be queried from two threads at once).
+  mutable std::vector<std::pair<double, uint64_t>> scratch;
+
+  unsigned int capacity(unsigned int level) const;
+  size_t total_capacity() const;
+  void grow();
+  void compress();
+  bool random_bit();
+
+public:
+  KLLSketch(unsigned int k=200);
+  void add(double x);
+  void merge(const KLLSketch& other);
+  void clear();
+
+  double quantile(double q) const;
+  uint64_t count() const;
+  size_t retained() const;
+  double min() const;
+  double max() const;
+};
+
+
+/*
+ * The usual tail summary of a sketch.
+ */
+struct TailQuantiles {
+  double p50, p95, p99, max;
+};
+
+TailQuantiles tail_quantiles(const KLLSketch& sketch);
+
+#endif /* SKETCH_H */
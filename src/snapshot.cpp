@@ -0,0 +1,52 @@
+#include "snapshot.h"
+#include "twiddle.h"
+#include <cmath>
+#include <type_traits>
+
+using namespace std;
+
+
+/*
+ * @brief       Capture the closed loop's state; the PIDs' coefficients are not part of it.
+ */
+LoopSnapshot take_snapshot(const OfflineSimulator& sim, const PID& pid_steering, const PID& pid_throttle) {
+    static_assert(is_trivially_copyable<LoopSnapshot>::value, "LoopSnapshot must be memcpy-able");
+    LoopSnapshot snapshot;
+    snapshot.sim = sim.save();
+    snapshot.steering = pid_steering.save();
+    snapshot.throttle = pid_throttle.save();
+    return snapshot;
+}
+
+
+/*
+ * @brief       Put the closed loop back in a captured state, keeping the PIDs' coefficients.
+ */
+void restore_snapshot(const LoopSnapshot& snapshot, OfflineSimulator& sim, PID& pid_steering, PID& pid_throttle) {
+    sim.restore(snapshot.sim);
+    pid_steering.restore(snapshot.steering);
+    pid_throttle.restore(snapshot.throttle);
+}
+
+
+/*
+ * @brief       Evaluate a parameter vector from a snapshot.
+ * @param[in]   params      {Kp, Ki, Kd} for steering, optionally followed by {Kp, Ki, Kd} for throttle
+ * @param[in]   sim_params  The parameters of the simulator the snapshot was taken from
+ * @return      The Twiddle objective of the next nsamples measured cte values
+ */
+double evaluate_from(const LoopSnapshot& snapshot, const vector<double>& params, unsigned int nsamples,
+                     SimParams sim_params) {
+    OfflineSimulator sim(sim_params);
+    PID pid_steering;
+    PID pid_throttle;
+    restore_snapshot(snapshot, sim, pid_steering, pid_throttle);
+
+    pid_steering.Init(fabs(params[0]), fabs(params[1]), fabs(params[2]));
+    if(params.size() >= 6) {
+        pid_throttle.Init(fabs(params[3]), fabs(params[4]), fabs(params[5]));
+    } else {
+        pid_throttle.Init(0.3, 0, 0.02);
+    }
+    return twiddle_objective(simulate_cte(sim, pid_steering, pid_throttle, nsamples));
+}
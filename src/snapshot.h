@@ -0,0 +1,30 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <vector>
+#include "offline_sim.h"
+#include "PID.h"
+
+
+/*
+ * The state of the offline closed loop, plant and both controllers, as plain
+ * data: a few KB that copy with memcpy, so a run can be forked any number of
+ * times and each fork continued with different gains from the identical state.
+ */
+struct LoopSnapshot {
+  SimState sim;
+  PIDState steering;
+  PIDState throttle;
+};
+
+LoopSnapshot take_snapshot(const OfflineSimulator& sim, const PID& pid_steering, const PID& pid_throttle);
+void restore_snapshot(const LoopSnapshot& snapshot, OfflineSimulator& sim, PID& pid_steering, PID& pid_throttle);
+
+/*
+ * Score a parameter vector, as for evaluate_offline, on a run continued from a snapshot
+ * instead of the start line. Thread-safe: the snapshot is only read.
+ */
+double evaluate_from(const LoopSnapshot& snapshot, const std::vector<double>& params, unsigned int nsamples,
+                     SimParams sim_params=SimParams());
+
+#endif /* SNAPSHOT_H */
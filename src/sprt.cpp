@@ -0,0 +1,110 @@
+#include "sprt.h"
+#include <cmath>
+#include <cstring>    // strcmp
+#include <cstdlib>    // atoi, atof
+#include <algorithm>  // max
+
+using namespace std;
+
+
+PairedSPRT::PairedSPRT(double alpha, double beta, double rel_delta, unsigned int min_pairs, unsigned int max_pairs)
+        : alpha(alpha), beta(beta), rel_delta(rel_delta),
+          min_pairs(max(2u, min_pairs)), max_pairs(max(min_pairs, max_pairs)) {
+    clear();
+}
+
+
+/*
+ * @brief       Start a new test.
+ */
+void PairedSPRT::clear() {
+    n = 0;
+    sum_probe = 0;
+    sum_incumbent = 0;
+    sum_d = 0;
+    sum_d2 = 0;
+}
+
+
+/*
+ * @brief       Log likelihood ratio of "better" against "worse" so far (0 before two pairs).
+ */
+double PairedSPRT::llr() const {
+    if(n < 2)
+        return 0;
+    double mean_d = sum_d / n;
+    double var_d = (sum_d2 - n * mean_d * mean_d) / (n - 1);
+    // Identical pairs would make any difference infinitely significant.
+    var_d = max(var_d, 1e-12 * max(1.0, mean_d * mean_d));
+    double delta = rel_delta * fabs(incumbent_mean());
+    return -delta * sum_d / var_d;
+}
+
+
+/*
+ * @brief       Add one pair of segment objectives and test.
+ * @param[in]   probe       Objective of a segment driven with the probe's gains
+ * @param[in]   incumbent   Objective of the neighbouring segment driven with the best gains so far
+ */
+sprt_verdict_t PairedSPRT::add(double probe, double incumbent) {
+    double d = probe - incumbent;
+    n++;
+    sum_probe += probe;
+    sum_incumbent += incumbent;
+    sum_d += d;
+    sum_d2 += d * d;
+
+    if(n < min_pairs)
+        return SPRT_CONTINUE;
+    double lambda = llr();
+    if(lambda >= log((1 - beta) / alpha))
+        return SPRT_BETTER;
+    if(lambda <= log(beta / (1 - alpha)))
+        return SPRT_WORSE;
+    if(n >= max_pairs)
+        return sum_d < 0 ? SPRT_BETTER : SPRT_WORSE;
+    return SPRT_CONTINUE;
+}
+
+
+unsigned int PairedSPRT::size() const {
+    return n;
+}
+
+
+double PairedSPRT::probe_mean() const {
+    return sum_probe / n;
+}
+
+
+double PairedSPRT::incumbent_mean() const {
+    return sum_incumbent / n;
+}
+
+
+PairedSPRT* parse_sprt(int argc, char* argv[], unsigned int& segment) {
+    bool enabled = false;
+    double alpha = 0.05, beta = 0.05, rel_delta = 0.05;
+    unsigned int max_pairs = 16;
+    segment = 400;
+
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--sprt") == 0) {
+            enabled = true;
+        } else if(strcmp(argv[i], "--sprt-segment") == 0 && has_value) {
+            segment = max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--sprt-alpha") == 0 && has_value) {
+            alpha = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--sprt-beta") == 0 && has_value) {
+            beta = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--sprt-delta") == 0 && has_value) {
+            rel_delta = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--sprt-max-pairs") == 0 && has_value) {
+            max_pairs = atoi(argv[++i]);
+        }
+    }
+    if(!enabled)
+        return nullptr;
+    return new PairedSPRT(alpha, beta, rel_delta, 3, max_pairs);
+}
@@ -0,0 +1,61 @@
+#ifndef SPRT_H
+#define SPRT_H
+
+
+/*
+ * Outcome of a sequential test so far.
+ */
+enum sprt_verdict_enum {
+  SPRT_CONTINUE,    // not resolved yet: collect another pair
+  SPRT_BETTER,      // the probe beats the incumbent
+  SPRT_WORSE,       // it does not
+};
+typedef enum sprt_verdict_enum sprt_verdict_t;
+
+
+/*
+ * Wald's sequential probability ratio test on paired objective samples: each
+ * pair is a probe and an incumbent segment driven back to back, and their
+ * difference d = probe - incumbent is taken as normal with the variance of the
+ * differences so far. The hypotheses are that the probe is better or worse by
+ * half an indifference zone, delta = rel_delta * |incumbent mean|, so the log
+ * likelihood ratio is -delta * sum(d) / var(d). The test stops when it crosses
+ * log((1 - beta) / alpha) or log(beta / (1 - alpha)), or after max_pairs pairs,
+ * when the probe must simply have the lower mean.
+ */
+class PairedSPRT {
+
+private:
+  double alpha;
+  double beta;
+  double rel_delta;
+  unsigned int min_pairs;
+  unsigned int max_pairs;
+
+  unsigned int n;
+  double sum_probe;
+  double sum_incumbent;
+  double sum_d;
+  double sum_d2;
+
+public:
+  PairedSPRT(double alpha=0.05, double beta=0.05, double rel_delta=0.05,
+             unsigned int min_pairs=3, unsigned int max_pairs=16);
+
+  sprt_verdict_t add(double probe, double incumbent);
+  void clear();
+  unsigned int size() const;
+  double probe_mean() const;
+  double incumbent_mean() const;
+  double llr() const;
+};
+
+
+/*
+ * Build a test from --sprt on the command line, with --sprt-segment N (samples per
+ * segment, default 400), --sprt-alpha, --sprt-beta, --sprt-delta and --sprt-max-pairs
+ * overriding the defaults; nullptr without --sprt.
+ */
+PairedSPRT* parse_sprt(int argc, char* argv[], unsigned int& segment);
+
+#endif /* SPRT_H */
@@ -0,0 +1,265 @@
+#include "stability.h"
+#include <iostream>
+#include <complex>
+#include <cmath>
+#include <cstring>    // strcmp
+#include <cstdlib>    // atof, atoi
+#include <limits>
+
+using namespace std;
+
+typedef complex<double> cplx;
+
+// Frequency grid for the margins, log-spaced over (0, pi] [rad/sample].
+constexpr unsigned int NUM_FREQUENCIES = 256;
+constexpr double MIN_FREQUENCY = 1e-3;
+
+
+/*
+ * @brief       Multiply two polynomials given as coefficient vectors.
+ */
+static vector<double> poly_mul(const vector<double>& a, const vector<double>& b) {
+    vector<double> c(a.size() + b.size() - 1, 0);
+    for(size_t i=0; i<a.size(); i++) {
+        for(size_t j=0; j<b.size(); j++) {
+            c[i + j] += a[i] * b[j];
+        }
+    }
+    return c;
+}
+
+
+/*
+ * @brief       Add two polynomials given as coefficient vectors.
+ */
+static vector<double> poly_add(const vector<double>& a, const vector<double>& b) {
+    vector<double> c(max(a.size(), b.size()), 0);
+    for(size_t i=0; i<a.size(); i++) {
+        c[i] += a[i];
+    }
+    for(size_t i=0; i<b.size(); i++) {
+        c[i] += b[i];
+    }
+    return c;
+}
+
+
+/*
+ * @brief       Evaluate a polynomial in q^-1 at a point on the complex plane.
+ */
+static cplx poly_eval(const vector<double>& p, cplx q_inv) {
+    cplx y = 0;
+    for(int i=p.size()-1; i>=0; i--) {
+        y = y * q_inv + p[i];
+    }
+    return y;
+}
+
+
+/*
+ * @brief       Largest root magnitude of the monic polynomial z^N + c_1 z^(N-1) + ... + c_N
+ *              by Durand-Kerner iteration.
+ * @param[in]   c       {1, c_1, ..., c_N}
+ */
+static double spectral_radius(const vector<double>& c) {
+    unsigned int n = c.size() - 1;
+    if(n == 0)
+        return 0;
+
+    // Start on a circle enclosing all roots (Cauchy bound), at non-symmetric angles.
+    double bound = 0;
+    for(unsigned int i=1; i<=n; i++) {
+        bound = max(bound, fabs(c[i]));
+    }
+    bound += 1;
+    vector<cplx> roots(n);
+    for(unsigned int i=0; i<n; i++) {
+        roots[i] = polar(bound, 2 * M_PI * i / n + 0.4);
+    }
+
+    for(unsigned int iteration=0; iteration<500; iteration++) {
+        double change = 0;
+        for(unsigned int i=0; i<n; i++) {
+            cplx num = 1;
+            for(unsigned int k=1; k<=n; k++) {
+                num = num * roots[i] + c[k];
+            }
+            cplx den = 1;
+            for(unsigned int j=0; j<n; j++) {
+                if(j != i)
+                    den *= roots[i] - roots[j];
+            }
+            cplx step = num / den;
+            roots[i] -= step;
+            change = max(change, abs(step));
+        }
+        if(change < 1e-12)
+            break;
+    }
+
+    double r = 0;
+    for(auto& z : roots) {
+        r = max(r, abs(z));
+    }
+    return r;
+}
+
+
+
+/*****************************************************************
+ ***************** Closed-loop screening of PID gains. ***********
+ *****************************************************************/
+
+
+/*
+ * @brief       Construct the filter for a plant at an operating speed.
+ * @param[in]   plant       ARX model of cte response to steering.
+ * @param[in]   speed       Operating speed [mph], for speed-scheduled plants.
+ */
+StabilityFilter::StabilityFilter(const ARXModel& plant, double speed) {
+    a_poly.assign(plant.na + 1, 0);
+    a_poly[0] = 1;
+    for(unsigned int i=0; i<plant.na; i++) {
+        a_poly[i + 1] = -plant.theta[i];
+    }
+    b_poly.assign(plant.nb + 1, 0);
+    for(unsigned int j=0; j<plant.nb; j++) {
+        b_poly[j + 1] = plant.gain(speed) * plant.theta[plant.na + j];
+    }
+
+    max_spectral_radius = 1.0;
+    min_gain_margin_db = 3.0;
+    min_phase_margin_deg = 20.0;
+}
+
+
+/*
+ * @brief       Closed-loop pole radius and open-loop margins for one set of gains.
+ */
+StabilityReport StabilityFilter::analyze(double Kp, double Ki, double Kd) const {
+    StabilityReport report;
+
+    vector<double> integrator = {1, -1};
+    vector<double> c_num = {Kp + Ki + Kd, -(Kp + 2 * Kd), Kd};
+    vector<double> characteristic = poly_add(poly_mul(a_poly, integrator), poly_mul(b_poly, c_num));
+
+    // Trailing zero coefficients are poles at the origin; drop them.
+    while(characteristic.size() > 1 && characteristic.back() == 0)
+        characteristic.pop_back();
+    report.spectral_radius = spectral_radius(characteristic);
+    report.stable = report.spectral_radius < 1.0;
+
+    // Margins from L = B C / (A (1 - q^-1)) on the unit circle.
+    report.gain_margin_db = numeric_limits<double>::infinity();
+    report.phase_margin_deg = numeric_limits<double>::infinity();
+    double log_min = log(MIN_FREQUENCY), log_max = log(M_PI);
+    cplx last_L = 0;
+    for(unsigned int i=0; i<NUM_FREQUENCIES; i++) {
+        double w = exp(log_min + (log_max - log_min) * i / (NUM_FREQUENCIES - 1));
+        cplx q_inv = polar(1.0, -w);
+        cplx L = poly_eval(b_poly, q_inv) * poly_eval(c_num, q_inv)
+                 / (poly_eval(a_poly, q_inv) * poly_eval(integrator, q_inv));
+
+        if(i > 0) {
+            // Phase crossover: L crosses the negative real axis. Only crossings inside the unit
+            // circle bound how much the gain can grow; the integrators make the loop conditionally
+            // stable, with further crossings at low frequency where |L| > 1.
+            if((last_L.imag() < 0) != (L.imag() < 0) && L.real() < 0 && abs(L) < 1) {
+                report.gain_margin_db = min(report.gain_margin_db, -20 * log10(abs(L)));
+            }
+            // Gain crossover: |L| crosses 1.
+            if((abs(last_L) < 1) != (abs(L) < 1)) {
+                double pm = 180.0 + arg(L) * 180.0 / M_PI;
+                if(pm > 180.0)
+                    pm -= 360.0;
+                report.phase_margin_deg = min(report.phase_margin_deg, pm);
+            }
+        }
+        last_L = L;
+    }
+
+    return report;
+}
+
+
+/*
+ * @brief       Whether a candidate is stable with enough margin to be worth evaluating.
+ * @param[in]   params      {Kp, Ki, Kd, ...}; only the steering gains are screened.
+ */
+bool StabilityFilter::accept(const vector<double>& params) const {
+    StabilityReport report = analyze(fabs(params[0]), fabs(params[1]), fabs(params[2]));
+    return report.stable
+        && report.spectral_radius <= max_spectral_radius
+        && report.gain_margin_db >= min_gain_margin_db
+        && report.phase_margin_deg >= min_phase_margin_deg;
+}
+
+
+/*
+ * @brief       The kinematic lateral model in ARX form.
+ * Double integrator cte'' = K delta with K = v^2 / L * max_angle [rad],
+ * under a zero-order hold: cte[t] = 2 cte[t-1] - cte[t-2] + K T^2 / 2 (u[t-1-d] + u[t-2-d]).
+ * @param[in]   speed       [mph]
+ * @param[in]   delay       Whole periods between command and actuation.
+ */
+ARXModel kinematic_plant(double speed, double wheelbase, double max_angle, double dt, unsigned int delay) {
+    double v = speed * 0.44704;
+    double K = v * v / wheelbase * max_angle * M_PI / 180.0;
+    double b = K * dt * dt / 2;
+
+    ARXModel model(2, 2 + delay, false);
+    model.v0 = speed;
+    model.theta.assign(model.num_params(), 0);
+    model.theta[0] = 2;
+    model.theta[1] = -1;
+    model.theta[2 + delay] = b;
+    model.theta[3 + delay] = b;
+    return model;
+}
+
+
+/*
+ * @brief       Build a stability filter from the command line.
+ * Recognized flags: --prescreen, --prescreen-model FILE, --prescreen-delay N,
+ * --min-gain-margin DB, --min-phase-margin DEG, --max-radius X.
+ * @param[in]   speed       Operating speed [mph].
+ * @param[in]   delay       Default actuation delay of the kinematic plant [periods].
+ * @return      A new filter, or nullptr if pre-screening was not requested.
+ */
+StabilityFilter* parse_stability_filter(int argc, char* argv[], double speed, unsigned int delay) {
+    bool enabled = false;
+    string model_fname;
+    double min_gm = 3.0, min_pm = 20.0, max_radius = 1.0;
+
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--prescreen") == 0) {
+            enabled = true;
+        } else if(strcmp(argv[i], "--prescreen-model") == 0 && has_value) {
+            enabled = true;
+            model_fname = argv[++i];
+        } else if(strcmp(argv[i], "--prescreen-delay") == 0 && has_value) {
+            delay = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--min-gain-margin") == 0 && has_value) {
+            min_gm = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--min-phase-margin") == 0 && has_value) {
+            min_pm = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--max-radius") == 0 && has_value) {
+            max_radius = atof(argv[++i]);
+        }
+    }
+    if(!enabled)
+        return nullptr;
+
+    ARXModel plant = kinematic_plant(speed, 2.67, 25.0, 0.049, delay);
+    if(!model_fname.empty() && !plant.load(model_fname)) {
+        cerr << "Failed to load plant model " << model_fname << "; using the kinematic model." << endl;
+        plant = kinematic_plant(speed, 2.67, 25.0, 0.049, delay);
+    }
+
+    StabilityFilter* filter = new StabilityFilter(plant, speed);
+    filter->min_gain_margin_db = min_gm;
+    filter->min_phase_margin_deg = min_pm;
+    filter->max_spectral_radius = max_radius;
+    return filter;
+}
@@ -0,0 +1,60 @@
+#ifndef STABILITY_H
+#define STABILITY_H
+
+#include <vector>
+#include <string>
+#include "sysid.h"
+
+
+/*
+ * Closed-loop properties of one set of steering gains on a plant model.
+ */
+struct StabilityReport {
+  double spectral_radius;   // largest closed-loop pole magnitude; < 1 is stable
+  double gain_margin_db;    // upward gain margin; infinite if the phase never crosses -180 degrees with |L| < 1
+  double phase_margin_deg;  // infinite if the loop gain never crosses 1
+  bool stable;
+};
+
+
+/*
+ * Screens PID gain candidates analytically before they cost an evaluation window.
+ *
+ * The PID is taken in its discrete form as implemented (dt = 1 nominal period,
+ * integral window ignored), u = -(Kp + Ki / (1 - q^-1) + Kd (1 - q^-1)) cte,
+ * and closed around an ARX plant A(q^-1) cte = B(q^-1) steer.
+ * Closed-loop poles are the roots of A (1 - q^-1) + B (Kp + Ki + Kd - (Kp + 2 Kd) q^-1 + Kd q^-2),
+ * and margins come from the open-loop frequency response on a grid.
+ */
+class StabilityFilter {
+
+private:
+  std::vector<double> a_poly;   // A(q^-1), coefficients of q^0, q^-1, ...
+  std::vector<double> b_poly;   // B(q^-1), with the speed schedule applied
+
+public:
+  double max_spectral_radius;
+  double min_gain_margin_db;
+  double min_phase_margin_deg;
+
+  StabilityFilter(const ARXModel& plant, double speed);
+  StabilityReport analyze(double Kp, double Ki, double Kd) const;
+  bool accept(const std::vector<double>& params) const;
+};
+
+
+/*
+ * ARX form of the kinematic lateral model at a given speed: cte'' = v^2 / L * delta,
+ * sampled with a zero-order hold, plus a whole number of periods of actuation delay.
+ */
+ARXModel kinematic_plant(double speed, double wheelbase=2.67, double max_angle=25.0,
+                         double dt=0.049, unsigned int delay=1);
+
+
+/*
+ * Build a filter from --prescreen (kinematic plant) or --prescreen-model FILE (identified plant)
+ * on the command line; nullptr if neither is given.
+ */
+StabilityFilter* parse_stability_filter(int argc, char* argv[], double speed, unsigned int delay=1);
+
+#endif /* STABILITY_H */
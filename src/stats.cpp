@@ -0,0 +1,220 @@
+#include "stats.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>  // min, max
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define STATS_HAVE_AVX2_KERNEL
+#endif
+
+using namespace std;
+
+// Values per block; block partial sums are combined with compensated summation.
+static const size_t BLOCK = 4096;
+
+// Independent accumulator lanes in the portable kernel (matches a 256-bit vector of doubles).
+static const unsigned int LANES = 4;
+
+
+/*
+ * Sums over one block, about the shifts a (for x) and b (for |x|).
+ */
+struct BlockSums {
+  double dx, dx2;    // sum(x - a), sum((x - a)^2)
+  double dabs, dabs2;  // sum(|x| - b), sum((|x| - b)^2)
+  double sq;         // sum(x^2)
+  double min, max;
+};
+
+
+/*
+ * @brief       Portable block kernel; written lane-wise so the compiler can vectorize it.
+ */
+static void block_sums_portable(const double* x, size_t n, double a, double b, BlockSums& out) {
+    double dx[LANES] = {0}, dx2[LANES] = {0}, dabs[LANES] = {0}, dabs2[LANES] = {0}, sq[LANES] = {0};
+    double lo[LANES], hi[LANES];
+    for(unsigned int k=0; k<LANES; k++) {
+        lo[k] = numeric_limits<double>::infinity();
+        hi[k] = -numeric_limits<double>::infinity();
+    }
+
+    size_t i = 0;
+    for(; i + LANES <= n; i += LANES) {
+        for(unsigned int k=0; k<LANES; k++) {
+            double v = x[i + k];
+            double d = v - a;
+            double e = fabs(v) - b;
+            dx[k] += d;
+            dx2[k] += d * d;
+            dabs[k] += e;
+            dabs2[k] += e * e;
+            sq[k] += v * v;
+            lo[k] = v < lo[k] ? v : lo[k];
+            hi[k] = v > hi[k] ? v : hi[k];
+        }
+    }
+    for(unsigned int k=0; i<n; i++, k++) {
+        double v = x[i];
+        double d = v - a;
+        double e = fabs(v) - b;
+        dx[k] += d;
+        dx2[k] += d * d;
+        dabs[k] += e;
+        dabs2[k] += e * e;
+        sq[k] += v * v;
+        lo[k] = v < lo[k] ? v : lo[k];
+        hi[k] = v > hi[k] ? v : hi[k];
+    }
+
+    out = {0, 0, 0, 0, 0, lo[0], hi[0]};
+    for(unsigned int k=0; k<LANES; k++) {
+        out.dx += dx[k];
+        out.dx2 += dx2[k];
+        out.dabs += dabs[k];
+        out.dabs2 += dabs2[k];
+        out.sq += sq[k];
+        out.min = min(out.min, lo[k]);
+        out.max = max(out.max, hi[k]);
+    }
+}
+
+
+#ifdef STATS_HAVE_AVX2_KERNEL
+
+/*
+ * @brief       AVX2 + FMA block kernel, four doubles per instruction.
+ */
+__attribute__((target("avx2,fma")))
+static void block_sums_avx2(const double* x, size_t n, double a, double b, BlockSums& out) {
+    const __m256d va = _mm256_set1_pd(a);
+    const __m256d vb = _mm256_set1_pd(b);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d dx = _mm256_setzero_pd(), dx2 = _mm256_setzero_pd();
+    __m256d dabs = _mm256_setzero_pd(), dabs2 = _mm256_setzero_pd();
+    __m256d sq = _mm256_setzero_pd();
+    __m256d lo = _mm256_set1_pd(numeric_limits<double>::infinity());
+    __m256d hi = _mm256_set1_pd(-numeric_limits<double>::infinity());
+
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4) {
+        __m256d v = _mm256_loadu_pd(x + i);
+        __m256d d = _mm256_sub_pd(v, va);
+        __m256d e = _mm256_sub_pd(_mm256_andnot_pd(sign, v), vb);
+        dx = _mm256_add_pd(dx, d);
+        dx2 = _mm256_fmadd_pd(d, d, dx2);
+        dabs = _mm256_add_pd(dabs, e);
+        dabs2 = _mm256_fmadd_pd(e, e, dabs2);
+        sq = _mm256_fmadd_pd(v, v, sq);
+        lo = _mm256_min_pd(lo, v);
+        hi = _mm256_max_pd(hi, v);
+    }
+
+    double l_dx[4], l_dx2[4], l_dabs[4], l_dabs2[4], l_sq[4], l_lo[4], l_hi[4];
+    _mm256_storeu_pd(l_dx, dx);
+    _mm256_storeu_pd(l_dx2, dx2);
+    _mm256_storeu_pd(l_dabs, dabs);
+    _mm256_storeu_pd(l_dabs2, dabs2);
+    _mm256_storeu_pd(l_sq, sq);
+    _mm256_storeu_pd(l_lo, lo);
+    _mm256_storeu_pd(l_hi, hi);
+
+    out = {0, 0, 0, 0, 0, l_lo[0], l_hi[0]};
+    for(unsigned int k=0; k<4; k++) {
+        out.dx += l_dx[k];
+        out.dx2 += l_dx2[k];
+        out.dabs += l_dabs[k];
+        out.dabs2 += l_dabs2[k];
+        out.sq += l_sq[k];
+        out.min = min(out.min, l_lo[k]);
+        out.max = max(out.max, l_hi[k]);
+    }
+    for(; i<n; i++) {
+        double v = x[i];
+        double d = v - a;
+        double e = fabs(v) - b;
+        out.dx += d;
+        out.dx2 += d * d;
+        out.dabs += e;
+        out.dabs2 += e * e;
+        out.sq += v * v;
+        out.min = min(out.min, v);
+        out.max = max(out.max, v);
+    }
+}
+
+#endif
+
+
+/*
+ * Neumaier's compensated sum.
+ */
+struct CompensatedSum {
+  double sum = 0;
+  double c = 0;
+
+  void add(double x) {
+    double t = sum + x;
+    if(fabs(sum) >= fabs(x)) {
+      c += (sum - t) + x;
+    } else {
+      c += (x - t) + sum;
+    }
+    sum = t;
+  }
+
+  double value() const {
+    return sum + c;
+  }
+};
+
+
+/*
+ * @brief       Sum, mean, variance, mean absolute value, RMS and range in one pass.
+ */
+VecStats vec_stats(const double* x, size_t n) {
+    const double nan = numeric_limits<double>::quiet_NaN();
+    VecStats s = {n, nan, nan, nan, nan, nan, nan, nan, nan, nan};
+    if(n == 0)
+        return s;
+
+    void (*block_sums)(const double*, size_t, double, double, BlockSums&) = block_sums_portable;
+#ifdef STATS_HAVE_AVX2_KERNEL
+    static const bool have_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if(have_avx2)
+        block_sums = block_sums_avx2;
+#endif
+
+    // Shift by the first value so squares are of deviations, not of the raw values.
+    double a = x[0];
+    double b = fabs(x[0]);
+    CompensatedSum dx, dx2, dabs, dabs2, sq;
+    double lo = numeric_limits<double>::infinity();
+    double hi = -numeric_limits<double>::infinity();
+    for(size_t start=0; start<n; start+=BLOCK) {
+        BlockSums block;
+        block_sums(x + start, min(BLOCK, n - start), a, b, block);
+        dx.add(block.dx);
+        dx2.add(block.dx2);
+        dabs.add(block.dabs);
+        dabs2.add(block.dabs2);
+        sq.add(block.sq);
+        lo = min(lo, block.min);
+        hi = max(hi, block.max);
+    }
+
+    double d = dx.value() / n;
+    double e = dabs.value() / n;
+    s.mean = a + d;
+    s.sum = a * n + dx.value();
+    s.mae = b + e;
+    s.rms = sqrt(sq.value() / n);
+    s.min = lo;
+    s.max = hi;
+    if(n > 1) {
+        s.variance = max(0.0, (dx2.value() - n * d * d) / (n - 1));
+        s.stdd = sqrt(s.variance);
+        s.mae_stdd = sqrt(max(0.0, (dabs2.value() - n * e * e) / (n - 1)));
+    }
+    return s;
+}
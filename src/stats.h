@@ -0,0 +1,41 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <vector>
+#include <cstddef>
+
+/*
+ * Summary statistics of a sample, all from one fused pass over the data.
+ */
+struct VecStats {
+  size_t n;
+  double sum;
+  double mean;
+  double variance;  // unbiased (n - 1)
+  double stdd;
+  double mae;       // mean absolute value
+  double mae_stdd;  // standard deviation of the absolute values
+  double rms;
+  double min;
+  double max;
+};
+
+
+/*
+ * Compute VecStats for n doubles in a single pass.
+ *
+ * Values are shifted by the first element before squaring, so the variance does
+ * not cancel catastrophically for data far from zero. Each block of a few thousand
+ * values is summed in several independent lanes (AVX2 when the CPU has it, else a
+ * portable loop the compiler can vectorize for SSE or NEON), and the per-block
+ * partial sums are then added with compensated (Neumaier) summation, which keeps
+ * the rounding error independent of the length of the log.
+ * Empty input gives n = 0 and NaN for everything else.
+ */
+VecStats vec_stats(const double* x, size_t n);
+
+inline VecStats vec_stats(const std::vector<double>& v) {
+  return vec_stats(v.data(), v.size());
+}
+
+#endif /* STATS_H */
@@ -0,0 +1,255 @@
+#include "sweep.h"
+#include <cmath>
+#include <cstring>    // strcmp
+#include <cstdlib>    // atoi, atof
+#include <cstdint>
+#include <fstream>
+#include <algorithm>  // max
+
+using namespace std;
+
+// Sobol direction numbers of dimensions 2 and up (Joe and Kuo, new-joe-kuo-6.21201):
+// degree s and coefficients a of the primitive polynomial, and the initial m_1..m_s.
+static const unsigned int SOBOL_DEGREE[SOBOL_MAX_DIMS - 1] = {1, 2, 3, 3, 4, 4, 5, 5, 5, 5, 5};
+static const unsigned int SOBOL_COEFFS[SOBOL_MAX_DIMS - 1] = {0, 1, 1, 2, 1, 4, 2, 4, 7, 11, 13};
+static const unsigned int SOBOL_INITIAL[SOBOL_MAX_DIMS - 1][5] = {
+    {1}, {1, 3}, {1, 3, 1}, {1, 1, 1}, {1, 1, 3, 3}, {1, 3, 5, 13},
+    {1, 1, 5, 5, 17}, {1, 1, 5, 5, 5}, {1, 1, 7, 11, 19}, {1, 1, 5, 1, 1}, {1, 1, 1, 3, 11},
+};
+
+static const char* AXIS_NAMES[SWEEP_DIMS] = {"kp", "ki", "kd"};
+
+
+SweepOptions parse_sweep_options(int argc, char* argv[], const vector<double>& center, unsigned int nsamples) {
+    SweepOptions options;
+    options.design = SWEEP_GRID;
+    options.points = 11;
+    options.center = center;
+    options.range = 4.0;
+    options.nsamples = nsamples;
+    options.bins = 0;
+    options.out = "sweep";
+
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--grid") == 0 && has_value) {
+            options.design = SWEEP_GRID;
+            options.points = max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--sobol") == 0 && has_value) {
+            options.design = SWEEP_SOBOL;
+            options.points = max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--center") == 0 && i + SWEEP_DIMS < argc) {
+            for(unsigned int k=0; k<SWEEP_DIMS; k++) {
+                options.center[k] = atof(argv[++i]);
+            }
+        } else if(strcmp(argv[i], "--range") == 0 && has_value) {
+            options.range = max(1.0, atof(argv[++i]));
+        } else if(strcmp(argv[i], "--samples") == 0 && has_value) {
+            options.nsamples = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--bins") == 0 && has_value) {
+            options.bins = max(1, atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--out") == 0 && has_value) {
+            options.out = argv[++i];
+        }
+    }
+
+    // By default the slices have the grid's resolution, or about as many cells as a Sobol set has points per axis.
+    if(options.bins == 0) {
+        if(options.design == SWEEP_GRID) {
+            options.bins = options.points;
+        } else {
+            options.bins = max(1u, (unsigned int) round(cbrt((double) options.points)));
+        }
+    }
+    return options;
+}
+
+
+/*
+ * @brief       The first n points of the Sobol sequence, in [0, 1)^dims.
+ * @param[in]   dims        At most SOBOL_MAX_DIMS.
+ */
+vector<vector<double> > sobol_points(unsigned int n, unsigned int dims) {
+    // Direction numbers, scaled to 32 bits.
+    vector<vector<uint32_t> > v(dims, vector<uint32_t>(33));
+    for(unsigned int k=1; k<=32; k++) {
+        v[0][k] = 1u << (32 - k);
+    }
+    for(unsigned int d=1; d<dims; d++) {
+        unsigned int s = SOBOL_DEGREE[d - 1];
+        unsigned int a = SOBOL_COEFFS[d - 1];
+        for(unsigned int k=1; k<=32; k++) {
+            if(k <= s) {
+                v[d][k] = SOBOL_INITIAL[d - 1][k - 1] << (32 - k);
+            } else {
+                v[d][k] = v[d][k - s] ^ (v[d][k - s] >> s);
+                for(unsigned int j=1; j<s; j++) {
+                    if((a >> (s - 1 - j)) & 1)
+                        v[d][k] ^= v[d][k - j];
+                }
+            }
+        }
+    }
+
+    // Gray code order: each point flips one direction number into the last.
+    vector<vector<double> > points(n, vector<double>(dims));
+    vector<uint32_t> x(dims, 0);
+    for(unsigned int i=0; i<n; i++) {
+        for(unsigned int d=0; d<dims; d++) {
+            points[i][d] = x[d] / 4294967296.0;
+        }
+        unsigned int c = 1;
+        for(unsigned int value=i; value & 1; value >>= 1) {
+            c++;
+        }
+        for(unsigned int d=0; d<dims; d++) {
+            x[d] ^= v[d][c];
+        }
+    }
+    return points;
+}
+
+
+/*
+ * @brief       The points of the sweep, each axis in [-1, 1], 0 being the center.
+ *              Grid points sit in the middle of equal cells, so an odd count includes the center.
+ */
+vector<vector<double> > sweep_design(const SweepOptions& options) {
+    vector<vector<double> > units;
+    if(options.design == SWEEP_SOBOL) {
+        units = sobol_points(options.points, SWEEP_DIMS);
+        for(auto& u : units) {
+            for(auto& x : u) {
+                x = 2 * x - 1;
+            }
+        }
+        return units;
+    }
+
+    unsigned int n = options.points;
+    for(unsigned int i=0; i<n; i++) {
+        for(unsigned int j=0; j<n; j++) {
+            for(unsigned int k=0; k<n; k++) {
+                units.push_back({(2.0 * i + 1) / n - 1, (2.0 * j + 1) / n - 1, (2.0 * k + 1) / n - 1});
+            }
+        }
+    }
+    return units;
+}
+
+
+/*
+ * @brief       Gains of a point of the design: center * range^u on each axis.
+ */
+vector<double> sweep_gains(const SweepOptions& options, const vector<double>& unit) {
+    vector<double> gains(SWEEP_DIMS);
+    for(unsigned int k=0; k<SWEEP_DIMS; k++) {
+        gains[k] = options.center[k] * pow(options.range, unit[k]);
+    }
+    return gains;
+}
+
+
+template <typename T>
+static void write_pod(ofstream& f, const T& x) {
+    f.write((const char*) &x, sizeof(T));
+}
+
+
+/*
+ * @brief       Write the results as columns of float64: kp, ki, kd, then the objective's
+ *              mean, stddev, p50, p90 and worst over the scenarios.
+ *
+ *              Little-endian layout: "PIDSWEEP", uint32 version (1), uint32 number of columns,
+ *              uint64 number of rows, a 16-byte zero-padded name per column, then each
+ *              column's values one after the other, so a column loads with a single read
+ *              (e.g. numpy.fromfile with an offset).
+ */
+bool write_sweep(const string& fname, const vector<vector<double> >& gains, const vector<RobustStats>& stats) {
+    ofstream f(fname, ios::trunc | ios::binary);
+    if(!f)
+        return false;
+
+    const char* names[] = {"kp", "ki", "kd", "mean", "stddev", "p50", "p90", "worst"};
+    uint32_t num_columns = sizeof(names) / sizeof(names[0]);
+    uint64_t num_rows = gains.size();
+    f.write("PIDSWEEP", 8);
+    write_pod(f, (uint32_t) 1);
+    write_pod(f, num_columns);
+    write_pod(f, num_rows);
+    for(auto name : names) {
+        char padded[16] = {0};
+        strncpy(padded, name, sizeof(padded) - 1);
+        f.write(padded, sizeof(padded));
+    }
+
+    vector<double> column(num_rows);
+    for(uint32_t c=0; c<num_columns; c++) {
+        for(uint64_t r=0; r<num_rows; r++) {
+            const RobustStats& s = stats[r];
+            switch(c) {
+                case 0: case 1: case 2: column[r] = gains[r][c]; break;
+                case 3: column[r] = s.mean; break;
+                case 4: column[r] = s.stddev; break;
+                case 5: column[r] = s.p50; break;
+                case 6: column[r] = s.p90; break;
+                case 7: column[r] = s.worst; break;
+            }
+        }
+        f.write((const char*) column.data(), num_rows * sizeof(double));
+    }
+    return (bool) f;
+}
+
+
+/*
+ * @brief       Write a 2-D slice through the center for each pair of gains, as PREFIX_kp_ki.csv etc.
+ *              Points are binned on the two gains; only those in the middle bin of the third
+ *              (with a grid, the layer through the center) count. Each line has a cell's gains,
+ *              its number of points, their mean objective and the worst case among them.
+ */
+bool write_slices(const SweepOptions& options, const vector<vector<double> >& units, const vector<RobustStats>& stats) {
+    unsigned int bins = options.bins;
+    double half_width = 1.0 / bins + 1e-9;
+    for(unsigned int a=0; a<SWEEP_DIMS; a++) {
+        for(unsigned int b=a+1; b<SWEEP_DIMS; b++) {
+            unsigned int c = SWEEP_DIMS - a - b;
+            vector<unsigned int> count(bins * bins, 0);
+            vector<double> sum(bins * bins, 0);
+            vector<double> worst(bins * bins, 0);
+            for(unsigned int k=0; k<units.size(); k++) {
+                const vector<double>& u = units[k];
+                if(fabs(u[c]) > half_width)
+                    continue;
+                unsigned int i = min(bins - 1, (unsigned int) ((u[a] + 1) / 2 * bins));
+                unsigned int j = min(bins - 1, (unsigned int) ((u[b] + 1) / 2 * bins));
+                count[i * bins + j]++;
+                sum[i * bins + j] += stats[k].mean;
+                worst[i * bins + j] = max(worst[i * bins + j], stats[k].worst);
+            }
+
+            string fname = options.out + "_" + AXIS_NAMES[a] + "_" + AXIS_NAMES[b] + ".csv";
+            ofstream f(fname, ios::trunc);
+            if(!f)
+                return false;
+            f.precision(10);
+            f << AXIS_NAMES[a] << "," << AXIS_NAMES[b] << ",points,mean,worst" << endl;
+            for(unsigned int i=0; i<bins; i++) {
+                for(unsigned int j=0; j<bins; j++) {
+                    unsigned int n = count[i * bins + j];
+                    if(n == 0)
+                        continue;
+                    vector<double> u(SWEEP_DIMS, 0);
+                    u[a] = (2.0 * i + 1) / bins - 1;
+                    u[b] = (2.0 * j + 1) / bins - 1;
+                    vector<double> gains = sweep_gains(options, u);
+                    f << gains[a] << "," << gains[b] << "," << n << "," << sum[i * bins + j] / n << ","
+                      << worst[i * bins + j] << endl;
+                }
+            }
+            if(!f)
+                return false;
+        }
+    }
+    return true;
+}
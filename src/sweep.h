@@ -0,0 +1,46 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <vector>
+#include <string>
+#include "robustness.h"
+
+#define SOBOL_MAX_DIMS 12
+#define SWEEP_DIMS 3
+
+
+/*
+ * How the points of a sweep are placed.
+ */
+enum sweep_design_enum {
+  SWEEP_GRID,     // a full Kp x Ki x Kd grid
+  SWEEP_SOBOL,    // a Sobol low-discrepancy sequence
+};
+typedef enum sweep_design_enum sweep_design_t;
+
+
+/*
+ * Command-line configurable settings.
+ */
+struct SweepOptions {
+  sweep_design_t design;
+  unsigned int points;            // per axis for a grid, in total for Sobol
+  std::vector<double> center;     // {Kp, Ki, Kd}
+  double range;                   // each gain goes from center / range to center * range, log-spaced
+  unsigned int nsamples;
+  unsigned int bins;              // per axis in the 2-D slices
+  std::string out;                // prefix of the output files
+};
+
+SweepOptions parse_sweep_options(int argc, char* argv[], const std::vector<double>& center, unsigned int nsamples);
+
+std::vector<std::vector<double> > sobol_points(unsigned int n, unsigned int dims);
+std::vector<std::vector<double> > sweep_design(const SweepOptions& options);
+std::vector<double> sweep_gains(const SweepOptions& options, const std::vector<double>& unit);
+
+bool write_sweep(const std::string& fname, const std::vector<std::vector<double> >& gains,
+                 const std::vector<RobustStats>& stats);
+bool write_slices(const SweepOptions& options, const std::vector<std::vector<double> >& units,
+                  const std::vector<RobustStats>& stats);
+
+#endif /* SWEEP_H */
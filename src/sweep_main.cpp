@@ -0,0 +1,79 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <algorithm>  // std::min
+
+#include "sweep.h"
+#include "robustness.h"
+#include "vector_utils.h"
+#include "say_time.h"
+
+// Set parameters.
+#define NSAMPLES 6400
+#define NDISCARD 32
+#define BLOCK 4096
+
+/*
+ * Map the Twiddle objective on the offline simulator around a set of steering gains.
+ *
+ *   ./sweep [--grid N | --sobol N] [--center KP KI KD] [--range F] [--samples N]
+ *           [--bins B] [--out PREFIX] [--robust N ...] [--threads N]
+ *
+ * Evaluates an N x N x N grid (11 by default) or N Sobol points, each gain from
+ * center / F to center * F (4) log-spaced, around the gains main.cpp drives with.
+ * Each point is scored on the nominal model, or with --robust on the same randomized
+ * scenarios (see parse_robustness_options), using every core. Writes the per-point
+ * statistics to PREFIX.bin (see write_sweep) and the slices through the center to
+ * PREFIX_kp_ki.csv, PREFIX_kp_kd.csv and PREFIX_ki_kd.csv.
+ */
+int main(int argc, char* argv[]) {
+
+    // pid_steering.Init in main.cpp.
+    std::vector<double> center = {0.174668, 0.000780556, 1.6099};
+    SweepOptions options = parse_sweep_options(argc, argv, center, NSAMPLES);
+
+    RobustnessOptions robust_options = parse_robustness_options(argc, argv);
+    if(!robust_options.enabled) {
+        // A single scenario, the nominal model.
+        robust_options.num_scenarios = 1;
+        robust_options.spread = ScenarioSpread();
+    }
+    RobustEvaluator evaluator(robust_options);
+
+    std::vector<std::vector<double> > units = sweep_design(options);
+    std::vector<std::vector<double> > gains;
+    for(auto& u : units) {
+        gains.push_back(sweep_gains(options, u));
+    }
+    say_time(); std::cout << "Sweeping " << gains.size() << " points over " << robust_options.num_scenarios
+                          << " scenarios around" << std::endl;
+    say_time(); vec_print(options.center, "p");
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<RobustStats> stats;
+    for(unsigned int k0=0; k0<gains.size(); k0+=BLOCK) {
+        unsigned int k1 = std::min((unsigned int) gains.size(), k0 + BLOCK);
+        std::vector<std::vector<double> > block(gains.begin() + k0, gains.begin() + k1);
+        std::vector<RobustStats> block_stats = evaluator.evaluate(block, options.nsamples, NDISCARD);
+        stats.insert(stats.end(), block_stats.begin(), block_stats.end());
+        say_time(); std::cout << k1 << " / " << gains.size() << " points done." << std::endl;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double steps = (double) gains.size() * robust_options.num_scenarios * (options.nsamples + NDISCARD);
+
+    unsigned int best = 0;
+    for(unsigned int k=0; k<stats.size(); k++) {
+        if(stats[k].mean < stats[best].mean)
+            best = k;
+    }
+    say_time(); std::cout << "Done in " << seconds << " s (" << steps / seconds << " steps/s)." << std::endl;
+    say_time(); std::cout << "Best mean objective " << stats[best].mean << " (worst " << stats[best].worst << ") with" << std::endl;
+    say_time(); vec_print(gains[best], "p");
+
+    if(!write_sweep(options.out + ".bin", gains, stats) || !write_slices(options, units, stats)) {
+        std::cerr << "Failed to write " << options.out << ".bin or its slices" << std::endl;
+        return -1;
+    }
+    say_time(); std::cout << "Wrote " << options.out << ".bin and its slices." << std::endl;
+    return 0;
+}
@@ -0,0 +1,378 @@
+#include "sysid.h"
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <limits>
+#include <cstdlib>    // strtol, strtod
+#include <algorithm>  // min, max
+
+using namespace std;
+
+
+/*
+ * @brief       Load the columns of a cte.csv log.
+ * Each line is "t, cte, speed, angle, steer, throttle, i_error".
+ * @return      Whether the file could be opened.
+ */
+bool read_telemetry_csv(const string& fname, TelemetryLog& log) {
+    ifstream f(fname);
+    if(!f.is_open())
+        return false;
+
+    string line;
+    while(getline(f, line)) {
+        const char* p = line.c_str();
+        char* end;
+        double fields[6];
+
+        long t = strtol(p, &end, 10);
+        if(end == p)
+            continue;
+        p = end;
+        unsigned int nfields = 0;
+        while(nfields < 6 && *p == ',') {
+            fields[nfields] = strtod(p + 1, &end);
+            if(end == p + 1)
+                break;
+            p = end;
+            nfields++;
+        }
+        if(nfields < 5)
+            continue;
+
+        log.t.push_back(t);
+        log.cte.push_back(fields[0]);
+        log.speed.push_back(fields[1]);
+        log.angle.push_back(fields[2]);
+        log.steer.push_back(fields[3]);
+        log.throttle.push_back(fields[4]);
+        log.i_error.push_back(nfields > 5 ? fields[5] : numeric_limits<double>::quiet_NaN());
+    }
+    return true;
+}
+
+
+
+/*****************************************************************
+ ***************** Least squares via normal equations. ***********
+ *****************************************************************/
+
+
+/*
+ * @brief       Construct empty normal equations for n parameters.
+ */
+NormalEquations::NormalEquations(unsigned int n) {
+    this->n = n;
+    xtx.assign(n * n, 0);
+    xty.assign(n, 0);
+    rows = 0;
+}
+
+
+/*
+ * @brief       Add one observation.
+ * @param[in]   x       n regressors
+ * @param[in]   y       the regressand
+ */
+void NormalEquations::add(const double* x, double y) {
+    for(unsigned int i=0; i<n; i++) {
+        double xi = x[i];
+        double* row = &xtx[i * n];
+        for(unsigned int j=0; j<n; j++) {
+            row[j] += xi * x[j];
+        }
+        xty[i] += xi * y;
+    }
+    rows++;
+}
+
+
+/*
+ * @brief       Solve (X^T X + ridge * mean(diag) * I) theta = X^T y by Cholesky decomposition.
+ * @return      Whether the system was positive definite.
+ */
+bool NormalEquations::solve(vector<double>& theta, double ridge) {
+    vector<double> L(xtx);
+    double mean_diagonal = 0;
+    for(unsigned int i=0; i<n; i++) {
+        mean_diagonal += L[i * n + i] / n;
+    }
+    for(unsigned int i=0; i<n; i++) {
+        L[i * n + i] += ridge * mean_diagonal;
+    }
+
+    // In-place lower-triangular factor.
+    for(unsigned int j=0; j<n; j++) {
+        double d = L[j * n + j];
+        for(unsigned int k=0; k<j; k++) {
+            d -= L[j * n + k] * L[j * n + k];
+        }
+        if(d <= 0)
+            return false;
+        d = sqrt(d);
+        L[j * n + j] = d;
+        for(unsigned int i=j+1; i<n; i++) {
+            double s = L[i * n + j];
+            for(unsigned int k=0; k<j; k++) {
+                s -= L[i * n + k] * L[j * n + k];
+            }
+            L[i * n + j] = s / d;
+        }
+    }
+
+    // Forward, then back substitution.
+    theta.assign(n, 0);
+    vector<double> z(n);
+    for(unsigned int i=0; i<n; i++) {
+        double s = xty[i];
+        for(unsigned int k=0; k<i; k++) {
+            s -= L[i * n + k] * z[k];
+        }
+        z[i] = s / L[i * n + i];
+    }
+    for(int i=n-1; i>=0; i--) {
+        double s = z[i];
+        for(unsigned int k=i+1; k<n; k++) {
+            s -= L[k * n + i] * theta[k];
+        }
+        theta[i] = s / L[i * n + i];
+    }
+    return true;
+}
+
+
+/*
+ * @brief       Number of observations added.
+ */
+unsigned long NormalEquations::size() const {
+    return rows;
+}
+
+
+
+/*****************************************************************
+ ***************** ARX model of cte response to steering. ********
+ *****************************************************************/
+
+
+/*
+ * @brief       Construct an (unfitted) ARX model.
+ * @param[in]   na          Number of autoregressive (cte) lags.
+ * @param[in]   nb          Number of input (steer) lags.
+ * @param[in]   scheduled   Whether the input gain is scheduled by speed squared.
+ */
+ARXModel::ARXModel(unsigned int na, unsigned int nb, bool scheduled) {
+    this->na = na;
+    this->nb = nb;
+    this->scheduled = scheduled;
+    v0 = 40.0;
+    theta.assign(num_params(), 0);
+}
+
+unsigned int ARXModel::num_params() const {
+    return na + nb + 1;
+}
+
+/*
+ * @brief       Number of past samples a prediction needs.
+ */
+unsigned int ARXModel::order() const {
+    return max(na, nb);
+}
+
+/*
+ * @brief       Input gain multiplier at a given speed [mph].
+ */
+double ARXModel::gain(double speed) const {
+    if(!scheduled)
+        return 1.0;
+    double r = speed / v0;
+    return r * r;
+}
+
+
+/*
+ * @brief       Build a regressor row.
+ * @param[in]   cte, steer, speed   Histories, most recent first (index 0 is t-1).
+ * @param[out]  x                   num_params() regressors
+ */
+void ARXModel::regressors(const double* cte, const double* steer, const double* speed, double* x) const {
+    for(unsigned int i=0; i<na; i++) {
+        x[i] = cte[i];
+    }
+    for(unsigned int j=0; j<nb; j++) {
+        x[na + j] = gain(speed[j]) * steer[j];
+    }
+    x[na + nb] = 1.0;
+}
+
+
+/*
+ * @brief       Fit the coefficients to a log by least squares.
+ * @param[out]  residuals   If given, the one-step prediction errors, one per fitted sample.
+ * @return      Whether the fit succeeded.
+ */
+bool ARXModel::fit(const TelemetryLog& log, vector<double>* residuals) {
+    unsigned int p = order();
+    unsigned int n = num_params();
+    if(log.cte.size() <= p + n)
+        return false;
+
+    if(scheduled) {
+        double sum = 0;
+        for(auto v : log.speed) {
+            sum += v;
+        }
+        v0 = max(1.0, sum / log.speed.size());
+    }
+
+    NormalEquations ne(n);
+    vector<double> x(n), c(p), u(p), v(p);
+    for(size_t t=p; t<log.cte.size(); t++) {
+        for(unsigned int i=0; i<p; i++) {
+            c[i] = log.cte[t - 1 - i];
+            u[i] = log.steer[t - 1 - i];
+            v[i] = log.speed[t - 1 - i];
+        }
+        regressors(c.data(), u.data(), v.data(), x.data());
+        ne.add(x.data(), log.cte[t]);
+    }
+    if(!ne.solve(theta))
+        return false;
+
+    if(residuals) {
+        residuals->clear();
+        for(size_t t=p; t<log.cte.size(); t++) {
+            for(unsigned int i=0; i<p; i++) {
+                c[i] = log.cte[t - 1 - i];
+                u[i] = log.steer[t - 1 - i];
+                v[i] = log.speed[t - 1 - i];
+            }
+            residuals->push_back(log.cte[t] - predict(c.data(), u.data(), v.data()));
+        }
+    }
+    return true;
+}
+
+
+/*
+ * @brief       One-step-ahead prediction from histories, most recent first.
+ */
+double ARXModel::predict(const double* cte, const double* steer, const double* speed) const {
+    double y = theta[na + nb];
+    for(unsigned int i=0; i<na; i++) {
+        y += theta[i] * cte[i];
+    }
+    for(unsigned int j=0; j<nb; j++) {
+        y += theta[na + j] * gain(speed[j]) * steer[j];
+    }
+    return y;
+}
+
+
+/*
+ * @brief       Write the model as "na nb scheduled v0" followed by the coefficients.
+ */
+bool ARXModel::save(const string& fname) const {
+    ofstream f(fname);
+    if(!f.is_open())
+        return false;
+    f.precision(17);
+    f << na << " " << nb << " " << scheduled << " " << v0 << endl;
+    for(auto th : theta) {
+        f << th << endl;
+    }
+    return true;
+}
+
+
+/*
+ * @brief       Read a model written by save().
+ */
+bool ARXModel::load(const string& fname) {
+    ifstream f(fname);
+    if(!(f >> na >> nb >> scheduled >> v0))
+        return false;
+    theta.assign(num_params(), 0);
+    for(auto& th : theta) {
+        if(!(f >> th))
+            return false;
+    }
+    return true;
+}
+
+
+
+/*****************************************************************
+ ***************** Surrogate plant for offline tuning. ***********
+ *****************************************************************/
+
+
+/*
+ * @brief       Construct the surrogate.
+ * @param[in]   residuals   Disturbance sequence to replay (cyclically).
+ * @param[in]   speeds      Speed profile to replay (cyclically) [mph].
+ */
+SurrogatePlant::SurrogatePlant(const ARXModel& model, const vector<double>& residuals, const vector<double>& speeds)
+        : model(model), residuals(residuals), speeds(speeds) {
+    if(this->residuals.empty())
+        this->residuals.push_back(0);
+    if(this->speeds.empty())
+        this->speeds.push_back(model.v0);
+    reset();
+}
+
+
+/*
+ * @brief       Start over from rest on the centerline, at the start of the replayed sequences.
+ */
+void SurrogatePlant::reset() {
+    unsigned int p = max(1u, model.order());
+    cte_history.assign(p, 0);
+    steer_history.assign(p, 0);
+    speed_history.assign(p, speeds[0]);
+    k = 0;
+}
+
+
+/*
+ * @brief       The most recent cte.
+ */
+double SurrogatePlant::cte() const {
+    return cte_history[0];
+}
+
+
+/*
+ * @brief       The current speed [mph].
+ */
+double SurrogatePlant::speed() const {
+    return speed_history[0];
+}
+
+
+/*
+ * @brief       Apply a steering command for one period.
+ * @return      The resulting cte.
+ */
+double SurrogatePlant::step(double steer) {
+    unsigned int p = steer_history.size();
+
+    // Shift in the command just applied, then predict the cte it leads to.
+    for(unsigned int i=p-1; i>0; i--) {
+        steer_history[i] = steer_history[i - 1];
+        speed_history[i] = speed_history[i - 1];
+    }
+    steer_history[0] = steer;
+    speed_history[0] = speeds[k % speeds.size()];
+
+    double y = model.predict(cte_history.data(), steer_history.data(), speed_history.data());
+    y += residuals[k % residuals.size()];
+    k++;
+
+    for(unsigned int i=p-1; i>0; i--) {
+        cte_history[i] = cte_history[i - 1];
+    }
+    cte_history[0] = y;
+    return y;
+}
@@ -0,0 +1,104 @@
+#ifndef SYSID_H
+#define SYSID_H
+
+#include <vector>
+#include <string>
+
+
+/*
+ * The columns of the cte.csv log written by twiddle_main.
+ */
+struct TelemetryLog {
+  std::vector<long> t;
+  std::vector<double> cte;
+  std::vector<double> speed;
+  std::vector<double> angle;
+  std::vector<double> steer;
+  std::vector<double> throttle;
+  std::vector<double> i_error;  // NaN in logs that predate the column
+};
+
+bool read_telemetry_csv(const std::string& fname, TelemetryLog& log);
+
+
+/*
+ * Accumulates X^T X and X^T y one regressor row at a time,
+ * for least-squares problems with few parameters and very many rows.
+ * The full (not just triangular) matrix is updated, so each row's rank-1
+ * update is n contiguous multiply-add loops the compiler can vectorize.
+ */
+class NormalEquations {
+
+private:
+  unsigned int n;
+  std::vector<double> xtx;
+  std::vector<double> xty;
+  unsigned long rows;
+
+public:
+  NormalEquations(unsigned int n);
+  void add(const double* x, double y);
+  bool solve(std::vector<double>& theta, double ridge=1e-9);
+  unsigned long size() const;
+};
+
+
+/*
+ * Discrete-time ARX model of the cte response to steering:
+ *
+ *   cte[t] = sum_i a_i cte[t-i] + sum_j b_j g(v[t-j]) steer[t-j] + c + e[t]
+ *
+ * with g(v) = (v / v0)^2 when scheduled by speed (the kinematic
+ * steering-to-cte gain grows with the square of speed), else g = 1.
+ */
+class ARXModel {
+
+public:
+  unsigned int na;
+  unsigned int nb;
+  bool scheduled;
+  double v0;
+
+  // {a_1..a_na, b_1..b_nb, c}
+  std::vector<double> theta;
+
+  ARXModel(unsigned int na=2, unsigned int nb=2, bool scheduled=false);
+
+  unsigned int num_params() const;
+  unsigned int order() const;
+  double gain(double speed) const;
+  void regressors(const double* cte, const double* steer, const double* speed, double* x) const;
+
+  bool fit(const TelemetryLog& log, std::vector<double>* residuals=nullptr);
+  double predict(const double* cte, const double* steer, const double* speed) const;
+
+  bool save(const std::string& fname) const;
+  bool load(const std::string& fname);
+};
+
+
+/*
+ * A closed-loop stand-in for the simulator built from an identified model.
+ * The fit residuals (mostly the effect of track curvature) are replayed
+ * as a disturbance, and the logged speed profile is replayed for the gain schedule.
+ */
+class SurrogatePlant {
+
+private:
+  ARXModel model;
+  std::vector<double> residuals;
+  std::vector<double> speeds;
+  std::vector<double> cte_history;
+  std::vector<double> steer_history;
+  std::vector<double> speed_history;
+  unsigned long k;
+
+public:
+  SurrogatePlant(const ARXModel& model, const std::vector<double>& residuals, const std::vector<double>& speeds);
+  void reset();
+  double cte() const;
+  double speed() const;
+  double step(double steer);
+};
+
+#endif /* SYSID_H */
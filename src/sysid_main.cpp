@@ -0,0 +1,106 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstring>    // strcmp
+#include <cstdlib>    // atoi
+#include <algorithm>  // std::min, std::max
+
+#include "sysid.h"
+#include "PID.h"
+#include "twiddle.h"
+#include "vector_utils.h"
+#include "say_time.h"
+
+// Set parameters.
+#define NSAMPLES 6400
+#define NDISCARD 32
+#define TWIDDLETOL 0.001
+
+/*
+ * Identify an ARX model of cte response to steering from a cte.csv log,
+ * and optionally run Twiddle against it as a surrogate for the simulator.
+ *
+ *   ./sysid cte.csv [--na N] [--nb N] [--scheduled] [--model FILE] [--twiddle MAXSAMPLES]
+ */
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " cte.csv [--na N] [--nb N] [--scheduled]"
+                  << " [--model FILE] [--twiddle MAXSAMPLES]" << std::endl;
+        return -1;
+    }
+
+    unsigned int na = 2, nb = 2;
+    bool scheduled = false;
+    std::string model_fname = "arx_model.txt";
+    unsigned long twiddle_samples = 0;
+    for(int i=2; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--na") == 0 && has_value) {
+            na = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--nb") == 0 && has_value) {
+            nb = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--scheduled") == 0) {
+            scheduled = true;
+        } else if(strcmp(argv[i], "--model") == 0 && has_value) {
+            model_fname = argv[++i];
+        } else if(strcmp(argv[i], "--twiddle") == 0 && has_value) {
+            twiddle_samples = atol(argv[++i]);
+        }
+    }
+
+    TelemetryLog log;
+    if(!read_telemetry_csv(argv[1], log)) {
+        std::cerr << "Failed to read " << argv[1] << std::endl;
+        return -1;
+    }
+    std::cout << "Read " << log.cte.size() << " samples from " << argv[1] << "." << std::endl;
+
+    // Fit.
+    ARXModel model(na, nb, scheduled);
+    std::vector<double> residuals;
+    auto start = std::chrono::steady_clock::now();
+    if(!model.fit(log, &residuals)) {
+        std::cerr << "Fit failed (too few samples, or no steering excitation)." << std::endl;
+        return -1;
+    }
+    double fit_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    double cte_var = vec_stats(log.cte).variance;
+    double res_var = vec_stats(residuals).variance;
+    std::cout << "Fit ARX(" << na << ", " << nb << ")" << (scheduled ? ", speed-scheduled," : "");
+    std::cout << " in " << fit_ms << " ms." << std::endl;
+    vec_print(model.theta, "theta");
+    std::cout << "One-step residual RMS = " << sqrt(res_var) << ", R^2 = " << 1 - res_var / cte_var << std::endl;
+
+    if(model.save(model_fname)) {
+        std::cout << "Saved model to " << model_fname << "." << std::endl;
+    }
+
+    if(twiddle_samples == 0)
+        return 0;
+
+    // Twiddle against the surrogate, with the same setup as twiddle_main.
+    SurrogatePlant plant(model, residuals, log.speed);
+    PID pid_steering;
+    pid_steering.Init(0.110293, 0.000680556, 0.797399);
+    std::vector<PID*> pids = {&pid_steering};
+    TwiddlerManager twiddler_manager(pids, NSAMPLES, TWIDDLETOL, NDISCARD);
+
+    start = std::chrono::steady_clock::now();
+    unsigned long t;
+    for(t=0; t<twiddle_samples && !twiddler_manager.is_converged(); t++) {
+        double cte = plant.cte();
+        pid_steering.UpdateError(cte, 1.0);
+        double steer_value = std::max(-1.0, std::min(1.0, pid_steering.TotalError()));
+        plant.step(steer_value);
+        twiddler_manager.process_error(cte);
+    }
+    double twiddle_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    say_time(); std::cout << "Twiddled on the surrogate for " << t << " samples in " << twiddle_s << " s (";
+    std::cout << 1e9 * twiddle_s / std::max(1ul, t) << " ns/sample; the simulator takes 49 ms)." << std::endl;
+    say_time(); std::cout << "Final gains, to confirm on the simulator:" << std::endl;
+    say_time(); vec_print(std::vector<double>({pid_steering.Kp, pid_steering.Ki, pid_steering.Kd}), "p");
+
+    return 0;
+}
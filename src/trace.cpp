@@ -0,0 +1,154 @@
+#include "trace.h"
+#include "say_time.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <mutex>
+#include <vector>
+#include <new>
+#include <csignal>
+#include <cstdlib>    // posix_memalign, atexit
+#include <thread>
+#include <unistd.h>   // pipe, read, write
+
+using namespace std;
+
+// Oldest events of a ring not copied when dumping, since the writer may be overwriting them.
+static const unsigned int OVERWRITE_MARGIN = 256;
+
+static mutex buffers_mutex;
+static vector<TraceBuffer*> buffers;
+
+// Reference points for converting ticks to microseconds.
+static const uint64_t origin_ticks = trace_ticks();
+static const chrono::steady_clock::time_point origin_time = chrono::steady_clock::now();
+
+static string exit_path;
+
+
+TraceBuffer::TraceBuffer(unsigned int tid) {
+    head.store(0, memory_order_relaxed);
+    this->tid = tid;
+}
+
+
+/*
+ * @brief       Allocate and register a buffer for the calling thread.
+ * Buffers are never freed, so spans from finished threads are kept.
+ */
+TraceBuffer* trace_register_thread() {
+    // Plain new ignores over-alignment before C++17.
+    void* memory = nullptr;
+    if(posix_memalign(&memory, alignof(TraceBuffer), sizeof(TraceBuffer)) != 0)
+        throw bad_alloc();
+    lock_guard<mutex> lock(buffers_mutex);
+    TraceBuffer* buffer = new(memory) TraceBuffer(buffers.size() + 1);
+    buffers.push_back(buffer);
+    return buffer;
+}
+
+
+/*
+ * @brief       Microseconds per tick, measured against steady_clock since startup.
+ */
+static double microseconds_per_tick() {
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t ticks = trace_ticks() - origin_ticks;
+    double us = chrono::duration<double, micro>(chrono::steady_clock::now() - origin_time).count();
+    return ticks > 0 ? us / ticks : 0;
+#else
+    return 1e-3;
+#endif
+}
+
+
+/*
+ * @brief       All recorded spans as Chrome trace JSON ("X" complete events).
+ */
+string trace_json() {
+    double scale = microseconds_per_tick();
+    ostringstream out;
+    out.precision(3);
+    out << fixed << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+
+    lock_guard<mutex> lock(buffers_mutex);
+    for(auto buffer : buffers) {
+        uint64_t head = buffer->head.load(memory_order_acquire);
+        uint64_t begin = 0;
+        if(head > TraceBuffer::CAPACITY - OVERWRITE_MARGIN)
+            begin = head - (TraceBuffer::CAPACITY - OVERWRITE_MARGIN);
+        for(uint64_t i=begin; i<head; i++) {
+            const TraceEvent& e = buffer->events[i & (TraceBuffer::CAPACITY - 1)];
+            if(!first)
+                out << ",";
+            first = false;
+            // Ticks before the origin can only come from static initializers.
+            double ts = e.start >= origin_ticks ? (e.start - origin_ticks) * scale : 0;
+            out << "\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid;
+            out << ",\"ts\":" << ts << ",\"dur\":" << (e.end - e.start) * scale << "}";
+        }
+    }
+    out << "\n]}\n";
+    return out.str();
+}
+
+
+/*
+ * @brief       Write the trace to a file.
+ * @return      Whether the file was written.
+ */
+bool trace_dump(const string& path) {
+    ofstream file(path, ios::trunc);
+    if(!file)
+        return false;
+    file << trace_json();
+    say_time(); cout << "Wrote trace to " << path << "." << endl;
+    return true;
+}
+
+
+static void dump_on_exit() {
+    trace_dump(exit_path);
+}
+
+
+// Written by the signal handler, read by the thread that dumps (see trace_dump_at_exit).
+static int signal_pipe[2] = {-1, -1};
+
+
+static void dump_on_signal(int sig) {
+    // Only async-signal-safe calls here: the interrupted thread may hold buffers_mutex or be inside malloc.
+    unsigned char byte = (unsigned char) sig;
+    ssize_t written = write(signal_pipe[1], &byte, 1);
+    (void) written;
+}
+
+
+/*
+ * @brief       Wait for dump_on_signal, then dump from this ordinary thread and die of the signal as before.
+ */
+static void dump_when_signalled() {
+    unsigned char byte;
+    while(read(signal_pipe[0], &byte, 1) != 1) {}
+    int sig = byte;
+    trace_dump(exit_path);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+
+/*
+ * @brief       Dump the trace to a file when the process exits or is stopped with SIGINT/SIGTERM.
+ */
+void trace_dump_at_exit(const string& path) {
+    exit_path = path;
+    atexit(dump_on_exit);
+    if(pipe(signal_pipe) != 0) {
+        cerr << "Could not create a pipe; the trace is only dumped on a normal exit." << endl;
+        return;
+    }
+    thread(dump_when_signalled).detach();
+    signal(SIGINT, dump_on_signal);
+    signal(SIGTERM, dump_on_signal);
+}
@@ -0,0 +1,409 @@
+#include "track.h"
+#include <cmath>
+#include <cstdlib>    // strtod
+#include <fstream>
+#include <limits>
+#include <algorithm>  // min, max, min_element, max_element, upper_bound
+
+using namespace std;
+
+// Catmull-Rom samples per waypoint interval when resampling.
+static const unsigned int SPLINE_SAMPLES = 32;
+
+// The grid is coarsened rather than grow beyond this many cells.
+static const unsigned long MAX_CELLS = 1 << 22;
+
+
+/*
+ * @brief       Wrap an angle to [-pi, pi).
+ */
+static double wrap_angle(double a) {
+    return a - 2 * M_PI * floor((a + M_PI) / (2 * M_PI));
+}
+
+
+/*
+ * @brief       Points every `spacing` meters along a closed polyline.
+ */
+static void resample(const vector<double>& px, const vector<double>& py, double spacing,
+                     vector<double>& x, vector<double>& y) {
+    x.clear();
+    y.clear();
+    unsigned int n = px.size();
+    double next = 0, s = 0;
+    for(unsigned int i=0; i<n; i++) {
+        unsigned int j = (i + 1) % n;
+        double len = hypot(px[j] - px[i], py[j] - py[i]);
+        while(next < s + len) {
+            double t = (next - s) / len;
+            x.push_back(px[i] + t * (px[j] - px[i]));
+            y.push_back(py[i] + t * (py[j] - py[i]));
+            next += spacing;
+        }
+        s += len;
+    }
+}
+
+
+/*
+ * @brief       Densely sample the closed Catmull-Rom spline through the waypoints.
+ */
+static void catmull_rom(const vector<double>& wx, const vector<double>& wy,
+                        vector<double>& px, vector<double>& py) {
+    unsigned int n = wx.size();
+    px.clear();
+    py.clear();
+    for(unsigned int i=0; i<n; i++) {
+        unsigned int i0 = (i + n - 1) % n, i2 = (i + 1) % n, i3 = (i + 2) % n;
+        for(unsigned int k=0; k<SPLINE_SAMPLES; k++) {
+            double t = (double) k / SPLINE_SAMPLES;
+            double t2 = t * t, t3 = t2 * t;
+            double c0 = -0.5 * t3 + t2 - 0.5 * t;
+            double c1 = 1.5 * t3 - 2.5 * t2 + 1;
+            double c2 = -1.5 * t3 + 2 * t2 + 0.5 * t;
+            double c3 = 0.5 * t3 - 0.5 * t2;
+            px.push_back(c0 * wx[i0] + c1 * wx[i] + c2 * wx[i2] + c3 * wx[i3]);
+            py.push_back(c0 * wy[i0] + c1 * wy[i] + c2 * wy[i2] + c3 * wy[i3]);
+        }
+    }
+}
+
+
+
+/*****************************************************************
+ ***************** Construction. *********************************
+ *****************************************************************/
+
+
+/*
+ * @brief       An empty track; see load and set_waypoints.
+ * @param[in]   reach       Distance from the centerline within which queries use the grid only [m].
+ */
+Track::Track(double reach) {
+    this->reach = reach;
+    length = 0;
+    grid_x0 = grid_y0 = 0;
+    cell_size = 1;
+    grid_nx = grid_ny = 0;
+}
+
+
+/*
+ * @brief       Load waypoints from a file with one "x,y" (or "x y") per line; other lines are skipped.
+ * @param[in]   spacing     If positive, resample a spline through the waypoints every `spacing` meters.
+ * @return      Whether the file had at least three waypoints.
+ */
+bool Track::load(const string& fname, double spacing) {
+    ifstream f(fname);
+    if(!f.is_open())
+        return false;
+
+    vector<double> wx, wy;
+    string line;
+    while(getline(f, line)) {
+        const char* p = line.c_str();
+        char* end;
+        double px = strtod(p, &end);
+        if(end == p)
+            continue;
+        p = end;
+        while(*p == ',' || *p == ' ' || *p == '\t')
+            p++;
+        double py = strtod(p, &end);
+        if(end == p)
+            continue;
+        wx.push_back(px);
+        wy.push_back(py);
+    }
+    if(wx.size() < 3)
+        return false;
+    set_waypoints(wx, wy, spacing);
+    return true;
+}
+
+
+/*
+ * @brief       Use the given (closed) centerline.
+ * @param[in]   spacing     If positive, resample a spline through the waypoints every `spacing` meters.
+ */
+void Track::set_waypoints(const vector<double>& wx, const vector<double>& wy, double spacing) {
+    x = wx;
+    y = wy;
+    // The closing segment is implicit.
+    if(x.size() > 1 && x.front() == x.back() && y.front() == y.back()) {
+        x.pop_back();
+        y.pop_back();
+    }
+    if(spacing > 0) {
+        vector<double> px, py;
+        catmull_rom(x, y, px, py);
+        resample(px, py, spacing, x, y);
+    }
+    build();
+}
+
+
+/*
+ * @brief       Arc lengths, directions, curvatures and the grid.
+ */
+void Track::build() {
+    unsigned int n = x.size();
+    s_start.resize(n);
+    seg_length.resize(n);
+    ux.resize(n);
+    uy.resize(n);
+    seg_heading.resize(n);
+    vertex_curvature.resize(n);
+
+    length = 0;
+    double max_length = 0;
+    for(unsigned int i=0; i<n; i++) {
+        unsigned int j = (i + 1) % n;
+        double dx = x[j] - x[i], dy = y[j] - y[i];
+        double len = hypot(dx, dy);
+        s_start[i] = length;
+        seg_length[i] = len;
+        ux[i] = len > 0 ? dx / len : 1;
+        uy[i] = len > 0 ? dy / len : 0;
+        seg_heading[i] = atan2(uy[i], ux[i]);
+        length += len;
+        max_length = max(max_length, len);
+    }
+
+    // Turning angle at each vertex over the length around it.
+    for(unsigned int i=0; i<n; i++) {
+        unsigned int h = (i + n - 1) % n;
+        double turn = atan2(ux[h] * uy[i] - uy[h] * ux[i], ux[h] * ux[i] + uy[h] * uy[i]);
+        double around = 0.5 * (seg_length[h] + seg_length[i]);
+        vertex_curvature[i] = around > 0 ? turn / around : 0;
+    }
+
+    // Cells of a fraction of the reach, and a margin of the reach all around,
+    // so any point within reach of the track is inside the grid.
+    double x_min = *min_element(x.begin(), x.end()) - reach, x_max = *max_element(x.begin(), x.end()) + reach;
+    double y_min = *min_element(y.begin(), y.end()) - reach, y_max = *max_element(y.begin(), y.end()) + reach;
+    cell_size = max(max_length, 0.25 * reach);
+    while(((x_max - x_min) / cell_size + 1) * ((y_max - y_min) / cell_size + 1) > MAX_CELLS)
+        cell_size *= 2;
+    grid_x0 = x_min;
+    grid_y0 = y_min;
+    grid_nx = (unsigned int) ((x_max - x_min) / cell_size) + 1;
+    grid_ny = (unsigned int) ((y_max - y_min) / cell_size) + 1;
+
+    // Each segment goes in every cell its bounding box, grown by the reach, overlaps.
+    vector<unsigned int> lo_x(n), hi_x(n), lo_y(n), hi_y(n);
+    vector<unsigned int> counts(grid_nx * grid_ny + 1, 0);
+    for(unsigned int i=0; i<n; i++) {
+        unsigned int j = (i + 1) % n;
+        lo_x[i] = (unsigned int) max(0.0, floor((min(x[i], x[j]) - reach - grid_x0) / cell_size));
+        hi_x[i] = (unsigned int) min(grid_nx - 1.0, floor((max(x[i], x[j]) + reach - grid_x0) / cell_size));
+        lo_y[i] = (unsigned int) max(0.0, floor((min(y[i], y[j]) - reach - grid_y0) / cell_size));
+        hi_y[i] = (unsigned int) min(grid_ny - 1.0, floor((max(y[i], y[j]) + reach - grid_y0) / cell_size));
+        for(unsigned int cy=lo_y[i]; cy<=hi_y[i]; cy++) {
+            for(unsigned int cx=lo_x[i]; cx<=hi_x[i]; cx++) {
+                counts[cy * grid_nx + cx + 1]++;
+            }
+        }
+    }
+    cell_start.assign(counts.size(), 0);
+    for(unsigned int c=1; c<counts.size(); c++) {
+        cell_start[c] = cell_start[c - 1] + counts[c];
+    }
+    cell_segments.resize(cell_start.back());
+    vector<unsigned int> fill(cell_start.begin(), cell_start.end() - 1);
+    for(unsigned int i=0; i<n; i++) {
+        for(unsigned int cy=lo_y[i]; cy<=hi_y[i]; cy++) {
+            for(unsigned int cx=lo_x[i]; cx<=hi_x[i]; cx++) {
+                cell_segments[fill[cy * grid_nx + cx]++] = i;
+            }
+        }
+    }
+}
+
+
+
+/*****************************************************************
+ ***************** Queries. **************************************
+ *****************************************************************/
+
+
+/*
+ * @brief       Squared distance from a point to a segment.
+ * @param[out]  t           Arc length along the segment of the nearest point.
+ */
+double Track::distance2(unsigned int segment, double px, double py, double& t) const {
+    double dx = px - x[segment], dy = py - y[segment];
+    t = max(0.0, min(seg_length[segment], dx * ux[segment] + dy * uy[segment]));
+    double ex = dx - t * ux[segment], ey = dy - t * uy[segment];
+    return ex * ex + ey * ey;
+}
+
+
+/*
+ * @brief       Nearest segment by checking them all.
+ */
+unsigned int Track::nearest_linear(double px, double py) const {
+    unsigned int best = 0;
+    double best_d2 = numeric_limits<double>::infinity();
+    double t;
+    for(unsigned int i=0; i<x.size(); i++) {
+        double d2 = distance2(i, px, py, t);
+        if(d2 < best_d2) {
+            best_d2 = d2;
+            best = i;
+        }
+    }
+    return best;
+}
+
+
+/*
+ * @brief       Nearest segment from the point's grid cell, which lists every segment within reach of it.
+ */
+unsigned int Track::nearest_grid(double px, double py) const {
+    double fx = floor((px - grid_x0) / cell_size);
+    double fy = floor((py - grid_y0) / cell_size);
+    if(fx < 0 || fy < 0 || fx >= grid_nx || fy >= grid_ny)
+        return nearest_linear(px, py);
+
+    unsigned int c = (unsigned int) fy * grid_nx + (unsigned int) fx;
+    unsigned int best = 0;
+    double best_d2 = numeric_limits<double>::infinity();
+    double t;
+    for(unsigned int k=cell_start[c]; k<cell_start[c + 1]; k++) {
+        unsigned int i = cell_segments[k];
+        double d2 = distance2(i, px, py, t);
+        if(d2 < best_d2 || (d2 == best_d2 && i < best)) {
+            best_d2 = d2;
+            best = i;
+        }
+    }
+    // Something out of reach may be nearer than what the cell lists.
+    if(best_d2 > reach * reach)
+        return nearest_linear(px, py);
+    return best;
+}
+
+
+/*
+ * @brief       Walk from a segment to the nearest one along the track in either direction.
+ */
+unsigned int Track::nearest_from(unsigned int hint, double px, double py) const {
+    unsigned int n = x.size();
+    if(hint >= n)
+        return nearest_grid(px, py);
+
+    double t;
+    unsigned int best = hint;
+    double best_d2 = distance2(hint, px, py, t);
+    for(int direction=1; direction>=-1; direction-=2) {
+        unsigned int i = hint;
+        for(unsigned int steps=0; steps<n; steps++) {
+            unsigned int next = (i + n + direction) % n;
+            double d2 = distance2(next, px, py, t);
+            if(d2 > best_d2)
+                break;
+            best_d2 = d2;
+            best = next;
+            i = next;
+        }
+    }
+    if(best_d2 > reach * reach)
+        return nearest_grid(px, py);
+    return best;
+}
+
+
+/*
+ * @brief       The query result for a point and its nearest segment.
+ */
+TrackQuery Track::describe(unsigned int segment, double px, double py) const {
+    double t;
+    double d = sqrt(distance2(segment, px, py, t));
+    double cross = ux[segment] * (py - y[segment]) - uy[segment] * (px - x[segment]);
+    unsigned int next = (segment + 1) % x.size();
+    double f = seg_length[segment] > 0 ? t / seg_length[segment] : 0;
+
+    TrackQuery q;
+    q.segment = segment;
+    q.s = s_start[segment] + t;
+    q.cte = cross < 0 ? -d : d;
+    q.heading = seg_heading[segment];
+    q.curvature = (1 - f) * vertex_curvature[segment] + f * vertex_curvature[next];
+    return q;
+}
+
+
+/*
+ * @brief       Locate a point relative to the track, from scratch.
+ */
+TrackQuery Track::query(double px, double py) const {
+    return describe(nearest_grid(px, py), px, py);
+}
+
+
+/*
+ * @brief       Locate a point relative to the track, starting from its previous segment.
+ * @param[in]   hint        The segment of the previous query for the same car.
+ */
+TrackQuery Track::query(double px, double py, unsigned int hint) const {
+    return describe(nearest_from(hint, px, py), px, py);
+}
+
+
+/*
+ * @brief       Locate a point by checking every segment; for testing the index.
+ */
+TrackQuery Track::query_linear(double px, double py) const {
+    return describe(nearest_linear(px, py), px, py);
+}
+
+
+/*
+ * @brief       A yaw relative to the track direction at a queried point, in [-pi, pi).
+ */
+double Track::heading_error(const TrackQuery& q, double yaw) const {
+    return wrap_angle(yaw - q.heading);
+}
+
+
+/*
+ * @brief       The centerline point and direction at an arc length (wrapped to the lap).
+ */
+void Track::position(double s, double& px, double& py, double& heading) const {
+    s -= length * floor(s / length);
+    unsigned int i = upper_bound(s_start.begin(), s_start.end(), s) - s_start.begin() - 1;
+    double t = s - s_start[i];
+    px = x[i] + t * ux[i];
+    py = y[i] + t * uy[i];
+    heading = seg_heading[i];
+}
+
+
+/*
+ * @brief       Number of waypoints (and segments).
+ */
+unsigned int Track::size() const {
+    return x.size();
+}
+
+
+/*
+ * @brief       Length of one lap [m].
+ */
+double Track::get_length() const {
+    return length;
+}
+
+
+void synthetic_waypoints(vector<double>& x, vector<double>& y, double spacing) {
+    x.clear();
+    y.clear();
+    unsigned int n = (unsigned int) (2 * M_PI * SYNTHETIC_RADIUS / spacing);
+    for(unsigned int i=0; i<n; i++) {
+        double theta = 2 * M_PI * i / n;
+        double r = SYNTHETIC_RADIUS * (1 + 0.25 * sin(2 * theta) + 0.1 * sin(3 * theta + 1.0));
+        x.push_back(r * cos(theta));
+        y.push_back(r * sin(theta));
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef TRACK_H
+#define TRACK_H
+
+#include <string>
+#include <vector>
+
+// Distance from the centerline [m] within which queries never fall back to a linear scan.
+#define TRACK_REACH 8.0
+
+// Mean radius of the synthetic test track [m].
+#define SYNTHETIC_RADIUS 150.0
+
+
+/*
+ * Where a point is relative to the track.
+ */
+struct TrackQuery {
+  unsigned int segment;   // index of the nearest centerline segment
+  double s;               // arc length of the nearest centerline point [m]
+  double cte;             // signed distance from the centerline, positive to the left [m]
+  double heading;         // direction of the centerline there [rad]
+  double curvature;       // of the centerline there, positive turning left [1/m]
+};
+
+
+/*
+ * A closed centerline given by waypoints, for computing cte the way the
+ * simulator does (distance to the polyline) from a car's position.
+ *
+ * The polyline is parameterized by arc length, and its segments are binned in
+ * a uniform grid, each cell listing the segments within `reach` of it. A query
+ * looks at one cell, so it is O(1) expected, and returns the exact nearest
+ * segment; points farther than `reach` from the track fall back to a linear scan.
+ *
+ * A query with a hint (the car's previous segment) instead walks the polyline
+ * from there to the nearest segment along it, which usually touches two or three
+ * segments. That differs from the global nearest only where the track passes
+ * within `reach` of itself, where following the car along the track is the better answer anyway.
+ */
+class Track {
+
+private:
+  // Vertices; segment i runs from vertex i to vertex i + 1 (mod n).
+  std::vector<double> x, y;
+  std::vector<double> s_start;
+  std::vector<double> seg_length;
+  std::vector<double> ux, uy;         // unit direction of each segment
+  std::vector<double> seg_heading;
+  std::vector<double> vertex_curvature;
+  double length;
+  double reach;
+
+  // Uniform grid, segments of each cell stored contiguously (cell c's are
+  // cell_segments[cell_start[c] .. cell_start[c + 1])).
+  double grid_x0, grid_y0, cell_size;
+  unsigned int grid_nx, grid_ny;
+  std::vector<unsigned int> cell_start;
+  std::vector<unsigned int> cell_segments;
+
+  void build();
+  double distance2(unsigned int segment, double px, double py, double& t) const;
+  unsigned int nearest_linear(double px, double py) const;
+  unsigned int nearest_grid(double px, double py) const;
+  unsigned int nearest_from(unsigned int hint, double px, double py) const;
+  TrackQuery describe(unsigned int segment, double px, double py) const;
+
+public:
+  Track(double reach=TRACK_REACH);
+
+  bool load(const std::string& fname, double spacing=0);
+  void set_waypoints(const std::vector<double>& x, const std::vector<double>& y, double spacing=0);
+
+  TrackQuery query(double px, double py) const;
+  TrackQuery query(double px, double py, unsigned int hint) const;
+  TrackQuery query_linear(double px, double py) const;
+  double heading_error(const TrackQuery& q, double yaw) const;
+  void position(double s, double& px, double& py, double& heading) const;
+
+  unsigned int size() const;
+  double get_length() const;
+};
+
+
+/*
+ * Waypoints every `spacing` meters along a closed test track about 1 km long, driven
+ * counterclockwise: a circle with a few radial harmonics, giving straights, sweepers
+ * and a couple of tighter turns.
+ */
+void synthetic_waypoints(std::vector<double>& x, std::vector<double>& y, double spacing=1.0);
+
+
+#endif /* TRACK_H */
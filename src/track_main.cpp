@@ -0,0 +1,115 @@
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstring>    // strcmp
+#include <cstdlib>    // atoi, atof
+
+#include "track.h"
+#include "say_time.h"
+
+// Set parameters.
+#define NQUERIES 1000000
+#define OFFSET 4.0
+
+/*
+ * Load a track's centerline (or make up one), and time and check cte queries
+ * at random points along it.
+ *
+ *   ./track waypoints.csv [--spacing M] [--queries N] [--export FILE]
+ *   ./track --synthetic [--spacing M] [--queries N] [--export FILE]
+ *
+ * waypoints.csv has one "x,y" per line. --spacing resamples a spline through the
+ * waypoints; --export writes the centerline's waypoints as x,y lines.
+ */
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " {waypoints.csv | --synthetic} [--spacing M] [--queries N]"
+                  << " [--export FILE]" << std::endl;
+        return -1;
+    }
+
+    std::string fname;
+    bool synthetic = false;
+    double spacing = 0;
+    unsigned int nqueries = NQUERIES;
+    std::string export_fname;
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--synthetic") == 0) {
+            synthetic = true;
+        } else if(strcmp(argv[i], "--spacing") == 0 && has_value) {
+            spacing = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--queries") == 0 && has_value) {
+            nqueries = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--export") == 0 && has_value) {
+            export_fname = argv[++i];
+        } else {
+            fname = argv[i];
+        }
+    }
+
+    Track track;
+    if(synthetic) {
+        std::vector<double> x, y;
+        synthetic_waypoints(x, y, spacing > 0 ? spacing : 1.0);
+        track.set_waypoints(x, y);
+    } else if(!track.load(fname, spacing)) {
+        std::cerr << "Could not read at least three waypoints from " << fname << std::endl;
+        return -1;
+    }
+    say_time(); std::cout << "Track of " << track.size() << " waypoints, " << track.get_length() << " m per lap." << std::endl;
+
+    if(!export_fname.empty()) {
+        std::ofstream f(export_fname);
+        for(unsigned int i=0; i<track.size(); i++) {
+            double px, py, heading;
+            track.position(track.get_length() * i / track.size(), px, py, heading);
+            f << px << "," << py << std::endl;
+        }
+    }
+    if(nqueries == 0)
+        return 0;
+
+    // Points within OFFSET of the centerline, in driving order, as a car would report them.
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> offset(-OFFSET, OFFSET);
+    std::vector<double> qx(nqueries), qy(nqueries), expected(nqueries);
+    for(unsigned int i=0; i<nqueries; i++) {
+        double px, py, heading;
+        double d = offset(rng);
+        track.position(3 * track.get_length() * i / nqueries, px, py, heading);
+        qx[i] = px - d * sin(heading);
+        qy[i] = py + d * cos(heading);
+    }
+
+    // Warm-started results are checked against a linear scan on a prefix.
+    unsigned int nchecked = std::min(nqueries, 20000u);
+    unsigned int mismatches = 0;
+    double sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(unsigned int i=0; i<nqueries; i++) {
+        sum += track.query(qx[i], qy[i]).cte;
+    }
+    double cold_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    unsigned int hint = track.query(qx[0], qy[0]).segment;
+    for(unsigned int i=0; i<nqueries; i++) {
+        TrackQuery q = track.query(qx[i], qy[i], hint);
+        hint = q.segment;
+        expected[i] = q.cte;
+        sum += q.cte;
+    }
+    double warm_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    for(unsigned int i=0; i<nchecked; i++) {
+        if(fabs(fabs(expected[i]) - fabs(track.query_linear(qx[i], qy[i]).cte)) > 1e-9)
+            mismatches++;
+    }
+
+    say_time(); std::cout << "Queries: " << cold_ns / nqueries << " ns cold, " << warm_ns / nqueries << " ns warm-started." << std::endl;
+    say_time(); std::cout << mismatches << " of " << nchecked << " |cte| differ from a linear scan (checksum " << sum << ")." << std::endl;
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+#include "track_sim.h"
+#include <cmath>
+#include <algorithm>  // std::min, std::max, std::fill
+
+using namespace std;
+
+
+/*
+ * @brief       Construct the simulator on a track, which must outlive it.
+ * @param[in]   params      Vehicle parameters; initial_cte offsets the start to the left of the centerline.
+ * @param[in]   seed        Seed for the measurement noise.
+ */
+TrackSimulator::TrackSimulator(const Track& track, SimParams params, unsigned int seed)
+        : track(track), params(params), noise(0.0, 1.0), seed(seed) {
+    this->params.delay = min(params.delay, (unsigned int) MAX_DELAY);
+    reset();
+}
+
+
+/*
+ * @brief       Put the car back at the start line, pointing along the track.
+ */
+void TrackSimulator::reset() {
+    rng.seed(seed);
+    noise.reset();
+    double px, py;
+    track.position(0, px, py, yaw);
+    x = px - params.initial_cte * sin(yaw);
+    y = py + params.initial_cte * cos(yaw);
+    v = params.initial_speed * MPH2MPS;
+    angle = 0;
+    steps = 0;
+    crashed = false;
+    fill(pending_steer, pending_steer + MAX_DELAY + 1, 0.0);
+    fill(pending_throttle, pending_throttle + MAX_DELAY + 1, 0.0);
+
+    TrackQuery q = track.query(x, y);
+    segment = q.segment;
+    s = q.s;
+    cte = q.cte;
+}
+
+
+/*
+ * @brief       Find the car on the track, walking from the previous segment.
+ */
+void TrackSimulator::locate() {
+    TrackQuery q = track.query(x, y, segment);
+    segment = q.segment;
+    s = q.s;
+    cte = q.cte;
+}
+
+
+/*
+ * @brief       Advance one control period.
+ * @param[in]   steer       Steering command in [-1, 1]; positive steers left, toward positive cte, as OfflineSimulator.
+ * @param[in]   throttle    Throttle command in [-1, 1].
+ */
+void TrackSimulator::step(double steer, double throttle) {
+    // The command takes effect params.delay periods from now; apply the one given that long ago.
+    unsigned int slots = params.delay + 1;
+    pending_steer[steps % slots] = steer;
+    pending_throttle[steps % slots] = throttle;
+    steer = pending_steer[(steps + 1) % slots];
+    throttle = pending_throttle[(steps + 1) % slots];
+    steps++;
+
+    // Once off the road, the car is stuck against the wall, as in Unity.
+    if(crashed)
+        return;
+
+    steer = max(-1.0, min(1.0, steer));
+    throttle = max(-1.0, min(1.0, throttle));
+    angle = steer * params.max_angle;
+    double delta = angle * M_PI / 180.0;
+
+    double h = params.dt / params.substeps;
+    for(unsigned int i=0; i<params.substeps; i++) {
+        // Semi-implicit Euler: update speed and heading first, then position.
+        v += h * (params.accel_gain * throttle - params.drag * v);
+        v = max(0.0, v);
+        yaw += h * v / params.wheelbase * tan(delta);
+        x += h * v * cos(yaw);
+        y += h * v * sin(yaw);
+    }
+    locate();
+
+    if(fabs(cte) > params.road_halfwidth) {
+        crashed = true;
+        v = 0;
+    }
+}
+
+
+/*
+ * @brief       The cte as reported in telemetry, including measurement noise.
+ */
+double TrackSimulator::measured_cte() {
+    if(params.cte_noise > 0)
+        return cte + params.cte_noise * noise(rng);
+    return cte;
+}
+
+
+/*
+ * @brief       Speed in the simulator's telemetry unit.
+ */
+double TrackSimulator::speed_mph() const {
+    return v / MPH2MPS;
+}
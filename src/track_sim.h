@@ -0,0 +1,54 @@
+#ifndef TRACK_SIM_H
+#define TRACK_SIM_H
+
+#include <random>
+#include "offline_sim.h"
+#include "track.h"
+
+
+/*
+ * The offline model's kinematic bicycle, integrated in world coordinates on a
+ * Track instead of in the road's frame: cte is the car's signed distance to the
+ * centerline polyline, as the Unity simulator computes it, looked up with the
+ * previous segment as a hint. SimParams' lap_length (and curvature profile) do
+ * not apply; the track's do.
+ */
+class TrackSimulator {
+
+private:
+  const Track& track;
+  SimParams params;
+  std::mt19937 rng;
+  std::normal_distribution<double> noise;
+  unsigned int seed;
+
+  unsigned int segment;   // nearest centerline segment at the last query
+
+  // Commands not yet applied, indexed by the step they were given at modulo delay + 1.
+  double pending_steer[MAX_DELAY + 1];
+  double pending_throttle[MAX_DELAY + 1];
+
+  void locate();
+
+public:
+  /*
+   * State
+   */
+  double x, y;        // position [m]
+  double yaw;         // heading, counterclockwise from +x [rad]
+  double v;           // speed [m/s]
+  double angle;       // last applied steering angle [deg]
+  double s;           // arc length of the nearest centerline point [m]
+  double cte;         // signed distance from the centerline, positive to the left [m]
+  unsigned long steps;
+  bool crashed;
+
+  TrackSimulator(const Track& track, SimParams params=SimParams(), unsigned int seed=0);
+
+  void reset();
+  void step(double steer, double throttle);
+  double measured_cte();
+  double speed_mph() const;
+};
+
+#endif /* TRACK_SIM_H */
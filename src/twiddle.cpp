@@ -1,13 +1,31 @@
 #include "twiddle.h"
+#include "sprt.h"
 #include <iostream>
 #include <cmath>
 #include <chrono>
 #include <algorithm> //  min, max
+#include <cstring>   // strcmp
+#include <cstdlib>   // atof, atoi
+#include <fstream>
+#include <sstream>
 
 using namespace std;
 
 constexpr double DEFAULT_DIFF_PARAMS = 0.01;
 
+// Give up filtering after this many consecutive rejections, rather than spin.
+constexpr unsigned int MAX_REJECTIONS = 1000;
+
+// Score of a probe failed right away; one failed after k scored samples scores k less,
+// so failures rank below every finished window, and lasting longer is better.
+constexpr double FAILED_OBJECTIVE = 1e6;
+
+// Freeze gains whose total-order sensitivity index is below this by default.
+constexpr double DEFAULT_FREEZE_BELOW = 0.05;
+
+// Segments the starting gains drive, in sequential mode, before the first probe.
+constexpr unsigned int SPRT_BASELINE_SEGMENTS = 2;
+
 
 /*****************************************************************
  ***************** Twiddle parameters to reduce an error signal. *
@@ -34,6 +52,8 @@ Twiddler::Twiddler(int nparams=3, double tol=0.0001) {
     last_change = NONE;
 
     declared_convergence = false;
+    has_verdict = false;
+    verdict = false;
 }
 
 // TODO: Replace this spaghetti pile with, Idunno, ravioli?
@@ -48,6 +68,9 @@ bool Twiddler::twiddle(double error) {
     if(declared_convergence)
         return true;
 
+    // Frozen parameters are never probed.
+    skip_frozen();
+
     // If we've finished the last parameter loop, check for convergence.
     if(i_param == parameters.size()) {
 
@@ -58,8 +81,9 @@ bool Twiddler::twiddle(double error) {
 
         // Sum the increment vector.
         double sdp = 0;
-        for(auto& d : diff_parameters) {
-            sdp += d;
+        for(unsigned int i=0; i<diff_parameters.size(); i++) {
+            if(!frozen[i])
+                sdp += diff_parameters[i];
         }
 
         // Check for convergence.
@@ -73,6 +97,7 @@ bool Twiddler::twiddle(double error) {
             // If we haven't converged, reset the counter for the next loop.
             cout << "Not yet converged. sum(dp)=" << sdp << " > tol=" << tol << endl;
             i_param = 0;
+            skip_frozen();
         }
     }
 
@@ -131,11 +156,26 @@ bool Twiddler::twiddle(double error) {
 }
 
 
+/*
+ * @brief       Make changes to parameters vector based on a decision already taken about the latest probe.
+ * @param[in]   error       The probe's error, recorded as the best one if it improved.
+ * @param[in]   improved    Whether the probe beats the best parameters, e.g. by a sequential test.
+ * @return      Whether convergence was achieved
+ */
+bool Twiddler::twiddle(double error, bool improved) {
+    has_verdict = true;
+    verdict = improved;
+    bool converged = twiddle(error);
+    has_verdict = false;
+    return converged;
+}
+
+
 /*
  * @brief       Trump up a simple comparison to a fancy print.
  */
 bool Twiddler::check_error(double error) {
-    bool result = error < best_error;
+    bool result = has_verdict ? verdict : error < best_error;
     cout << "err=" << error;
     if(result) {
         cout << " < ";
@@ -156,6 +196,7 @@ void Twiddler::succeed(double error) {
     diff_parameters[i_param] *= 1.5;
     say_time(); vec_print(diff_parameters, "dp");
     best_error = error;
+    best_parameters = parameters;
     say_time(); cout << "Best error decreased to " << best_error << "." << endl;
     moveOn(error);
 }
@@ -173,6 +214,16 @@ void Twiddler::fail(double error) {
 }
 
 
+/*
+ * @brief       Move past frozen parameters, if the loop is not already done.
+ */
+void Twiddler::skip_frozen() {
+    while(i_param < parameters.size() && frozen[i_param]) {
+        i_param++;
+    }
+}
+
+
 /*
  * @brief       When we've tried increasing and decreasing a parameter and one or neither worked, continue to the next parameter.
  */
@@ -195,6 +246,14 @@ std::vector<double> Twiddler::get_params() {
 }
 
 
+/*
+ * @brief       The parameters that scored the best error so far (the starting ones before any did).
+ */
+std::vector<double> Twiddler::get_best_params() {
+    return best_parameters;
+}
+
+
 /*
  * @brief       Update/reset the parameters vector.
  */
@@ -202,6 +261,8 @@ void Twiddler::set_params(vector<double> new_parameters) {
     cout << "Changed p from" << endl;
     vec_print(parameters, "p");
     parameters = new_parameters;
+    best_parameters = new_parameters;
+    frozen.resize(parameters.size(), false);
     cout << "to" << endl;
     vec_print(parameters, "p");
 }
@@ -219,6 +280,17 @@ void Twiddler::set_diff_params(vector<double> new_diff_parameters) {
 }
 
 
+/*
+ * @brief       Hold some parameters at their current values: they are skipped, and their
+ *              steps do not count towards convergence.
+ * @param[in]   new_frozen  One flag per parameter.
+ */
+void Twiddler::set_frozen(vector<bool> new_frozen) {
+    frozen = new_frozen;
+    frozen.resize(parameters.size(), false);
+}
+
+
 /*
  * @brief       Getter for the convergence state.
  */
@@ -227,6 +299,30 @@ bool Twiddler::is_converged() {
 }
 
 
+/*
+ * @brief       Getter for the number of completed loops over all parameters.
+ */
+int Twiddler::get_iterations() {
+    return iterations;
+}
+
+
+/*
+ * @brief       Getter for the best error seen so far.
+ */
+double Twiddler::get_best_error() {
+    return best_error;
+}
+
+
+/*
+ * @brief       Replace the best error with a fresh estimate for the same best parameters.
+ */
+void Twiddler::set_best_error(double error) {
+    best_error = error;
+}
+
+
 
 /*****************************************************************
  ***************** Control the parameter-twiddling process. *******
@@ -250,10 +346,49 @@ TwiddlerManager::TwiddlerManager(std::vector<PID*>& pids, unsigned int tmax, dou
     this->tmin = tmin;
 
     num_discarded = 0;
+    num_windows = 0;
+    num_gain_changes = 0;
+    last_objective = numeric_limits<double>::quiet_NaN();
+    const double nan = numeric_limits<double>::quiet_NaN();
+    window_tails = {nan, nan, nan, nan};
 
     lambda_mean = 2.0;
     lambda_stdd = 1.0;
+    lambda_tail = 0.0;
+
+    window_distance = 0;
+    reset_between = false;
+    odometer = 0;
+    next_boundary = 0;
+    reset_requested = false;
+
+    recovering = false;
+    settled_cte = 1.0;
+    settled_samples = 0;
+    recovery_samples = 0;
+    recovery_crossed = false;
+
+    sprt = nullptr;
+    segment = 0;
+    sprt_on_probe = true;
+    sprt_baseline = true;
+    pending_probe = numeric_limits<double>::quiet_NaN();
+    pending_incumbent = numeric_limits<double>::quiet_NaN();
+    incumbent_sum = 0;
+    incumbent_count = 0;
+
+    // A window never holds more than tmax samples, so it never grows on the hot path.
+    errors.reserve(tmax);
+
+    reload_params();
+}
+
 
+/*
+ * @brief       (Re)start twiddling from the PIDs' current coefficients,
+ *              e.g. after they were set by an autotuner.
+ */
+void TwiddlerManager::reload_params() {
     int nparams = pids.size() * 3;
 
     // Extract the existing parameters.
@@ -275,6 +410,15 @@ TwiddlerManager::TwiddlerManager(std::vector<PID*>& pids, unsigned int tmax, dou
     }
     twiddler.set_params(new_parameters);
     twiddler.set_diff_params(new_diff_parameters);
+
+    // Start a fresh evaluation window.
+    errors.clear();
+    window_sketch.clear();
+    num_discarded = 0;
+
+    // The best gains changed: their estimate starts over, along with any test in progress.
+    if(sprt)
+        restart_sprt();
 }
 
 
@@ -282,26 +426,79 @@ TwiddlerManager::TwiddlerManager(std::vector<PID*>& pids, unsigned int tmax, dou
  * @brief       Record an error value and maybe do some twiddling with it.
  */
 void TwiddlerManager::process_error(double error) {
+    process_error(error, 0);
+}
+
+
+/*
+ * @brief       Record an error value and the distance driven since the last one, and maybe do some twiddling.
+ * @param[in]   ds          Distance driven since the previous sample [m]; only used with set_window_distance.
+ */
+void TwiddlerManager::process_error(double error, double ds) {
+
+    // Recovering from a failed probe: nothing is scored until the car is back near the centerline
+    // (and, with distance windows, at a window boundary).
+    if(recovering) {
+        odometer += ds;
+        if(window_distance > 0 && odometer >= next_boundary) {
+            recovery_crossed = true;
+            while(next_boundary <= odometer) {
+                next_boundary += window_distance;
+            }
+        }
+        settled_samples = fabs(error) < settled_cte ? settled_samples + 1 : 0;
+        recovery_samples++;
+        if(settled_samples >= max(tmin, 1u) && (window_distance == 0 || recovery_crossed)) {
+            say_time(); cout << "Recovered; resuming with the next probe." << endl;
+            recovering = false;
+            apply_params(twiddler.get_params());
+        } else if(recovery_samples >= tmax) {
+            // Stuck, e.g. against a wall: ask for a reset after all.
+            say_time(); cout << "No recovery after " << recovery_samples << " samples; requesting a reset." << endl;
+            recovering = false;
+            apply_params(twiddler.get_params());
+            odometer = 0;
+            next_boundary = window_distance;
+            reset_requested = true;
+        }
+        return;
+    }
+
+    if(sprt) {
+        process_segment(error);
+        return;
+    }
 
     // Save the error history.
 
+    lap_sketch.add(fabs(error));
     if(num_discarded >= tmin) {
         errors.push_back(error);
-        absolute_errors.push_back(fabs(error));
+        window_sketch.add(fabs(error));
     } else {
         num_discarded++;
     }
 
-    // If we've added up enough errors, take a mean.
-    if(errors.size() >= tmax - tmin) {
+    // If we've added up enough errors, or driven to the end of the window's stretch of track, take a mean.
+    // With distance windows, tmax - tmin samples is only a cap, for a car that stopped.
+    odometer += ds;
+    bool at_boundary = window_distance > 0 && odometer >= next_boundary && !errors.empty();
+    if(errors.size() >= tmax - tmin || at_boundary) {
 
-        double mae = vec_mean(absolute_errors);
-        double sae = vec_stdd(absolute_errors, mae);
+        VecStats stats = vec_stats(errors);
+        double mae = stats.mae;
+        double sae = stats.mae_stdd;
+        double me  = stats.mean;
+        double se  = stats.stdd;
 
-        double me  = vec_mean(errors);
-        double se  = vec_stdd(errors, me);
+        window_tails = tail_quantiles(window_sketch);
+        window_sketch.clear();
 
-        double objective = lambda_mean * mae + lambda_stdd * se;
+        double objective = twiddle_objective(mae, se, lambda_mean, lambda_stdd);
+        if(lambda_tail != 0)
+            objective += lambda_tail * window_tails.p95;
+        num_windows++;
+        last_objective = objective;
 
         if(!twiddler.is_converged()) {
             say_time(); cout << "Run stats (" << errors.size() << " samples):" << endl;
@@ -309,23 +506,510 @@ void TwiddlerManager::process_error(double error) {
             say_time(); cout << "    Stdd absolute error = " << sae << endl;
             say_time(); cout << "    Mean error          = " << me << endl;
             say_time(); cout << "   >Stdd error          = " << se << endl;
+            say_time(); cout << "    |cte| p50/p95/p99/max = " << window_tails.p50 << " / " << window_tails.p95
+                             << " / " << window_tails.p99 << " / " << window_tails.max << endl;
             say_time(); cout << "   ==> objective = " << objective << endl;
         }
 
         // Then twiddle the parameters.
         twiddler.twiddle(objective);
+        apply_filter();
 
         // Apply the new parameters to the PIDs.
-        int i = 0;
-        vector<double> p = twiddler.get_params();
-        for(auto &pid : pids) {
-            pid->Init(fabs(p[i*3]), fabs(p[i*3+1]), fabs(p[i*3+2]));
-            i++;
-        }
+        apply_params(twiddler.get_params());
 
         // Clear the run.
-        absolute_errors.clear();
         errors.clear();
 
+        // The next window covers the next stretch, or with resets the same one again.
+        if(window_distance > 0) {
+            if(reset_between) {
+                odometer = 0;
+                next_boundary = window_distance;
+                reset_requested = true;
+            } else {
+                while(next_boundary <= odometer) {
+                    next_boundary += window_distance;
+                }
+            }
+        }
+    }
+}
+
+
+/*
+ * @brief       Record an error value in sequential mode, and when a segment is complete, score it and maybe decide.
+ */
+void TwiddlerManager::process_segment(double error) {
+
+    lap_sketch.add(fabs(error));
+    if(twiddler.is_converged())
+        return;
+
+    // Skip the transient after each change of gains.
+    if(num_discarded < tmin) {
+        num_discarded++;
+        return;
+    }
+    errors.push_back(error);
+    window_sketch.add(fabs(error));
+    if(errors.size() < segment)
+        return;
+
+    double objective = segment_objective();
+
+    // Every segment of the best gains refines their estimate, which is what probes are compared with.
+    if(sprt_baseline || !sprt_on_probe) {
+        incumbent_sum += objective;
+        incumbent_count++;
+        twiddler.set_best_error(incumbent_sum / incumbent_count);
+    }
+
+    // Before the first probe, drive the starting gains for a couple of segments.
+    if(sprt_baseline) {
+        if(incumbent_count >= SPRT_BASELINE_SEGMENTS) {
+            say_time(); cout << "Baseline objective " << twiddler.get_best_error() << " over "
+                             << incumbent_count << " segments." << endl;
+            twiddler.twiddle(twiddler.get_best_error());
+            apply_filter();
+            sprt_baseline = false;
+            start_segment(true);
+        }
+        return;
+    }
+
+    if(sprt_on_probe) {
+        pending_probe = objective;
+    } else {
+        pending_incumbent = objective;
+    }
+    if(isnan(pending_probe) || isnan(pending_incumbent)) {
+        start_segment(!sprt_on_probe);
+        return;
+    }
+
+    sprt_verdict_t verdict = sprt->add(pending_probe, pending_incumbent);
+    say_time(); cout << "Pair " << sprt->size() << ": probe " << pending_probe << ", best " << pending_incumbent
+                     << "; log likelihood ratio " << sprt->llr() << endl;
+    pending_probe = numeric_limits<double>::quiet_NaN();
+    pending_incumbent = numeric_limits<double>::quiet_NaN();
+
+    // Undecided: the next pair starts with the gains already on, probe and best alternating ABBA.
+    if(verdict == SPRT_CONTINUE) {
+        start_segment(sprt_on_probe);
+        return;
     }
+
+    double probe_mean = sprt->probe_mean();
+    unsigned int npairs = sprt->size();
+    say_time(); cout << "Decided after " << npairs << " pairs (" << 2 * npairs * segment << " scored samples): probe "
+                     << (verdict == SPRT_BETTER ? "better" : "not better") << ", " << probe_mean << " vs "
+                     << sprt->incumbent_mean() << endl;
+    sprt->clear();
+
+    twiddler.twiddle(probe_mean, verdict == SPRT_BETTER);
+    apply_filter();
+
+    // An accepted probe is the new best, with its segments as the estimate so far.
+    if(verdict == SPRT_BETTER) {
+        incumbent_sum = probe_mean * npairs;
+        incumbent_count = npairs;
+    }
+
+    if(twiddler.is_converged()) {
+        apply_params(twiddler.get_best_params());
+        return;
+    }
+    // Start the next test with the gains already on, if they are still the best: the incumbent's after a
+    // rejection, or an accepted probe's, which now are the best.
+    bool on_best = sprt_on_probe ? verdict == SPRT_BETTER : verdict != SPRT_BETTER;
+    start_segment(!on_best);
+}
+
+
+/*
+ * @brief       Score the segment just driven, and start the next one empty.
+ */
+double TwiddlerManager::segment_objective() {
+    VecStats stats = vec_stats(errors);
+    window_tails = tail_quantiles(window_sketch);
+    double objective = twiddle_objective(stats.mae, stats.stdd, lambda_mean, lambda_stdd);
+    if(lambda_tail != 0)
+        objective += lambda_tail * window_tails.p95;
+
+    // Logged like a window's, for pidlog, plot.py and /tune.
+    say_time(); cout << "Segment stats (" << errors.size() << " samples, "
+                     << (sprt_on_probe && !sprt_baseline ? "probe" : "best") << " gains):" << endl;
+    say_time(); cout << "   >Mean absolute error = " << stats.mae << endl;
+    say_time(); cout << "   >Stdd error          = " << stats.stdd << endl;
+    say_time(); cout << "    |cte| p50/p95/p99/max = " << window_tails.p50 << " / " << window_tails.p95
+                     << " / " << window_tails.p99 << " / " << window_tails.max << endl;
+    say_time(); cout << "   ==> objective = " << objective << endl;
+
+    num_windows++;
+    last_objective = objective;
+    errors.clear();
+    window_sketch.clear();
+    return objective;
+}
+
+
+/*
+ * @brief       Drive the next segment with the probe's gains or the best ones; the transient
+ *              is only discarded when that changes the gains.
+ */
+void TwiddlerManager::start_segment(bool probe) {
+    sprt_on_probe = probe;
+    vector<double> p = probe ? twiddler.get_params() : twiddler.get_best_params();
+    if(p != segment_params) {
+        segment_params = p;
+        apply_params(p);
+        num_discarded = 0;
+    }
+}
+
+
+/*
+ * @brief       Drop the test in progress and the estimate of the best gains, and start over from them.
+ */
+void TwiddlerManager::restart_sprt() {
+    sprt->clear();
+    pending_probe = numeric_limits<double>::quiet_NaN();
+    pending_incumbent = numeric_limits<double>::quiet_NaN();
+    incumbent_sum = 0;
+    incumbent_count = 0;
+    segment_params.clear();
+    sprt_baseline = true;
+    start_segment(false);
+}
+
+
+/*
+ * @brief       Set the PIDs' coefficients from a parameter vector, three per PID.
+ */
+void TwiddlerManager::apply_params(const vector<double>& p) {
+    num_gain_changes++;
+    int i = 0;
+    for(auto &pid : pids) {
+        pid->Init(fabs(p[i*3]), fabs(p[i*3+1]), fabs(p[i*3+2]));
+        i++;
+    }
+}
+
+
+/*
+ * @brief       Stop the current window early and score its probe as failed, e.g. when the car left the road:
+ *              FAILED_OBJECTIVE less the samples it lasted. In sequential mode, a failure while the best gains
+ *              drive (an incumbent or baseline segment) only voids the test in progress: the probe is not scored.
+ * @param[in]   recover         Drive with the best gains so far until |cte| stays below settled_cte for
+ *                              tmin samples, then go on with the next probe; after tmax samples without
+ *                              settling, request a reset (see take_reset) instead. Otherwise the caller resets
+ *                              the simulator, and the next probe starts right away from the start line.
+ * @param[in]   settled_cte     [m]
+ */
+void TwiddlerManager::fail_window(bool recover, double settled_cte) {
+    num_windows++;
+    last_objective = FAILED_OBJECTIVE - (double) errors.size();
+    bool probe_driving = !sprt || (sprt_on_probe && !sprt_baseline);
+    say_time(); cout << (probe_driving ? "Probe" : "Best gains") << " failed after " << errors.size()
+                     << " scored samples; objective = " << last_objective << endl;
+
+    if(sprt) {
+        // The test is void; the next one starts with the probe, whose gains are on after recovering.
+        sprt->clear();
+        pending_probe = numeric_limits<double>::quiet_NaN();
+        pending_incumbent = numeric_limits<double>::quiet_NaN();
+    }
+    if(probe_driving) {
+        // A failed probe never improved, even while the best objective is still unknown (infinite).
+        twiddler.twiddle(last_objective, false);
+        apply_filter();
+    }
+
+    errors.clear();
+    window_sketch.clear();
+    num_discarded = 0;
+    sprt_on_probe = true;
+    segment_params = twiddler.get_params();
+
+    if(recover) {
+        recovering = true;
+        this->settled_cte = settled_cte;
+        settled_samples = 0;
+        recovery_samples = 0;
+        recovery_crossed = false;
+        apply_params(twiddler.get_best_params());
+    } else {
+        apply_params(twiddler.get_params());
+        odometer = 0;
+        next_boundary = window_distance;
+    }
+}
+
+
+/*
+ * @brief       Whether the PIDs are driving with the best gains after a failed probe, scoring nothing.
+ */
+bool TwiddlerManager::is_recovering() {
+    return recovering;
+}
+
+
+/*
+ * @brief       End windows at track positions instead of after a sample count, so every
+ *              candidate is scored on the same mix of straights and curves.
+ * @param[in]   meters          Window length, e.g. a whole lap; windows end each time the distance
+ *                              driven since now passes a multiple of it. 0 goes back to sample counts.
+ * @param[in]   reset_between   Put the car back at the start line after each window (see take_reset),
+ *                              so every window is the same stretch from the same initial condition.
+ */
+void TwiddlerManager::set_window_distance(double meters, bool reset_between) {
+    window_distance = meters;
+    this->reset_between = reset_between;
+    odometer = 0;
+    next_boundary = meters;
+    say_time(); cout << "Evaluation windows end every " << meters << " m"
+                     << (reset_between ? ", with a reset in between." : ".") << endl;
+}
+
+
+/*
+ * @brief       Decide each probe by a sequential test instead of one window: probe and best gains drive
+ *              alternate segments, paired, until the test resolves, so a decision takes as many samples as
+ *              the noise calls for. The best objective is re-estimated from every segment of the best gains.
+ *              Window distances and resets do not apply.
+ * @param[in]   sprt        The test, owned by the caller
+ * @param[in]   segment     Scored samples per segment, after tmin discarded ones when the gains change
+ */
+void TwiddlerManager::set_sprt(PairedSPRT* sprt, unsigned int segment) {
+    this->sprt = sprt;
+    this->segment = max(segment, 1u);
+    say_time(); cout << "Sequential decisions over paired segments of " << this->segment << " samples." << endl;
+    restart_sprt();
+}
+
+
+/*
+ * @brief       Whether a window just ended and the simulator should be reset; clears the request.
+ */
+bool TwiddlerManager::take_reset() {
+    bool requested = reset_requested;
+    reset_requested = false;
+    return requested;
+}
+
+
+/*
+ * @brief       Whether the underlying twiddler has converged.
+ */
+bool TwiddlerManager::is_converged() {
+    return twiddler.is_converged();
+}
+
+
+/*
+ * @brief       Number of evaluation windows scored so far.
+ */
+unsigned long TwiddlerManager::get_num_windows() {
+    return num_windows;
+}
+
+
+/*
+ * @brief       Number of times the PIDs' coefficients were set, e.g. to compare before and after a sample.
+ */
+unsigned long TwiddlerManager::get_num_gain_changes() {
+    return num_gain_changes;
+}
+
+
+/*
+ * @brief       Number of completed twiddle loops over all parameters.
+ */
+int TwiddlerManager::get_iterations() {
+    return twiddler.get_iterations();
+}
+
+
+/*
+ * @brief       Objective of the most recent evaluation window (NaN before the first).
+ */
+double TwiddlerManager::get_last_objective() {
+    return last_objective;
+}
+
+
+/*
+ * @brief       Best objective the twiddler has accepted.
+ */
+double TwiddlerManager::get_best_objective() {
+    return twiddler.get_best_error();
+}
+
+
+/*
+ * @brief       |cte| median, tail percentiles and maximum of the last completed window (NaN before the first).
+ */
+TailQuantiles TwiddlerManager::get_window_tails() {
+    return window_tails;
+}
+
+
+/*
+ * @brief       |cte| median, tail percentiles and maximum of the lap so far.
+ */
+TailQuantiles TwiddlerManager::get_lap_tails() {
+    return tail_quantiles(lap_sketch);
+}
+
+
+/*
+ * @brief       Close the current lap: log its |cte| tails, return them and start a new lap.
+ */
+TailQuantiles TwiddlerManager::end_lap() {
+    TailQuantiles tails = tail_quantiles(lap_sketch);
+    say_time(); cout << "Lap stats (" << lap_sketch.count() << " samples): |cte| p50/p95/p99/max = "
+                     << tails.p50 << " / " << tails.p95 << " / " << tails.p99 << " / " << tails.max << endl;
+    lap_sketch.clear();
+    return tails;
+}
+
+
+/*
+ * @brief       Pre-screen every new probe, e.g. with a StabilityFilter.
+ */
+void TwiddlerManager::set_filter(CandidateFilter filter) {
+    this->filter = filter;
+}
+
+
+/*
+ * @brief       Tune only some of the gains, e.g. those the objective is sensitive to.
+ * @param[in]   frozen      One flag per parameter, steering Kp, Ki, Kd first; true holds it fixed.
+ */
+void TwiddlerManager::freeze(vector<bool> frozen) {
+    frozen.resize(pids.size() * 3, false);
+    twiddler.set_frozen(frozen);
+    say_time(); cout << "Frozen parameters:";
+    for(unsigned int i=0; i<frozen.size(); i++) {
+        if(frozen[i])
+            cout << " p[" << i << "]";
+    }
+    cout << endl;
+}
+
+
+/*
+ * @brief       Score probes the filter rejects as failures right away,
+ *              so no evaluation window is spent on them.
+ */
+void TwiddlerManager::apply_filter() {
+    if(!filter)
+        return;
+    unsigned int nrejected = 0;
+    while(!twiddler.is_converged() && !filter(twiddler.get_params()) && nrejected < MAX_REJECTIONS) {
+        say_time(); cout << "Pre-screen rejected the probe; scoring it as failed." << endl;
+        twiddler.twiddle(numeric_limits<double>::infinity());
+        nrejected++;
+    }
+}
+
+
+void parse_tail_options(int argc, char* argv[], double& lambda_tail, double& lap_length) {
+    lambda_tail = 0;
+    lap_length = 0;
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--tail-weight") == 0 && has_value) {
+            lambda_tail = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--lap-length") == 0 && has_value) {
+            lap_length = atof(argv[++i]);
+        }
+    }
+}
+
+
+void parse_window_options(int argc, char* argv[], double lap_length, double& window_distance, bool& reset_between) {
+    window_distance = 0;
+    reset_between = false;
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--window-distance") == 0 && has_value) {
+            window_distance = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--window-laps") == 0 && has_value) {
+            window_distance = atof(argv[++i]) * lap_length;
+        } else if(strcmp(argv[i], "--window-reset") == 0) {
+            reset_between = true;
+        }
+    }
+}
+
+
+vector<bool> parse_freeze_options(int argc, char* argv[], unsigned int nparams) {
+    vector<bool> frozen(nparams, false);
+    string sensitivity_fname;
+    double freeze_below = DEFAULT_FREEZE_BELOW;
+    for(int i=1; i<argc; i++) {
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--freeze") == 0 && has_value) {
+            stringstream list(argv[++i]);
+            string index;
+            while(getline(list, index, ',')) {
+                unsigned int k = atoi(index.c_str());
+                if(k < nparams)
+                    frozen[k] = true;
+            }
+        } else if(strcmp(argv[i], "--freeze-from") == 0 && has_value) {
+            sensitivity_fname = argv[++i];
+        } else if(strcmp(argv[i], "--freeze-below") == 0 && has_value) {
+            freeze_below = atof(argv[++i]);
+        }
+    }
+
+    if(!sensitivity_fname.empty()) {
+        // Lines of gain,first,first_conf,total,total_conf after a header, in parameter order.
+        ifstream f(sensitivity_fname);
+        if(!f) {
+            cerr << "Could not read " << sensitivity_fname << "; freezing nothing from it." << endl;
+            return frozen;
+        }
+        string line;
+        getline(f, line);
+        for(unsigned int k=0; k<nparams && getline(f, line); k++) {
+            stringstream fields(line);
+            string field;
+            for(unsigned int c=0; c<4; c++) {
+                getline(fields, field, ',');
+            }
+            double total = atof(field.c_str());
+            if(isnan(total)) {
+                cerr << "No total-order index for p[" << k << "] in " << sensitivity_fname << "; not freezing it." << endl;
+            } else if(total < freeze_below) {
+                frozen[k] = true;
+            }
+        }
+    }
+    return frozen;
+}
+
+
+/*
+ * @brief       The objective TwiddlerManager minimizes, for callers that score runs themselves.
+ * @param[in]   errors          The cte history of one run
+ * @param[in]   lambda_mean     Weight of the mean absolute error
+ * @param[in]   lambda_stdd     Weight of the error spread
+ */
+double twiddle_objective(const vector<double>& errors, double lambda_mean, double lambda_stdd) {
+    VecStats stats = vec_stats(errors);
+    return twiddle_objective(stats.mae, stats.stdd, lambda_mean, lambda_stdd);
+}
+
+
+/*
+ * @brief       The same objective from summary statistics, for callers that keep running sums.
+ * @param[in]   mae             Mean absolute error
+ * @param[in]   stdd            Standard deviation of the error
+ */
+double twiddle_objective(double mae, double stdd, double lambda_mean, double lambda_stdd) {
+    return lambda_mean * mae + lambda_stdd * stdd;
 }
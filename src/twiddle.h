@@ -3,10 +3,19 @@
 
 #include <vector>
 #include <limits>
+#include <functional>
 #include "PID.h"
 #include "vector_utils.h"
+#include "sketch.h"
 #include "say_time.h"
 
+class PairedSPRT;
+
+/*
+ * A predicate on a parameter vector, checked before spending an evaluation on it.
+ */
+typedef std::function<bool(const std::vector<double>&)> CandidateFilter;
+
 enum last_change_enum { INCREASE, DECREASE, NONE };
 typedef enum last_change_enum last_change_t;
 
@@ -16,6 +25,8 @@ class Twiddler {
 private:
   std::vector<double> parameters;
   std::vector<double> diff_parameters;
+  std::vector<double> best_parameters;
+  std::vector<bool> frozen;
 
   unsigned int i_param;
   int iterations;
@@ -25,19 +36,30 @@ private:
 
   bool declared_convergence;
 
+  // A verdict decided outside, e.g. by a sequential test, overriding the comparison with best_error.
+  bool has_verdict;
+  bool verdict;
+
   void moveOn(double error);
   void succeed(double error);
   void fail(double error);
 
   bool check_error(double error);
+  void skip_frozen();
 
 public:
   Twiddler(int nparams, double tol);
   bool twiddle(double error);
+  bool twiddle(double error, bool improved);
   std::vector<double> get_params();
+  std::vector<double> get_best_params();
   void set_params(std::vector<double> new_parameters);
   void set_diff_params(std::vector<double> new_diff_params);
+  void set_frozen(std::vector<bool> new_frozen);
   bool is_converged();
+  int get_iterations();
+  double get_best_error();
+  void set_best_error(double error);
 };
 
 class TwiddlerManager {
@@ -46,18 +68,100 @@ private:
   std::vector<PID*> pids;
   Twiddler twiddler;
   
-  std::vector<double> absolute_errors;
   std::vector<double> errors;
 
   unsigned int tmin, tmax, num_discarded;
 
+  unsigned long num_windows;
+  unsigned long num_gain_changes;
+  double last_objective;
+
+  // Windows aligned to track position rather than sample count (see set_window_distance).
+  double window_distance;
+  bool reset_between;
+  double odometer;
+  double next_boundary;
+  bool reset_requested;
+
+  // After a failed probe, drive with the best gains until the car has settled (see fail_window).
+  bool recovering;
+  double settled_cte;
+  unsigned int settled_samples;
+  unsigned int recovery_samples;
+  bool recovery_crossed;
+
+  void apply_params(const std::vector<double>& p);
+
+  // Sequential decisions (see set_sprt): probe and incumbent segments alternate in pairs until the test resolves.
+  PairedSPRT* sprt;
+  unsigned int segment;
+  bool sprt_on_probe;                   // the current segment drives the probe, not the best gains
+  bool sprt_baseline;                   // no probe yet: the starting gains drive every segment
+  std::vector<double> segment_params;   // gains the current segment drives with
+  double pending_probe;                 // segment objectives of the current pair (NaN until driven)
+  double pending_incumbent;
+  double incumbent_sum;                 // sum over every segment the best gains have driven since they became best
+  unsigned int incumbent_count;
+
+  double segment_objective();
+  void process_segment(double error);
+  void start_segment(bool probe);
+  void restart_sprt();
+
+  // |cte| distributions of the current window and lap, in constant memory.
+  KLLSketch window_sketch, lap_sketch;
+  TailQuantiles window_tails;
+
+  CandidateFilter filter;
+  void apply_filter();
+
 public:
   double lambda_mean;
   double lambda_stdd;
+  double lambda_tail;  // weight of the window's p95 |cte| in the objective
   TwiddlerManager(std::vector<PID*>& pids, unsigned int tmax, double tol, unsigned int tmin);
   void process_error(double error);
+  void process_error(double error, double ds);
+  void set_window_distance(double meters, bool reset_between);
+  void set_sprt(PairedSPRT* sprt, unsigned int segment);
+  bool take_reset();
+  void fail_window(bool recover, double settled_cte=1.0);
+  bool is_recovering();
+  bool is_converged();
+  void set_filter(CandidateFilter filter);
+  void freeze(std::vector<bool> frozen);
+  void reload_params();
+  unsigned long get_num_windows();
+  unsigned long get_num_gain_changes();
+  int get_iterations();
+  double get_last_objective();
+  double get_best_objective();
+  TailQuantiles get_window_tails();
+  TailQuantiles get_lap_tails();
+  TailQuantiles end_lap();
 
 };
 
+/*
+ * Parse --tail-weight (lambda_tail, default 0) and --lap-length (meters; 0, the default, disables laps).
+ */
+void parse_tail_options(int argc, char* argv[], double& lambda_tail, double& lap_length);
+
+/*
+ * Parse --window-distance M, or --window-laps N (N * lap_length), for windows ending
+ * every M meters driven, and --window-reset to put the car back at the start between them.
+ */
+void parse_window_options(int argc, char* argv[], double lap_length, double& window_distance, bool& reset_between);
+
+/*
+ * Parse --freeze I,J,... (parameter indices, steering Kp Ki Kd then throttle Kp Ki Kd) and
+ * --freeze-from FILE, a ./sensitivity CSV whose gains with a total-order index below
+ * --freeze-below (default 0.05) are frozen. Returns one flag per parameter.
+ */
+std::vector<bool> parse_freeze_options(int argc, char* argv[], unsigned int nparams);
+
+double twiddle_objective(const std::vector<double>& errors, double lambda_mean=2.0, double lambda_stdd=1.0);
+double twiddle_objective(double mae, double stdd, double lambda_mean=2.0, double lambda_stdd=1.0);
+
 
 #endif /* TWIDDLE_H */
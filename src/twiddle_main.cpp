@@ -1,13 +1,26 @@
 #include <iostream>
 #include <cmath>
-#include <algorithm>  // std::min, std::max
+#include <algorithm>  // std::min, std::max, std::count
 #include <fstream> // std::ofstream
+#include <cstring>    // strcmp
 #include "json.hpp"
 
 #include <uWS/uWS.h>
 #include "PID.h"
 
 #include "twiddle.h"
+#include "halving.h"
+#include "shadow.h"
+#include "stability.h"
+#include "relay.h"
+#include "offtrack.h"
+#include "handler.h"
+#include "sprt.h"
+#include "metrics.h"
+#include "cadence.h"
+#include "perf_counters.h"
+#include "follow.h"
+#include "trace.h"
 #include "say_time.h"
 
 
@@ -29,24 +42,37 @@ double deg2rad(double x) { return x * pi() / 180; }
 
 double rad2deg(double x) { return x * 180 / pi(); }
 
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-std::string hasData(std::string s) {
-    auto found_null = s.find("null");
-    auto b1 = s.find_first_of("[");
-    auto b2 = s.find_last_of("]");
-    if (found_null != std::string::npos) {
-        return "";
-    } else if (b1 != std::string::npos && b2 != std::string::npos) {
-        return s.substr(b1, b2 - b1 + 1);
-    }
-    return "";
+/*
+ * Per-connection state, kept as the websocket's user data.
+ */
+struct Connection {
+    unsigned long frames = 0;
+    CadenceMonitor* cadence = nullptr;
+    HalvingWorker* worker = nullptr;  // only in halving mode
+};
+
+
+/*
+ * @brief       Completion callback for ws.send, to track replies not yet written to the socket.
+ */
+void on_sent(uWS::WebSocket<uWS::SERVER> ws, void *data, bool cancelled, void *reserved) {
+    metrics_add(GAUGE_SEND_QUEUE_DEPTH, -1);
+}
+
+
+/*
+ * @brief       Send a reply, counting it in the metrics.
+ */
+void send_reply(uWS::WebSocket<uWS::SERVER> ws, const std::string& msg) {
+    TRACE_SPAN("ws.send");
+    metrics_add(GAUGE_SEND_QUEUE_DEPTH, 1);
+    metrics_count(COUNTER_BYTES_SENT, msg.length());
+    ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT, on_sent);
 }
 
 
 
-int main() {
+int main(int argc, char* argv[]) {
     uWS::Hub h;
 
     PID pid_steering;
@@ -81,75 +107,217 @@ int main() {
     // Finally, after examining the PV(t), CV(t) recordings, I guessed that the large Kd value
     // was causing some of the overreacting to small disturbances, and so reduced it from the ZN prediction.
     // Basically, I took very little from ZN.
+    // `./twiddle --relay` now estimates Kc and Tc automatically with a relay-feedback
+    // experiment instead (see relay.h), and starts twiddling from the gains it suggests.
     pid_steering.Init(0.110293, 0.000680556, 0.797399);
 
     pid_throttle.Init(0.3, 0, 0.02);
 
     std::vector<PID*> pids = {&pid_steering};//, &pid_throttle};
 
+    // With --tune-throttle, twiddle the throttle gains too.
+    for(int i=1; i<argc; i++) {
+        if(strcmp(argv[i], "--tune-throttle") == 0)
+            pids.push_back(&pid_throttle);
+    }
+
     // Time-average the CTE to get an error value for Twiddle.
     TwiddlerManager twiddler_manager(pids, NSAMPLES, TWIDDLETOL, NDISCARD);
 
+    // With --freeze or --freeze-from, hold some gains fixed, e.g. those ./sensitivity
+    // finds the objective insensitive to, and twiddle only the rest.
+    std::vector<bool> frozen = parse_freeze_options(argc, argv, pids.size() * 3);
+    if(std::count(frozen.begin(), frozen.end(), true) > 0)
+        twiddler_manager.freeze(frozen);
+
+    // With --tail-weight W, also penalize the window's p95 |cte|.
+    // With --lap-length L, report |cte| tails every L meters driven.
+    double lap_length;
+    parse_tail_options(argc, argv, twiddler_manager.lambda_tail, lap_length);
+
+    // With --sprt, decide each probe by a sequential test on paired segments of --sprt-segment
+    // samples, probe and best gains alternating, instead of one window per probe.
+    unsigned int sprt_segment;
+    PairedSPRT* sprt = parse_sprt(argc, argv, sprt_segment);
+    if(sprt)
+        twiddler_manager.set_sprt(sprt, sprt_segment);
+
+    // With --window-laps N or --window-distance M, score each candidate over the same
+    // stretch of track, and with --window-reset from the start line every time.
+    double window_distance;
+    bool window_reset;
+    parse_window_options(argc, argv, lap_length, window_distance, window_reset);
+    if(window_distance > 0 && !sprt)
+        twiddler_manager.set_window_distance(window_distance, window_reset);
+
+    // With --offtrack, fail a probe as soon as the car leaves the road, stalls or oscillates
+    // with growing swings; then reset the simulator (with --offtrack-reset or --window-reset)
+    // or drive back to the centerline with the best gains so far before the next probe.
+    OffTrackDetector* offtrack = parse_offtrack_detector(argc, argv);
+    bool offtrack_reset = window_reset;
+    for(int i=1; i<argc; i++) {
+        if(strcmp(argv[i], "--offtrack-reset") == 0)
+            offtrack_reset = true;
+    }
+    TuneStage tune_stage(twiddler_manager, pid_steering, pid_throttle, offtrack, offtrack_reset, lap_length, epoch_time());
+
+    // With --prescreen, skip candidates whose closed loop is unstable or has
+    // poor margins on a plant model, without spending a window on them.
+    StabilityFilter* stability = parse_stability_filter(argc, argv, TARGETSPEED);
+    CandidateFilter candidate_filter = nullptr;
+    if(stability) {
+        candidate_filter = [stability](const std::vector<double>& p) { return stability->accept(p); };
+        twiddler_manager.set_filter(candidate_filter);
+    }
+
+    // With --halving or --hyperband, screen candidate gains instead of twiddling,
+    // each connected simulator evaluating its own share of the schedule.
+    HalvingOptions halving_options = parse_halving_options(argc, argv, NSAMPLES);
+    HalvingScheduler* halving_scheduler = nullptr;
+    if(halving_options.enabled) {
+        std::vector<double> center = {pid_steering.Kp, pid_steering.Ki, pid_steering.Kd};
+        halving_scheduler = new HalvingScheduler(halving_options, center, candidate_filter);
+    }
+
+    // With --shadow K, K candidate controllers watch every frame instead,
+    // and take over the steering when they look better than the active gains.
+    ShadowOptions shadow_options = parse_shadow_options(argc, argv);
+    ShadowTournament* shadow = nullptr;
+    if(shadow_options.num_candidates > 0) {
+        std::mt19937 rng(shadow_options.seed);
+        std::vector<double> center = {pid_steering.Kp, pid_steering.Ki, pid_steering.Kd};
+        shadow = new ShadowTournament(&pid_steering,
+                sample_candidates(center, shadow_options.spread, shadow_options.num_candidates, rng),
+                shadow_options, MAXANGLE);
+    }
+
+    // With --relay, start with a relay-feedback experiment to pick initial gains,
+    // then twiddle from there.
+    tuning_rule_t relay_rule;
+    RelayAutotuner* relay = parse_relay_autotuner(argc, argv, pid_steering.Kd / pid_steering.Kp, relay_rule);
+    long relay_last_t = epoch_time();
+
+    // Watch the event loop's lag and each connection's frame cadence.
+    unsigned int lag_interval_ms;
+    double lag_alert_ms, jitter_alert_ms;
+    parse_cadence_options(argc, argv, lag_interval_ms, lag_alert_ms, jitter_alert_ms);
+    LoopLagProbe lag_probe(h.getLoop(), lag_interval_ms, lag_alert_ms);
+    unsigned int num_connections = 0;
+
+    // With --perf, count cycles, instructions, cache and branch misses per handler stage.
+    PerfCounters* perf = parse_perf_counters(argc, argv);
+
+    // With --follow FILE, keep a summary of a twiddle log (e.g. this run's, through tee) at /tune.
+    TuneFollower* follower = parse_tune_follower(argc, argv, h.getLoop());
+
     std::ofstream cte_log_file;
     cte_log_file.open("cte.csv", std::ios::trunc);
 
-    h.onMessage([&pid_steering, &pid_throttle, &twiddler_manager, &cte_log_file](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
+#ifdef PID_TRACE
+    trace_dump_at_exit("trace.json");
+#endif
+
+    h.onMessage([&pid_steering, &pid_throttle, &twiddler_manager, &cte_log_file, shadow, relay, relay_rule, &relay_last_t, perf, &tune_stage](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
         // "42" at the start of the message means there's a websocket message event.
         // The 4 signifies a websocket message
         // The 2 signifies a websocket event
+        StageClock clock;
+        PerfScope perf_scope(perf, STAGE_TOTAL);
+        metrics_count(COUNTER_MESSAGES);
+        metrics_count(COUNTER_BYTES_RECEIVED, length);
         if (length && length > 2 && data[0] == '4' && data[1] == '2') {
-            auto s = hasData(std::string(data).substr(0, length));
+            auto s = hasData(std::string(data, length));
             if (s != "") {
-                auto j = json::parse(s);
+                json j;
+                {
+                    TRACE_SPAN("json::parse");
+                    j = json::parse(s);
+                }
                 std::string event = j[0].get<std::string>();
                 if (event == "telemetry") {
                     // j[1] is the data JSON object
-                    double cte = std::stod(j[1]["cte"].get<std::string>());
-                    double speed = std::stod(j[1]["speed"].get<std::string>());
-                    double angle = std::stod(j[1]["steering_angle"].get<std::string>());
-
-
-                    pid_steering.UpdateError(cte);
-
-                    double speedTarget = TARGETSPEED;
-                    pid_throttle.UpdateError(speed - speedTarget);
-
-
-                    /*
-                    * Calcuate steering value here, remember the steering value is
-                    * [-1, 1].
-                    * NOTE: Feel free to play around with the throttle and speed. Maybe use
-                    * another PID controller to control the speed!
-                    */
-                    double steer_value = std::max(-1.0, std::min(1.0, pid_steering.TotalError()));
-                    double throttle = std::max(pid_throttle.TotalError(), 0.0);
+                    Telemetry telemetry = parse_telemetry(j[1]);
+                    double cte = telemetry.cte;
+                    double speed = telemetry.speed;
+                    clock.lap(STAGE_PARSE);
+
+                    metrics_count(COUNTER_FRAMES);
+                    Connection* connection = (Connection*) ws.getUserData();
+                    if(connection) {
+                        connection->frames++;
+                        connection->cadence->frame();
+                    }
+
+                    // In halving mode, each connection drives with its own controllers.
+                    HalvingWorker* worker = connection ? connection->worker : nullptr;
+                    PID& steering = worker ? worker->pid_steering : pid_steering;
+                    PID& throttling = worker ? worker->pid_throttle : pid_throttle;
+
+                    // Steering in [-1, 1] from the cte, and throttle towards the target speed.
+                    Controls controls = control_step(steering, throttling, telemetry, TARGETSPEED);
+
+                    // While the relay experiment runs, it steers instead.
+                    bool relaying = relay && !relay->is_done();
+                    if(relaying) {
+                        long t = epoch_time();
+                        controls.steer = relay->control(cte, (t - relay_last_t) / 49.0);
+                        relay_last_t = t;
+                        if(relay->is_done() && relay->succeeded()) {
+                            std::vector<double> p = relay->gains(relay_rule);
+                            pid_steering.Init(p[0], p[1], p[2]);
+                            pid_steering.Reset();
+                            twiddler_manager.reload_params();
+                        }
+                    }
+
+                    clock.lap(STAGE_CONTROL);
 
                     // Save to log file.
-                    cte_log_file <<epoch_time()<<", " <<cte<<","   <<speed<<"," <<angle<<",";
-                    cte_log_file <<steer_value<<","   <<throttle<<"," <<pid_steering.i_error<< std::endl;
+                    log_frame(cte_log_file, telemetry, controls, steering.i_error);
+                    clock.lap(STAGE_LOG);
 
-                    json msgJson;
-                    msgJson["steering_angle"] = steer_value;
-                    msgJson["throttle"] = throttle;
-                    auto msg = "42[\"steer\"," + msgJson.dump() + "]";
+                    std::string msg = steer_message(controls);
                     // std::cout << msg << std::endl;
-                    ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
-
-                    twiddler_manager.process_error(cte);
+                    clock.lap(STAGE_SERIALIZE);
+                    send_reply(ws, msg);
+                    clock.lap(STAGE_SEND);
+
+                    PerfScope tune_perf_scope(perf, STAGE_TUNE);
+                    if(worker) {
+                        worker->process_error(cte);
+                    } else if(relaying) {
+                        // Nothing to score until the relay experiment is over.
+                    } else if(shadow) {
+                        shadow->process(cte, speed, controls.steer);
+                    } else if(tune_stage.process(telemetry, epoch_time())) {
+                        // Back to the start line for the next candidate.
+                        send_reply(ws, "42[\"reset\",{}]");
+                    }
+                    clock.lap(STAGE_TUNE);
                 }
             } else {
                 // Manual driving
+                metrics_count(COUNTER_MANUAL);
                 std::string msg = "42[\"manual\",{}]";
-                ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+                send_reply(ws, msg);
             }
         }
     });
 
-    // We don't need this since we're not using HTTP but if it's removed the program
-    // doesn't compile :-(
-    h.onHttpRequest([](uWS::HttpResponse *res, uWS::HttpRequest req, char *data, size_t, size_t) {
+    // Serve the metrics for Prometheus (or curl) at /metrics, the spans recorded so far at /trace,
+    // and the followed log's summary at /tune.
+    h.onHttpRequest([follower](uWS::HttpResponse *res, uWS::HttpRequest req, char *data, size_t, size_t) {
         const std::string s = "<h1>Hello world!</h1>";
-        if (req.getUrl().valueLength == 1) {
+        if (req.getUrl().toString() == "/metrics") {
+            std::string body = metrics_exposition() + cadence_exposition();
+            res->end(body.data(), body.length());
+        } else if (req.getUrl().toString() == "/trace") {
+            std::string body = trace_json();
+            res->end(body.data(), body.length());
+        } else if (req.getUrl().toString() == "/tune" && follower) {
+            std::string body = follower->summary_json();
+            res->end(body.data(), body.length());
+        } else if (req.getUrl().valueLength == 1) {
             res->end(s.data(), s.length());
         } else {
             // i guess this should be done more gracefully?
@@ -157,11 +325,30 @@ int main() {
         }
     });
 
-    h.onConnection([&h](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+    h.onConnection([&h, halving_scheduler, jitter_alert_ms, &num_connections](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
         std::cout << "Connected!!!" << std::endl;
+        metrics_count(COUNTER_CONNECTIONS);
+        metrics_add(GAUGE_CONNECTIONS_ACTIVE, 1);
+        Connection* connection = new Connection();
+        connection->cadence = new CadenceMonitor(++num_connections, jitter_alert_ms);
+        if(halving_scheduler) {
+            connection->worker = new HalvingWorker(halving_scheduler, NDISCARD);
+        }
+        ws.setUserData(connection);
     });
 
     h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
+        Connection* connection = (Connection*) ws.getUserData();
+        if(connection) {
+            metrics_count(COUNTER_DISCONNECTIONS);
+            metrics_add(GAUGE_CONNECTIONS_ACTIVE, -1);
+            metrics_record(HISTOGRAM_CONNECTION_FRAMES, connection->frames);
+            connection->cadence->summarize();
+            delete connection->cadence;
+            delete connection->worker;
+            delete connection;
+        }
+        ws.setUserData(nullptr);
         ws.close();
         std::cout << "Disconnected" << std::endl;
     });
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <cmath>
+#include <vector>
+
+#include "PID.h"
+#include "twiddle.h"
+#include "sprt.h"
+
+// Set parameters.
+#define KP 0.2
+#define KI 0.001
+#define KD 3.0
+#define TMAX 10
+
+static int failures = 0;
+
+#define CHECK(condition) check(condition, #condition, __LINE__)
+
+
+void check(bool condition, const char* text, int line) {
+    if(!condition) {
+        std::cerr << "twiddle_test.cpp:" << line << ": FAIL: " << text << std::endl;
+        failures++;
+    }
+}
+
+
+/*
+ * @brief       A manager over one PID at KP, KI, KD, after its first window, driving the first probe.
+ */
+TwiddlerManager* start_first_probe(PID& pid, std::vector<PID*>& pids) {
+    pid.Init(KP, KI, KD);
+    pids = {&pid};
+    TwiddlerManager* manager = new TwiddlerManager(pids, TMAX, 0.001, 0);
+    for(int i=0; i<TMAX; i++) {
+        manager->process_error(0.5);
+    }
+    return manager;
+}
+
+
+/*
+ * The first probe leaving the road is a failure, although no window has set a best objective yet:
+ * its step is not grown, and recovery drives the starting gains, not the probe's.
+ */
+void test_failed_first_probe(bool recover) {
+    PID pid;
+    std::vector<PID*> pids;
+    TwiddlerManager* manager = start_first_probe(pid, pids);
+    double dp = pid.Kp - KP;
+    CHECK(dp > 0);
+
+    manager->fail_window(recover);
+    CHECK(std::isinf(manager->get_best_objective()));
+    if(recover) {
+        CHECK(manager->is_recovering());
+        CHECK(pid.Kp == KP);
+        for(int i=0; i<TMAX; i++) {
+            manager->process_error(0);
+        }
+        CHECK(!manager->is_recovering());
+    }
+
+    // The increase failed, so the decrease is next, by the same step.
+    CHECK(std::fabs(pid.Kp - (KP - dp)) < 1e-12);
+    delete manager;
+}
+
+
+/*
+ * In sequential mode, the best gains leaving the road during their segment void the test, but the
+ * probe is not scored: after the reset, the same probe drives again.
+ */
+void test_failed_incumbent_segment() {
+    PID pid;
+    pid.Init(KP, KI, KD);
+    std::vector<PID*> pids = {&pid};
+    TwiddlerManager manager(pids, TMAX, 0.001, 0);
+    PairedSPRT sprt;
+    manager.set_sprt(&sprt, TMAX);
+
+    // Two baseline segments, then the probe's; the best gains drive the second of the first pair.
+    for(int i=0; i<2*TMAX; i++) {
+        manager.process_error(0.5);
+    }
+    double probe_kp = pid.Kp;
+    CHECK(probe_kp > KP);
+    for(int i=0; i<TMAX; i++) {
+        manager.process_error(0.5);
+    }
+    CHECK(pid.Kp == KP);
+
+    manager.fail_window(false);
+    CHECK(pid.Kp == probe_kp);
+    CHECK(std::fabs(manager.get_best_objective() - 1) < 1e-12);
+}
+
+
+/*
+ * Check Twiddle's bookkeeping of failed probes; exits with status 1 on any failure.
+ */
+int main() {
+    test_failed_first_probe(true);
+    test_failed_first_probe(false);
+    test_failed_incumbent_segment();
+    if(failures > 0) {
+        std::cerr << failures << " checks failed." << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}
@@ -2,8 +2,8 @@
 #define VECTOR_UTILS_H
 
 #include <vector>
-#include <cmath>
 #include <iostream>
+#include "stats.h"
 
 // PRINTING
 
@@ -29,47 +29,29 @@ void vec_print(std::vector<T> v, std::string name) {
 
 
 // STATISTICS
+// Thin wrappers around vec_stats (stats.h); use it directly when you need more than one.
 
 /*
  * @brief       Sum a vector.
  */
-template <typename T>
-T vec_sum(std::vector<T> v) {
-    T out = 0;
-    for(auto & x : v) {
-        out += x;
-    }
-    return out;
+inline double vec_sum(const std::vector<double>& v) {
+    return vec_stats(v).sum;
 }
 
 
-// TODO: Deal with zero-length vectors reasonably.
 /*
- * @brief       Average the elements of a vector.
+ * @brief       Average the elements of a vector (NaN if empty).
  */
-template<typename T>
-double vec_mean(std::vector<T> v) {
-    T sum = vec_sum(v);
-    return (double) sum / v.size();
+inline double vec_mean(const std::vector<double>& v) {
+    return vec_stats(v).mean;
 }
 
 
 /*
- * @brief       Take the standard deviation of a vector.
+ * @brief       Take the (sample) standard deviation of a vector.
  */
-template<typename T>
-double vec_stdd(std::vector<T> v, double mean) {
-    double sum_squared_differences = 0;
-    for(auto & x : v) {
-        sum_squared_differences += std::pow(x - mean, 2);
-    }
-    return sum_squared_differences / (v.size() - 1);
-}
-
-template<typename T>
-double vec_stdd(std::vector<T> v) {
-    double mean = vec_mean(v);
-    return vec_stdd(v, mean);
+inline double vec_stdd(const std::vector<double>& v) {
+    return vec_stats(v).stdd;
 }
 
-#endif /* VECTOR_UTILS_H */
\ No newline at end of file
+#endif /* VECTOR_UTILS_H */